@@ -0,0 +1,50 @@
+# copyright ################################# #
+# This file is part of the Xfields Package.   #
+# Copyright (c) CERN, 2021.                   #
+# ########################################### #
+
+import time
+
+import numpy as np
+
+from xobjects import ContextCpu, ContextCupy, ContextPyopencl
+from xfieldsdev.solvers import FFTSolver3D, FFTSolver3DR2C, FFTSolver3DPruned
+
+context = ContextCpu()
+#context = ContextCupy(default_block_size=256)
+
+print(repr(context))
+
+nx = ny = nz = 128
+dx = dy = 1e-4
+dz = 1e-2
+n_rep = 10
+
+x = (np.arange(nx) - nx/2) * dx
+y = (np.arange(ny) - ny/2) * dy
+z = (np.arange(nz) - nz/2) * dz
+XX, YY, ZZ = np.meshgrid(x, y, z, indexing='ij')
+rho = np.exp(-XX**2/(2*(10*dx)**2) - YY**2/(2*(10*dy)**2)
+             - ZZ**2/(2*(10*dz)**2))
+rho_dev = context.nparray_to_context_array(np.asfortranarray(rho))
+
+phi_ref = None
+for solver_class in [FFTSolver3D, FFTSolver3DR2C, FFTSolver3DPruned]:
+    solver = solver_class(dx=dx, dy=dy, dz=dz, nx=nx, ny=ny, nz=nz,
+                          context=context)
+    phi = solver.solve(rho_dev) # warm up (plans, caches)
+    context.synchronize()
+
+    t0 = time.perf_counter()
+    for _ in range(n_rep):
+        phi = solver.solve(rho_dev)
+    context.synchronize()
+    t1 = time.perf_counter()
+
+    phi = context.nparray_from_context_array(phi).copy()
+    if phi_ref is None:
+        phi_ref = phi
+    err = np.max(np.abs(phi - phi_ref)) / np.max(np.abs(phi_ref))
+
+    print(f'{solver_class.__name__:20s} {nx}x{ny}x{nz}: '
+          f'{(t1 - t0)/n_rep*1e3:8.2f} ms/solve (rel. diff. {err:.2e})')
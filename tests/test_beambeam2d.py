@@ -6,6 +6,7 @@
 import numpy as np
 
 import xpart as xp
+import xtrack as xt
 
 import ducktrack as dtk
 
@@ -157,3 +158,120 @@ def test_beambeam(test_context):
 
     assert np.allclose(p2np(p_before.px), p2np(particles_b1.px), atol=1e-14)
     assert np.allclose(p2np(p_before.py), p2np(particles_b1.py), atol=1e-14)
+
+
+@for_all_test_contexts
+def test_beambeam_field_table(test_context):
+
+    from xfieldsdev import BeamBeamBiGaussian2D
+
+    sigma_x = 1.7e-3
+    sigma_y = 2.1e-3
+    p0c = 25.92e9
+
+    # Probes inside and outside the table (8 sigma_y)
+    n_probes = 10000
+    rng = np.random.default_rng(seed=123)
+    r_probes = sigma_y * np.concatenate([
+                            rng.uniform(0, 8, n_probes // 2),
+                            rng.uniform(8, 20, n_probes // 2)])
+    theta_probes = rng.uniform(0, 2 * np.pi, n_probes)
+
+    p2np = test_context.nparray_from_context_array
+
+    bbeams = {}
+    px = {}
+    py = {}
+    for field_engine in ['exact', 'table']:
+        bbeams[field_engine] = BeamBeamBiGaussian2D(
+                    _context=test_context,
+                    other_beam_num_particles=3e11,
+                    other_beam_q0=1.,
+                    other_beam_beta0=1.,
+                    other_beam_Sigma_11=sigma_x**2,
+                    other_beam_Sigma_33=sigma_y**2,
+                    other_beam_shift_x=-1e-3,
+                    other_beam_shift_y=1.4e-3,
+                    field_engine=field_engine)
+        assert bbeams[field_engine].field_engine == field_engine
+
+        particles = xp.Particles(_context=test_context, p0c=p0c,
+                mass0=pmass,
+                x=-1e-3 + r_probes * np.cos(theta_probes),
+                y=1.4e-3 + r_probes * np.sin(theta_probes))
+        bbeams[field_engine].track(particles)
+        px[field_engine] = p2np(particles.px)
+        py[field_engine] = p2np(particles.py)
+
+    assert bbeams['exact'].table_max_error is None
+    assert bbeams['table'].table_max_error < 1e-6
+
+    # Errors relative to the peak kick (table_tolerance)
+    kick_max = max(np.max(np.abs(px['exact'])), np.max(np.abs(py['exact'])))
+    assert np.allclose(px['table'], px['exact'], rtol=0, atol=1e-6 * kick_max)
+    assert np.allclose(py['table'], py['exact'], rtol=0, atol=1e-6 * kick_max)
+
+    # With a different sigma_y/sigma_x the exact formula is used
+    for bb in bbeams.values():
+        bb.other_beam_Sigma_33 = (1.5 * sigma_y)**2
+    for field_engine in ['exact', 'table']:
+        particles = xp.Particles(_context=test_context, p0c=p0c,
+                mass0=pmass,
+                x=-1e-3 + r_probes * np.cos(theta_probes),
+                y=1.4e-3 + r_probes * np.sin(theta_probes))
+        bbeams[field_engine].track(particles)
+        px[field_engine] = p2np(particles.px)
+        py[field_engine] = p2np(particles.py)
+
+    assert np.all(px['table'] == px['exact'])
+    assert np.all(py['table'] == py['exact'])
+
+
+@for_all_test_contexts
+def test_beambeam_field_tiles(test_context):
+
+    from xfieldsdev import BeamBeamBiGaussian2D
+
+    # The exact field is evaluated for tiles of particles on the cpu contexts
+    # (get_Ex_Ey_gauss_vec), BIGAUSSIAN_VEC_SCALAR selects the per-particle
+    # evaluation
+    p0c = 25.92e9
+    n_probes = 1001 # not a multiple of the tile size
+    rng = np.random.default_rng(seed=321)
+    coords = dict(x=rng.normal(-1e-3, 5e-3, n_probes),
+                  y=rng.normal(1.4e-3, 5e-3, n_probes))
+
+    p2np = test_context.nparray_from_context_array
+
+    for Sigma_13, Sigma_33 in [(0., 2.1e-3**2), (0.5e-6, 2.1e-3**2),
+                               (0., 1.7e-3**2)]: # elliptic, coupled, round
+        px = {}
+        py = {}
+        for scalar in [True, False]:
+            bb = BeamBeamBiGaussian2D(
+                        _context=test_context,
+                        other_beam_num_particles=3e11,
+                        other_beam_q0=1.,
+                        other_beam_beta0=1.,
+                        other_beam_Sigma_11=1.7e-3**2,
+                        other_beam_Sigma_13=Sigma_13,
+                        other_beam_Sigma_33=Sigma_33,
+                        other_beam_shift_x=-1e-3,
+                        other_beam_shift_y=1.4e-3,
+                        post_subtract_px=1e-7)
+            line = xt.Line(elements=[bb])
+            line.config.BIGAUSSIAN_VEC_SCALAR = scalar
+            line.build_tracker(_context=test_context)
+
+            particles = xp.Particles(_context=test_context, p0c=p0c,
+                    mass0=pmass, **coords)
+            line.track(particles)
+            px[scalar] = p2np(particles.px)
+            py[scalar] = p2np(particles.py)
+
+        # Same formula, the Faddeeva function evaluations differ by less
+        # than 1e-9 (see test_cerrf.py)
+        kick_max = max(np.max(np.abs(px[True])), np.max(np.abs(py[True])))
+        assert kick_max > 0
+        assert np.allclose(px[False], px[True], rtol=0, atol=1e-8 * kick_max)
+        assert np.allclose(py[False], py[True], rtol=0, atol=1e-8 * kick_max)
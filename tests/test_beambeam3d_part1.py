@@ -333,6 +333,155 @@ def test_compute_moments_2(test_context):
             ), f"Mismatch in {binning} binning!"
 
 
+@for_all_test_contexts(excluding=("ContextPyopencl", "ContextCupy"))
+def test_compute_moments_offset_many_slices(test_context):
+    # Small beam far from the axis and more slices than fit in stack
+    # arrays: the single-pass centred moments keep the precision of the
+    # offset-free computation
+    p0c = 182.5e9  # [eV]
+    mass0 = 0.511e6  # [eV]
+    sigma_z_tot = 0.00254  # [m]
+    n_macroparticles = int(2e5)
+    n_slices = 5000
+    threshold_num_macroparticles = 20
+
+    rng = np.random.default_rng(seed=2025)
+    offsets = dict(x=1e-1, px=-2e-2, y=3e-2, py=1e-3)
+    sigmas = dict(x=1e-7, px=1e-8, y=2e-9, py=5e-7)
+    coords = {kk: offsets[kk] + sigmas[kk]*rng.standard_normal(n_macroparticles)
+              for kk in offsets}
+    # correlated x-px
+    coords['px'] += 0.3 * (coords['x'] - offsets['x'])
+
+    particles = xp.Particles(_context=test_context, q0=-1, p0c=p0c,
+                             mass0=mass0,
+                             zeta=sigma_z_tot*rng.standard_normal(n_macroparticles),
+                             delta=1e-3*rng.standard_normal(n_macroparticles),
+                             **coords)
+    particles.state[::17] = 0
+
+    slicer = xf.TempSlicer(_context=test_context, n_slices=n_slices,
+                           sigma_z=sigma_z_tot, mode="unicharge")
+    # all particles in a few slices, so that they pass the threshold
+    slicer.assign_slices(particles)
+    i_slice_all = particles.slice.copy()
+    i_slice_all[i_slice_all >= 0] %= 3
+    i_slice_all[i_slice_all >= 0] += n_slices - 3
+    particles.slice[:] = i_slice_all
+
+    moments = slicer.compute_moments(particles, update_assigned_slices=False,
+                        threshold_num_macroparticles=threshold_num_macroparticles)
+    moments = test_context.nparray_from_context_array(moments).reshape(17, n_slices)
+
+    assert np.all(moments[:, :n_slices - 3] == 0)
+    names = ['x', 'px', 'y', 'py']
+    pairs = [(aa, bb) for ia, aa in enumerate(names) for bb in names[ia:]]
+    for i_slice in range(n_slices - 3, n_slices):
+        mask = i_slice_all == i_slice
+        assert moments[0, i_slice] == mask.sum() * particles.weight[0]
+        for jj, nn in enumerate(names):
+            assert np.isclose(moments[1 + jj, i_slice], coords[nn][mask].mean(),
+                              rtol=1e-14, atol=0)
+        for jj, (aa, bb) in enumerate(pairs):
+            ref = np.mean((coords[aa][mask] - coords[aa][mask].mean())
+                          * (coords[bb][mask] - coords[bb][mask].mean()))
+            scale = np.sqrt(np.var(coords[aa][mask]) * np.var(coords[bb][mask]))
+            assert np.abs(moments[7 + jj, i_slice] - ref) < 1e-6 * scale
+
+
+@for_all_test_contexts(excluding=("ContextPyopencl", "ContextCupy"))
+def test_compute_moments_fused_slicing(test_context):
+    p0c = 182.5e9  # [eV]
+    mass0 = 0.511e6  # [eV]
+    sigma_z_tot = 0.00254  # [m]
+    n_macroparticles = int(1e5)
+    n_slices = 101
+
+    rng = np.random.default_rng(seed=7)
+    particles = xp.Particles(_context=test_context, q0=-1, p0c=p0c, mass0=mass0,
+                             x=1e-5*rng.standard_normal(n_macroparticles),
+                             px=1e-6*rng.standard_normal(n_macroparticles),
+                             y=1e-7*rng.standard_normal(n_macroparticles),
+                             py=1e-6*rng.standard_normal(n_macroparticles),
+                             zeta=sigma_z_tot*rng.standard_normal(n_macroparticles),
+                             delta=1e-3*rng.standard_normal(n_macroparticles))
+    particles.state[::23] = 0
+
+    for mode in ["unibin", "unicharge", "shatilov"]:
+        slicer = xf.TempSlicer(_context=test_context, n_slices=n_slices,
+                               sigma_z=sigma_z_tot, mode=mode)
+        # particles on the bin edges
+        particles.zeta[:n_slices + 1] = slicer.bin_edges
+
+        # two passes: digitize, then moments
+        slicer.assign_slices(particles)
+        slices_ref = particles.slice.copy()
+        moments_ref = slicer.compute_moments(particles,
+                                             update_assigned_slices=False)
+
+        # one pass, without touching particles.slice
+        particles.slice[:] = -7
+        moments = slicer.compute_moments(particles, store_slices=False)
+        assert np.all(particles.slice == -7)
+        assert np.all(moments == moments_ref), mode
+
+        # one pass, storing the slices
+        moments = slicer.compute_moments(particles)
+        assert np.all(particles.slice == slices_ref), mode
+        assert np.all(moments == moments_ref), mode
+        expected = np.digitize(particles.zeta, slicer.bin_edges, right=True) - 1
+        expected[particles.state <= 0] = -1
+        assert np.all(particles.slice == expected), mode
+
+
+@for_all_test_contexts(excluding=("ContextPyopencl", "ContextCupy"))
+def test_compute_moments_incremental(test_context):
+    p0c = 182.5e9  # [eV]
+    mass0 = 0.511e6  # [eV]
+    sigma_z_tot = 0.00254  # [m]
+    n_macroparticles = int(1e5)
+    n_slices = 50
+
+    rng = np.random.default_rng(seed=11)
+    zeta = sigma_z_tot*rng.standard_normal(n_macroparticles)
+    # some particles beyond the bin edges (at +-5 sigma_z)
+    zeta[:1000] = np.sign(zeta[:1000]) * 6 * sigma_z_tot
+    particles = xp.Particles(_context=test_context, q0=-1, p0c=p0c, mass0=mass0,
+                             x=1e-3 + 1e-6*rng.standard_normal(n_macroparticles),
+                             px=1e-7*rng.standard_normal(n_macroparticles),
+                             y=1e-8*rng.standard_normal(n_macroparticles),
+                             py=1e-6*rng.standard_normal(n_macroparticles),
+                             zeta=zeta,
+                             delta=1e-3*rng.standard_normal(n_macroparticles))
+
+    slicer = xf.TempSlicer(_context=test_context, n_slices=n_slices,
+                           sigma_z=sigma_z_tot, mode="unicharge")
+    inc = xf.IncrementalSliceMoments(slicer)
+    moments = inc.reset(particles)
+    assert np.all(moments == slicer.compute_moments(particles, store_slices=False))
+
+    slice_index = slicer.get_slice_indices(particles)
+    for i_step in range(10):
+        # move the particles of a few slices, some to other slices
+        ids = np.where((slice_index >= i_step) & (slice_index < i_step + 3))[0]
+        # and some of the particles beyond the bin edges, moved inside
+        ids_out = np.where((slice_index < 0) | (slice_index >= n_slices))[0]
+        ids_out = ids_out[i_step::10]
+        ids = np.concatenate([ids, ids_out])
+        inc.remove(particles, ids)
+        particles.px[ids] += 1e-8*rng.standard_normal(len(ids))
+        particles.x[ids] += 1e-7*rng.standard_normal(len(ids))
+        particles.zeta[ids] += 0.1*sigma_z_tot*rng.standard_normal(len(ids))
+        particles.zeta[ids_out] *= 0.5
+        particles.state[ids[::97]] = 0
+        inc.add(particles, ids)
+
+        moments = inc.get_moments(particles)
+        moments_ref = slicer.compute_moments(particles, store_slices=False)
+        assert np.all(moments[:n_slices] == moments_ref[:n_slices])
+        assert np.allclose(moments, moments_ref, rtol=1e-8, atol=1e-20)
+
+
 def sigma_configurations():
     print("decoupled round beam")
     (
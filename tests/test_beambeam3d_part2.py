@@ -441,3 +441,242 @@ def test_beambeam3d_old_interface(test_context, Sig_11_0, Sig_12_0, Sig_13_0,
         print(f'before: {cc} = {val_ref:.12e}')
         print(f'after bb off:    {cc} = {val_test:.12e}')
         assert np.allclose(val_test, val_ref, rtol=0, atol=1e-14)
+
+
+@for_all_test_contexts
+def test_beambeam3d_slice_record(test_context):
+
+    from xfieldsdev.beam_elements.beambeam3d import (
+        _SLICE_RECORD_FIELDS, _SLICE_RECORD_SIZE)
+
+    n_slices = 5
+    bb = xf.BeamBeamBiGaussian3D(
+        _context=test_context,
+        phi=0.1, alpha=0.2,
+        other_beam_q0=1,
+        slices_other_beam_num_particles=np.linspace(1e10, 2e10, n_slices),
+        slices_other_beam_zeta_center=np.linspace(0.1, -0.1, n_slices),
+        slices_other_beam_x_center=np.linspace(-1e-6, 1e-6, n_slices),
+        slices_other_beam_Sigma_11=np.linspace(1e-6, 2e-6, n_slices),
+        slices_other_beam_Sigma_12=0,
+        slices_other_beam_Sigma_22=1e-9,
+        slices_other_beam_Sigma_33=np.linspace(3e-6, 4e-6, n_slices),
+        slices_other_beam_Sigma_34=0,
+        slices_other_beam_Sigma_44=1e-9,
+    )
+
+    ctx2np = bb._context.nparray_from_context_array
+
+    def check_record():
+        record = ctx2np(bb._slices_other_beam_packed).reshape(
+                                            n_slices, _SLICE_RECORD_SIZE)
+        for ii, nn in enumerate(_SLICE_RECORD_FIELDS):
+            assert np.all(record[:, ii] == ctx2np(getattr(bb, nn)))
+        # Tabulated slice invariants
+        i0 = len(_SLICE_RECORD_FIELDS)
+        S11 = ctx2np(bb.slices_other_beam_Sigma_11_star)
+        S33 = ctx2np(bb.slices_other_beam_Sigma_33_star)
+        S22 = ctx2np(bb.slices_other_beam_Sigma_22_star)
+        S44 = ctx2np(bb.slices_other_beam_Sigma_44_star)
+        assert np.allclose(record[:, i0 + 0], S11 - S33, rtol=0, atol=1e-20)
+        assert np.allclose(record[:, i0 + 3], S11 + S33, rtol=0, atol=1e-20)
+        assert np.allclose(record[:, i0 + 5], S22 + S44, rtol=0, atol=1e-20)
+
+    check_record()
+
+    # Setting a per-slice array
+    bb.slices_other_beam_y_center_star = bb._arr2ctx(
+                                        np.linspace(2e-6, 3e-6, n_slices))
+    check_record()
+
+    # Setting an element through the unboosted Sigma
+    bb.slices_other_beam_Sigma_33[2] = 5e-6
+    check_record()
+
+    # In-place modification of the per-slice arrays
+    bb.slices_other_beam_num_particles[3] = 0
+    check_record()
+    bb.slices_other_beam_x_center_star[1] = 2e-6
+    check_record()
+    bb.slices_other_beam_Sigma_44_star[:] = 2e-9
+    check_record()
+
+
+@for_all_test_contexts
+def test_beambeam3d_slice_record_inplace_kick(test_context):
+
+    n_slices = 5
+    bb_kwargs = dict(
+        phi=0.1, alpha=0.2,
+        other_beam_q0=1,
+        slices_other_beam_num_particles=np.linspace(1e10, 2e10, n_slices),
+        slices_other_beam_zeta_center=np.linspace(0.1, -0.1, n_slices),
+        slices_other_beam_x_center=np.linspace(-1e-6, 1e-6, n_slices),
+        slices_other_beam_Sigma_11=np.linspace(1e-6, 2e-6, n_slices),
+        slices_other_beam_Sigma_12=0,
+        slices_other_beam_Sigma_22=1e-9,
+        slices_other_beam_Sigma_33=np.linspace(3e-6, 4e-6, n_slices),
+        slices_other_beam_Sigma_34=0,
+        slices_other_beam_Sigma_44=1e-9,
+    )
+
+    bb = xf.BeamBeamBiGaussian3D(_context=test_context, **bb_kwargs)
+    bb_ref = xf.BeamBeamBiGaussian3D(_context=test_context, **bb_kwargs)
+
+    # Modify one slice in place, the reference is rebuilt from the arrays
+    ctx2np = bb._context.nparray_from_context_array
+    bb.slices_other_beam_x_center_star[2] = 3e-6
+    bb.slices_other_beam_num_particles[:] = 3e10
+    x_star = ctx2np(bb_ref.slices_other_beam_x_center_star).copy()
+    x_star[2] = 3e-6
+    bb_ref.slices_other_beam_x_center_star = bb_ref._arr2ctx(x_star)
+    bb_ref.slices_other_beam_num_particles = bb_ref._arr2ctx(
+                                            np.full(n_slices, 3e10))
+
+    rng = np.random.default_rng(3)
+    part = xp.Particles(_context=test_context, p0c=7e12,
+                        x=1e-3*rng.normal(size=100),
+                        y=1e-3*rng.normal(size=100),
+                        zeta=0.1*rng.normal(size=100))
+    part_ref = part.copy()
+    part_unmodified = part.copy()
+
+    bb.track(part)
+    bb_ref.track(part_ref)
+    xf.BeamBeamBiGaussian3D(_context=test_context, **bb_kwargs).track(
+                                                            part_unmodified)
+
+    for cc in ['x', 'px', 'y', 'py', 'zeta', 'delta']:
+        val = ctx2np(getattr(part, cc))
+        assert np.all(val == ctx2np(getattr(part_ref, cc)))
+    assert not np.all(ctx2np(part.px) == ctx2np(part_unmodified.px))
+
+
+@pytest.mark.parametrize('omp_num_threads', [0, 2],
+                         ids=['cpu_serial', 'cpu_openmp'])
+@for_all_sigma_configurations
+def test_beambeam3d_particle_blocking(omp_num_threads, Sig_11_0, Sig_12_0,
+        Sig_13_0, Sig_14_0, Sig_22_0, Sig_23_0, Sig_24_0, Sig_33_0, Sig_34_0,
+        Sig_44_0):
+
+    # The blocked loop is only used on the cpu contexts
+    test_context = xo.ContextCpu(omp_num_threads=omp_num_threads)
+
+    charge_slices = np.array([1e16, 2e16, 5e16])
+    z_slices = np.array([-6.0, 0.2, 5.5])
+
+    sigmas = {}
+    for ij, val in zip(['11', '12', '13', '14', '22', '23', '24', '33', '34', '44'],
+                       [Sig_11_0, Sig_12_0, Sig_13_0, Sig_14_0, Sig_22_0,
+                        Sig_23_0, Sig_24_0, Sig_33_0, Sig_34_0, Sig_44_0]):
+        sigmas[f'slices_other_beam_Sigma_{ij}'] = val + np.zeros_like(charge_slices)
+        # one slice differs from the others
+        sigmas[f'slices_other_beam_Sigma_{ij}'][1] *= 1000
+
+    bb_kwargs = dict(
+        phi=0.8, alpha=0.7,
+        other_beam_q0=1,
+        slices_other_beam_num_particles=charge_slices,
+        slices_other_beam_zeta_center=z_slices,
+        ref_shift_x=2e-3, ref_shift_y=-3e-3,
+        other_beam_shift_x=5e-3, other_beam_shift_y=-4e-3,
+        post_subtract_px=1e-8,
+        flag_luminosity=1,
+        **sigmas,
+    )
+
+    n_part = 1001 # not a multiple of the block size
+    rng = np.random.default_rng(seed=42)
+    coords = dict(
+        x=rng.normal(2e-3, 1e-4, n_part),
+        px=rng.normal(1e-6, 1e-6, n_part),
+        y=rng.normal(-3e-3, 2e-4, n_part),
+        py=rng.normal(-2e-6, 2e-6, n_part),
+        zeta=rng.normal(0, 5e-2, n_part),
+        delta=rng.normal(0, 1e-4, n_part),
+    )
+
+    num_turns = 2
+    particles = {}
+    lumi = {}
+    for blocking in [False, True]:
+        line = xt.Line(elements=[
+                xf.BeamBeamBiGaussian3D(_context=test_context, **bb_kwargs)])
+        line.config.XFIELDS_BB3D_LUMI_DETERMINISTIC = True
+        if blocking:
+            line.config.XFIELDS_BB3D_PARTICLE_BLOCK = True
+        line.build_tracker(_context=test_context)
+        part = xp.Particles(_context=test_context, p0c=6500e9, **coords)
+        record = line.start_internal_logging_for_elements_of_type(
+            xf.BeamBeamBiGaussian3D, capacity={"beamstrahlungtable": int(0),
+                "bhabhatable": int(0), "lumitable": int(n_part*num_turns)})
+        line.track(part, num_turns=num_turns)
+        line.stop_internal_logging_for_elements_of_type(xf.BeamBeamBiGaussian3D)
+        particles[blocking] = part
+        lumi[blocking] = record.lumitable.get_luminosity_from_partial_sums(
+                                                        num_turns=num_turns)
+
+    # Same operations on each particle in the same order (bitwise identical
+    # unless the compiler contracts them differently)
+    for nn in ['x', 'px', 'y', 'py', 'zeta', 'delta']:
+        assert np.allclose(getattr(particles[True], nn),
+                           getattr(particles[False], nn), rtol=1e-15, atol=0)
+    assert np.all(lumi[False] > 0)
+    assert np.allclose(lumi[True], lumi[False], rtol=1e-15, atol=0)
+
+
+def test_beambeam3d_trace():
+
+    from xfieldsdev.beam_elements.beambeam3d import TRACE_DEPTH
+
+    test_context = xo.ContextCpu()
+
+    n_slices = 5
+    bb_kwargs = dict(
+        phi=0.1, alpha=0.3,
+        other_beam_q0=1,
+        slices_other_beam_num_particles=np.linspace(1e10, 2e10, n_slices),
+        slices_other_beam_zeta_center=np.linspace(0.1, -0.1, n_slices),
+        slices_other_beam_Sigma_11=np.linspace(1e-6, 2e-6, n_slices),
+        slices_other_beam_Sigma_22=1e-9,
+        slices_other_beam_Sigma_33=np.linspace(3e-6, 4e-6, n_slices),
+        slices_other_beam_Sigma_44=1e-9,
+    )
+
+    n_part = 20
+    rng = np.random.default_rng(seed=1)
+    coords = dict(x=rng.normal(0, 1e-3, n_part), y=rng.normal(0, 2e-3, n_part),
+                  zeta=rng.normal(0, 5e-2, n_part))
+
+    particles = {}
+    for trace in [False, True]:
+        line = xt.Line(elements=[
+                xf.BeamBeamBiGaussian3D(_context=test_context, **bb_kwargs)])
+        line.config.XFIELDS_TRACE = trace
+        line.build_tracker(_context=test_context)
+        record = line.start_internal_logging_for_elements_of_type(
+            xf.BeamBeamBiGaussian3D,
+            capacity={'tracetable': n_part * TRACE_DEPTH})
+        part = xp.Particles(_context=test_context, p0c=6500e9, **coords)
+        line.track(part)
+        line.stop_internal_logging_for_elements_of_type(xf.BeamBeamBiGaussian3D)
+        particles[trace] = part
+
+        events = record.tracetable.get_events()
+        if not trace:
+            # Compiled out
+            assert len(events['event']) == 0
+            continue
+
+        # One field and one kick event per particle and slice
+        assert len(events['event']) == 2 * n_slices * n_part
+        for pid in range(n_part):
+            mask = events['particle_id'] == pid
+            assert np.all(events['name'][mask][0::2] == 'bb3d_field')
+            assert np.all(events['name'][mask][1::2] == 'bb3d_kick')
+            assert np.all(events['value_0'][mask][1::2] == np.arange(n_slices))
+
+    # Tracing does not change the tracking
+    for nn in ['x', 'px', 'y', 'py', 'zeta', 'delta']:
+        assert np.all(getattr(particles[True], nn)
+                      == getattr(particles[False], nn))
@@ -149,3 +149,131 @@ def test_beambeamstrongstrong3d():
    assert np.isclose(np.max(np.abs(bbeamIP1_b1.partner_moments-moments_b2)),0.0)
    assert np.isclose(np.max(np.abs(bbeamIP1_b2.partner_moments-moments_b1)),0.0)
 
+
+def test_strongstrong_wire_format():
+
+   context = xo.ContextCpu()
+
+   n_slices = 5
+   n_lumigrid = 3*3*n_slices
+   rng = np.random.default_rng(1)
+
+   for encoding, rtol in [('float64', 0.), ('float32', 1e-7), ('delta', 1e-7)]:
+      sender = xf.StrongStrongWireFormat(context,
+                  n_slices_send=n_slices, n_slices_recv=n_slices,
+                  n_lumigrid_send=n_lumigrid, n_lumigrid_recv=n_lumigrid,
+                  lumigrid_encoding=encoding)
+      receiver = xf.StrongStrongWireFormat(context,
+                  n_slices_send=n_slices, n_slices_recv=n_slices,
+                  n_lumigrid_send=n_lumigrid, n_lumigrid_recv=n_lumigrid,
+                  lumigrid_encoding=encoding)
+      assert len(sender.send_buffers[0]) == len(receiver.recv_buffer)
+
+      lumigrid = rng.poisson(1e3, n_lumigrid).astype(float)
+      for i_step in range(4):
+         moments = rng.normal(size=17*n_slices)
+         lumigrid += rng.poisson(10., n_lumigrid)
+         buf = sender.encode(moments, lumigrid, at_turn=3, i_step=i_step)
+         receiver.recv_buffer[:] = buf
+
+         header = receiver.check_received()
+         assert header['at_turn'] == 3
+         assert header['i_step'] == i_step
+         assert np.all(receiver.recv_moments == moments.reshape(17, n_slices))
+         assert np.allclose(receiver.decode_lumigrid(), lumigrid,
+                            rtol=rtol, atol=0)
+
+      # send buffers are used in turn
+      assert sender.send_buffers[0] is not sender.send_buffers[1]
+      assert buf is sender.send_buffers[1]
+
+   # the receiver rejects messages encoded differently
+   sender = xf.StrongStrongWireFormat(context, n_slices, n_slices,
+               n_lumigrid, n_lumigrid, lumigrid_encoding='float64')
+   receiver = xf.StrongStrongWireFormat(context, n_slices, n_slices,
+               n_lumigrid, n_lumigrid, lumigrid_encoding='float32')
+   receiver.recv_buffer[:] = sender.encode(
+         np.zeros(17*n_slices), np.zeros(n_lumigrid))[:len(receiver.recv_buffer)]
+   try:
+      receiver.check_received()
+   except ValueError:
+      pass
+   else:
+      raise AssertionError('the mismatch of the flags is not detected')
+
+def test_beambeamstrongstrong3d_overlap_communication():
+
+   context = xo.ContextCpu()
+
+   n_macroparticles = int(1e4)
+   sigma_x = 1e-5
+   sigma_y = 2e-5
+   sigma_z = 0.08
+   sigma_delta = 1E-4
+   p0c = 7000e9
+   n_slices = 5
+
+   rng = np.random.default_rng(2)
+   coords = {}
+   for name, offset_x in [('B1b1', 0.1), ('B2b1', -0.1)]:
+      coords[name] = dict(
+         x=sigma_x*(rng.normal(size=n_macroparticles)+offset_x),
+         px=1e-6*rng.normal(size=n_macroparticles),
+         y=sigma_y*rng.normal(size=n_macroparticles),
+         py=1e-6*rng.normal(size=n_macroparticles),
+         zeta=sigma_z*rng.normal(size=n_macroparticles),
+         delta=sigma_delta*rng.normal(size=n_macroparticles))
+
+   def track(overlap_communication):
+      pipeline_manager = xt.PipelineManager()
+      pipeline_manager.add_particles('B1b1',0)
+      pipeline_manager.add_particles('B2b1',0)
+      pipeline_manager.add_element('IP1')
+
+      slicer = xf.TempSlicer(sigma_z=sigma_z, n_slices=n_slices)
+      branches = []
+      elements = []
+      for name, partner in [('B1b1', 'B2b1'), ('B2b1', 'B1b1')]:
+         particles = xp.Particles(_context=context, p0c=p0c,
+                                  weight=1e11/n_macroparticles, **coords[name])
+         particles.init_pipeline(name)
+         config_for_update = xf.ConfigForUpdateBeamBeamBiGaussian3D(
+            pipeline_manager=pipeline_manager,
+            element_name='IP1',
+            partner_particles_name=partner,
+            slicer=slicer,
+            update_every=1,
+            overlap_communication=overlap_communication)
+         element = xf.BeamBeamBiGaussian3D(
+            _context=context,
+            other_beam_q0=particles.q0,
+            phi=0.0, alpha=0.0,
+            config_for_update=config_for_update)
+         line = xt.Line(elements=[element])
+         line.build_tracker()
+         branches.append(xt.PipelineBranch(line, particles))
+         elements.append(element)
+
+      multitracker = xt.PipelineMultiTracker(branches=branches)
+      multitracker.track(num_turns=2)
+      return [branch.particles for branch in branches], elements
+
+   particles_ref, elements_ref = track(overlap_communication=False)
+   particles_ovl, elements_ovl = track(overlap_communication=True)
+
+   # same kicks, the moments only differ by rounding (different order of
+   # the updates of the slice moments)
+   for p_ref, p_ovl in zip(particles_ref, particles_ovl):
+      for cc in ['x', 'px', 'y', 'py', 'zeta', 'delta']:
+         assert np.allclose(getattr(p_ovl, cc), getattr(p_ref, cc),
+                            rtol=1e-10, atol=1e-20)
+
+   for element in elements_ref:
+      assert element.communication_counters['num_early_kicks'] == 0
+   # with a single process the partner progresses only when this element
+   # is on hold, slice 0 is then kicked while waiting
+   for element in elements_ovl:
+      counters = element.communication_counters
+      assert counters['num_on_hold'] >= counters['num_waits'] > 0
+      assert counters['num_early_kicks'] > 0
+      assert counters['wait_time'] >= 0
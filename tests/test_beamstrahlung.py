@@ -901,3 +901,105 @@ def test_beambeam3d_beamstrahlung_ss(test_context):
 
     assert np.all(np.abs(record_avg_b1.beamstrahlungtable.photon_energy - ss_b1_photon_energy_mean) / ss_b1_photon_energy_mean < 1e-1)
     assert np.all(np.abs(record_avg_b2.beamstrahlungtable.photon_energy - ss_b2_photon_energy_mean) / ss_b2_photon_energy_mean < 1e-1)
+
+
+@for_all_test_contexts
+def test_beambeam3d_beamstrahlung_record_chunks(test_context, tmp_path):
+
+    if not isinstance(test_context, xo.ContextCpu):
+        pytest.skip("Chunked record allocation is only used on CPU")
+
+    bunch_intensity     = 2.3e11  # [1]
+    p0c                 = 182.5e9  # [eV]
+    mass0               = .511e6  # [eV]
+    phi                 = 15e-3  # [rad] half xing
+    physemit_x          = 1.46e-09  # [m]
+    physemit_y          = 2.9e-12  # [m]
+    beta_x              = 1  # [m]
+    beta_y              = .0016  # [m]
+    sigma_x             = np.sqrt(physemit_x*beta_x)  # [m]
+    sigma_px            = np.sqrt(physemit_x/beta_x)  # [m]
+    sigma_y             = np.sqrt(physemit_y*beta_y)  # [m]
+    sigma_py            = np.sqrt(physemit_y/beta_y)  # [m]
+    sigma_z_tot         = .00254  # [m] sr+bs
+    sigma_delta_tot     = .00192  # [m]
+    n_macroparticles_b1 = int(1e4)
+    num_turns           = 3
+
+    n_slices = 10
+    slicer = xf.TempSlicer(n_slices=n_slices, sigma_z=sigma_z_tot, mode="unicharge")
+
+    rng = np.random.default_rng(seed=2024)
+    coords = dict(
+        x     = sigma_x        *rng.standard_normal(n_macroparticles_b1),
+        y     = sigma_y        *rng.standard_normal(n_macroparticles_b1),
+        zeta  = sigma_z_tot    *rng.standard_normal(n_macroparticles_b1),
+        px    = sigma_px       *rng.standard_normal(n_macroparticles_b1),
+        py    = sigma_py       *rng.standard_normal(n_macroparticles_b1),
+        delta = sigma_delta_tot*rng.standard_normal(n_macroparticles_b1),
+        )
+
+    photons = {}
+    for chunked in [False, True]:
+        el_beambeam_b1 = xf.BeamBeamBiGaussian3D(
+            _context=test_context,
+            other_beam_q0=1,
+            phi=phi,
+            alpha=0,
+            slices_other_beam_num_particles = slicer.bin_weights * bunch_intensity,
+            slices_other_beam_zeta_center = slicer.bin_centers,
+            slices_other_beam_Sigma_11    = n_slices*[sigma_x**2],
+            slices_other_beam_Sigma_22    = n_slices*[sigma_px**2],
+            slices_other_beam_Sigma_33    = n_slices*[sigma_y**2],
+            slices_other_beam_Sigma_44    = n_slices*[sigma_py**2],
+            slices_other_beam_zeta_bin_width_star_beamstrahlung = slicer.bin_widths_beamstrahlung / np.cos(phi),
+            slices_other_beam_Sigma_12    = n_slices*[0],
+            slices_other_beam_Sigma_34    = n_slices*[0],
+            )
+
+        line = xt.Line(elements = [el_beambeam_b1])
+        if chunked:
+            line.config.XFIELDS_RECORD_CHUNKS = True
+        line.build_tracker(_context=test_context)
+        line.configure_radiation(model_beamstrahlung='quantum')
+
+        particles_b1 = xp.Particles(_context=test_context, q0=-1, p0c=p0c,
+                                    mass0=mass0, **coords)
+        particles_b1._init_random_number_generator(
+                                    seeds=np.arange(n_macroparticles_b1) + 1)
+
+        capacity = int(1e4) if chunked else int(1e5)
+        record = line.start_internal_logging_for_elements_of_type(
+            xf.BeamBeamBiGaussian3D, capacity={"beamstrahlungtable": capacity,
+                                  "bhabhatable": int(0), "lumitable": int(0)})
+        if chunked:
+            # the table is emptied to disk after every turn
+            writer = xf.PhotonRecordWriter(record, tmp_path,
+                                           tables=['beamstrahlungtable'])
+            for _ in range(num_turns):
+                line.track(particles_b1, num_turns=1)
+                written = writer.flush()
+                assert written['beamstrahlungtable'] > 0
+                assert record.beamstrahlungtable._index.num_recorded == 0
+            assert writer.num_full_flushes['beamstrahlungtable'] == 0
+            table = xf.PhotonRecordWriter.load(tmp_path, 'beamstrahlungtable')
+            assert len(table['photon_energy']) == writer.num_written[
+                                                        'beamstrahlungtable']
+        else:
+            line.track(particles_b1, num_turns=num_turns)
+            record.move(_context=xo.context_default)
+            n_recorded = record.beamstrahlungtable._index.num_recorded
+            table = {cc: getattr(record.beamstrahlungtable, cc)[:n_recorded]
+                     for cc in ['particle_id', 'at_turn', 'photon_id',
+                                'photon_energy', 'primary_energy']}
+        line.stop_internal_logging_for_elements_of_type(xf.BeamBeamBiGaussian3D)
+
+        order = np.lexsort((table['photon_id'], table['primary_energy'],
+                            table['at_turn'], table['particle_id']))
+        photons[chunked] = {cc: np.asarray(table[cc])[order] for cc in
+                            ['particle_id', 'at_turn', 'photon_energy']}
+
+    # same photons, only the slots differ
+    assert len(photons[False]['photon_energy']) > 0
+    for cc in photons[False]:
+        assert np.all(photons[True][cc] == photons[False][cc])
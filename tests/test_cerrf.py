@@ -12,8 +12,8 @@ from xfieldsdev.general import _pkg_root
 from xobjects.test_helpers import for_all_test_contexts
 
 
-@pytest.fixture
-def faddeeva_calculator():
+@pytest.fixture(params=['faddeeva_w', 'faddeeva_w_vec'])
+def faddeeva_calculator(request):
     source = '''
         /*gpukern*/ void FaddeevaCalculator_compute(FaddeevaCalculatorData data) {
             int64_t len = FaddeevaCalculatorData_len_z_re(data);
@@ -29,6 +29,27 @@ def faddeeva_calculator():
                 FaddeevaCalculatorData_set_w_im(data, ii, w_im);
             } //end_vectorize
         }
+
+        #define TILE 64
+        /*gpukern*/ void FaddeevaCalculator_compute_vec(FaddeevaCalculatorData data) {
+            int64_t len = FaddeevaCalculatorData_len_z_re(data);
+            double z_re[TILE], z_im[TILE], w_re[TILE], w_im[TILE];
+
+            for (int64_t i0 = 0; i0 < len; i0 += TILE) {
+                int64_t n = (len - i0 < TILE) ? len - i0 : TILE;
+                for (int64_t ii = 0; ii < n; ii++) {
+                    z_re[ii] = FaddeevaCalculatorData_get_z_re(data, i0 + ii);
+                    z_im[ii] = FaddeevaCalculatorData_get_z_im(data, i0 + ii);
+                }
+
+                faddeeva_w_vec(n, z_re, z_im, w_re, w_im);
+
+                for (int64_t ii = 0; ii < n; ii++) {
+                    FaddeevaCalculatorData_set_w_re(data, i0 + ii, w_re[ii]);
+                    FaddeevaCalculatorData_set_w_im(data, i0 + ii, w_im[ii]);
+                }
+            }
+        }
     '''
 
     class FaddeevaCalculator(xo.HybridClass):
@@ -52,7 +73,12 @@ def faddeeva_calculator():
                 args=[
                     xo.Arg(xo.ThisClass, name='data'),
                 ],
-            )
+            ),
+            'FaddeevaCalculator_compute_vec': xo.Kernel(
+                args=[
+                    xo.Arg(xo.ThisClass, name='data'),
+                ],
+            ),
         }
 
         def __init__(self, z, **kwargs):
@@ -74,8 +100,13 @@ def faddeeva_calculator():
 
         def compute(self):
             self._xobject.compile_kernels(only_if_needed=True)
-            kernel = self._context.kernels.FaddeevaCalculator_compute
-            kernel.set_n_threads(len(self.z_re))
+            if request.param == 'faddeeva_w_vec':
+                # Single thread, the batch function loops over the tiles
+                kernel = self._context.kernels.FaddeevaCalculator_compute_vec
+                kernel.set_n_threads(1)
+            else:
+                kernel = self._context.kernels.FaddeevaCalculator_compute
+                kernel.set_n_threads(len(self.z_re))
             kernel(data=self)
 
     return FaddeevaCalculator
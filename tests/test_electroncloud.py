@@ -102,3 +102,103 @@ def test_tricubic_interpolation(test_context):
     assert np.allclose(part.px[mask_p], true_px, atol=1.e-13, rtol=1.e-13)
     assert np.allclose(part.py[mask_p], true_py, atol=1.e-13, rtol=1.e-13)
     assert np.allclose(part.ptau[mask_p], true_ptau, atol=1.e-13, rtol=1.e-13)
+
+
+@for_all_test_contexts
+def test_tricubic_precomputed_coefficients(test_context):
+    NN = 11
+    x_grid = np.linspace(-0.5, 0.5, NN)
+    y_grid = np.linspace(-0.4, 0.4, NN + 2)
+    z_grid = np.linspace(-0.3, 0.3, NN + 4)
+    rng = default_rng(2345)
+    phi_taylor = rng.random(len(x_grid) * len(y_grid) * len(z_grid) * 8)
+
+    p0c = 450e9
+    n_parts = 1000
+    x_test = rng.random(n_parts) * 1.2 - 0.6
+    y_test = rng.random(n_parts) * 1.0 - 0.5
+    tau_test = rng.random(n_parts) * 0.8 - 0.4
+    beta0 = xp.Particles(p0c=p0c).beta0
+
+    tracked = []
+    for precompute_coefficients in [False, True]:
+        fieldmap = xf.TriCubicInterpolatedFieldMap(_context=test_context,
+                x_grid=x_grid, y_grid=y_grid, z_grid=z_grid,
+                phi_taylor=test_context.nparray_to_context_array(phi_taylor),
+                precompute_coefficients=precompute_coefficients)
+        assert fieldmap.precompute_coefficients == precompute_coefficients
+        ecloud = xf.ElectronCloud(length=1, fieldmap=fieldmap,
+                                  _buffer=fieldmap._buffer)
+        part = xp.Particles(_context=test_context, x=x_test, y=y_test,
+                            zeta=beta0*tau_test, p0c=p0c)
+        ecloud.track(part)
+        part.move(_context=xo.ContextCpu())
+        tracked.append(part)
+
+    part_ref, part_cached = tracked
+    assert np.all(part_ref.state == part_cached.state)
+    assert np.sum(part_ref.state == 1) > n_parts // 2
+    for nn in ['px', 'py', 'ptau']:
+        assert np.allclose(getattr(part_cached, nn), getattr(part_ref, nn),
+                           atol=1e-14, rtol=1e-12)
+
+
+@for_all_test_contexts
+def test_tricubic_values_at_points(test_context):
+    rng = default_rng(3456)
+    cc = rng.random((4, 4, 4)) - 0.5
+    ii, jj, kk = np.meshgrid(np.arange(4), np.arange(4), np.arange(4),
+                             indexing='ij')
+
+    def poly(x, y, z, dx=0, dy=0, dz=0):
+        # derivative of order (dx, dy, dz) of sum_ijk cc_ijk x^i y^j z^k
+        res = 0.
+        for i, j, k, c in zip(ii.ravel(), jj.ravel(), kk.ravel(), cc.ravel()):
+            if i < dx or j < dy or k < dz:
+                continue
+            fact = (np.prod(np.arange(i - dx + 1, i + 1))
+                    * np.prod(np.arange(j - dy + 1, j + 1))
+                    * np.prod(np.arange(k - dz + 1, k + 1)))
+            res = res + c * fact * x**(i - dx) * y**(j - dy) * z**(k - dz)
+        return res
+
+    x_grid = np.linspace(-0.5, 0.5, 15)
+    y_grid = np.linspace(-0.4, 0.4, 13)
+    z_grid = np.linspace(-0.3, 0.3, 11)
+    hx = x_grid[1] - x_grid[0]
+    hy = y_grid[1] - y_grid[0]
+    hz = z_grid[1] - z_grid[0]
+    ZZ, YY, XX = np.meshgrid(z_grid, y_grid, x_grid, indexing='ij')
+    phi_taylor = np.zeros(XX.shape + (8,))
+    orders = [(0, 0, 0), (1, 0, 0), (0, 1, 0), (0, 0, 1),
+              (1, 1, 0), (1, 0, 1), (0, 1, 1), (1, 1, 1)]
+    for ll, (ox, oy, oz) in enumerate(orders):
+        phi_taylor[..., ll] = (poly(XX, YY, ZZ, ox, oy, oz)
+                               * hx**ox * hy**oy * hz**oz)
+
+    n_points = 1000
+    x_test = rng.random(n_points) * 1.2 - 0.6
+    y_test = rng.random(n_points) * 1.0 - 0.5
+    z_test = rng.random(n_points) * 0.8 - 0.4
+    inside = ((np.abs(x_test) < 0.5) & (np.abs(y_test) < 0.4)
+              & (np.abs(z_test) < 0.3))
+
+    for precompute_coefficients in [False, True]:
+        fieldmap = xf.TriCubicInterpolatedFieldMap(_context=test_context,
+                x_grid=x_grid, y_grid=y_grid, z_grid=z_grid,
+                phi_taylor=test_context.nparray_to_context_array(
+                                                    phi_taylor.ravel()),
+                precompute_coefficients=precompute_coefficients)
+
+        res = fieldmap.get_values_at_points(
+                x=test_context.nparray_to_context_array(x_test),
+                y=test_context.nparray_to_context_array(y_test),
+                z=test_context.nparray_to_context_array(z_test))
+        res = [test_context.nparray_from_context_array(rr) for rr in res]
+
+        for rr, (ox, oy, oz) in zip(res, [(0, 0, 0), (1, 0, 0),
+                                          (0, 1, 0), (0, 0, 1)]):
+            expected = poly(x_test, y_test, z_test, ox, oy, oz)
+            assert np.allclose(rr[inside], expected[inside],
+                               atol=1e-13, rtol=1e-12)
+            assert np.all(rr[~inside] == 0)
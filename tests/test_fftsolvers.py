@@ -0,0 +1,118 @@
+# copyright ################################# #
+# This file is part of the Xfields Package.   #
+# Copyright (c) CERN, 2021.                   #
+# ########################################### #
+
+import numpy as np
+import pytest
+
+import xobjects as xo
+from xobjects.test_helpers import for_all_test_contexts
+
+from xfieldsdev.solvers import FFTSolver2p5D
+
+
+@for_all_test_contexts
+def test_shared_green_spectrum_2p5d(test_context):
+
+    from xfieldsdev.solvers.fftsolvers import clear_green_spectrum_cache
+    clear_green_spectrum_cache()
+
+    nx, ny, nz = 32, 24, 8
+    dx, dy, dz = 1e-4, 2e-4, 1e-2
+
+    s1 = FFTSolver2p5D(dx=dx, dy=dy, dz=dz, nx=nx, ny=ny, nz=nz,
+                       context=test_context)
+    s2 = FFTSolver2p5D(dx=dx, dy=dy, dz=2*dz, nx=nx, ny=ny, nz=nz,
+                       context=test_context)
+    s3 = FFTSolver2p5D(dx=2*dx, dy=dy, dz=dz, nx=nx, ny=ny, nz=nz,
+                       context=test_context)
+
+    assert s1._gint_rep_transf_dev is s2._gint_rep_transf_dev
+    assert s1._gint_rep_transf_dev is not s3._gint_rep_transf_dev
+
+    # All slices are solved in one pass, the result is the same for
+    # identical slices
+    x = (np.arange(nx) - nx/2) * dx
+    y = (np.arange(ny) - ny/2) * dy
+    XX, YY = np.meshgrid(x, y, indexing='ij')
+    rho_xy = np.exp(-XX**2/(2*(5*dx)**2) - YY**2/(2*(5*dy)**2))
+    rho = np.zeros((nx, ny, nz), order='F')
+    for iz in range(nz):
+        rho[:, :, iz] = (iz + 1) * rho_xy
+
+    phi = test_context.nparray_from_context_array(
+        s1.solve(test_context.nparray_to_context_array(rho))).copy()
+    for iz in range(nz):
+        assert np.allclose(phi[:, :, iz], (iz + 1) * phi[:, :, 0],
+                           rtol=1e-10, atol=0)
+
+
+@pytest.mark.parametrize('solver_name', ['FFTSolver3D', 'FFTSolver2p5D'])
+@for_all_test_contexts
+def test_green_spectrum_disk_cache(solver_name, test_context, tmp_path):
+
+    import xfieldsdev.solvers as xfs
+
+    nx, ny, nz = 16, 12, 8
+    dx, dy, dz = 1e-4, 2e-4, 1e-2
+    solver_class = getattr(xfs, solver_name)
+
+    xfs.clear_green_spectrum_cache()
+    xfs.set_green_function_cache_dir(tmp_path)
+    try:
+        s1 = solver_class(dx=dx, dy=dy, dz=dz, nx=nx, ny=ny, nz=nz,
+                          context=test_context)
+        assert len(list(tmp_path.glob('green_*.npy'))) == 1
+
+        # Loaded from disk
+        xfs.clear_green_spectrum_cache()
+        s2 = solver_class(dx=dx, dy=dy, dz=dz, nx=nx, ny=ny, nz=nz,
+                          context=test_context)
+        assert s2._gint_rep_transf_dev is not s1._gint_rep_transf_dev
+        assert len(list(tmp_path.glob('green_*.npy'))) == 1
+    finally:
+        xfs.set_green_function_cache_dir(None)
+        xfs.clear_green_spectrum_cache()
+
+    ctx2np = test_context.nparray_from_context_array
+    assert np.all(ctx2np(s1._gint_rep_transf_dev)
+                  == ctx2np(s2._gint_rep_transf_dev))
+
+
+@pytest.mark.parametrize('solver_name', ['FFTSolver3D', 'FFTSolver2p5D',
+                                         'FFTSolver3DR2C', 'FFTSolver2p5DR2C'])
+@for_all_test_contexts
+def test_solve_returns_independent_potentials(solver_name, test_context):
+
+    import xfieldsdev.solvers as xfs
+
+    if isinstance(test_context, xo.ContextPyopencl) and 'R2C' in solver_name:
+        pytest.skip("Not implemented for OpenCL")
+
+    nx, ny, nz = 16, 12, 8
+    dx, dy, dz = 1e-4, 2e-4, 1e-2
+    solver = getattr(xfs, solver_name)(dx=dx, dy=dy, dz=dz,
+                                       nx=nx, ny=ny, nz=nz,
+                                       context=test_context)
+
+    rng = np.random.default_rng(4)
+    rho1 = rng.uniform(size=(nx, ny, nz))
+    rho2 = rng.uniform(size=(nx, ny, nz))
+
+    ctx2np = test_context.nparray_from_context_array
+    np2ctx = test_context.nparray_to_context_array
+
+    # The first potential is not overwritten by the second call
+    phi1 = solver.solve(np2ctx(rho1))
+    phi1_ref = ctx2np(phi1).copy()
+    phi2 = solver.solve(np2ctx(rho2))
+    assert np.all(ctx2np(phi1) == phi1_ref)
+    assert np.all(ctx2np(solver.solve(np2ctx(rho1))) == phi1_ref)
+    assert not np.allclose(ctx2np(phi2), phi1_ref)
+
+    # The potential on the doubled grid is left in the solver workspace
+    workspace = solver.solve_in_workspace(np2ctx(rho1))
+    assert workspace is solver._workspace_dev
+    assert np.allclose(ctx2np(workspace.real[:nx, :ny, :nz]), phi1_ref,
+                       rtol=0, atol=1e-12*np.max(np.abs(phi1_ref)))
@@ -0,0 +1,209 @@
+# copyright ################################# #
+# This file is part of the Xfields Package.   #
+# Copyright (c) CERN, 2021.                   #
+# ########################################### #
+
+import numpy as np
+import pytest
+
+import xobjects as xo
+from xobjects.test_helpers import for_all_test_contexts
+
+from xfieldsdev import TriLinearInterpolatedFieldMap
+
+
+@for_all_test_contexts
+def test_charge_deposition_private_grids(test_context):
+
+    if not isinstance(test_context, xo.ContextCpu):
+        pytest.skip('Private grids deposition is available only on CPU')
+
+    n_particles = int(1e5)
+    rng = np.random.default_rng(seed=123)
+    x = rng.normal(0, 1e-3, n_particles)
+    y = rng.normal(0, 2e-3, n_particles)
+    z = rng.normal(0, 1e-1, n_particles)
+    ncharges = rng.uniform(0.5, 1.5, n_particles)
+    state = np.ones(n_particles, dtype=np.int64)
+    state[::13] = 0
+
+    ctx2np = test_context.nparray_from_context_array
+    np2ctx = test_context.nparray_to_context_array
+
+    rho = {}
+    for mode in ['atomic', 'private_grids']:
+        fmap = TriLinearInterpolatedFieldMap(
+                _context=test_context,
+                x_range=(-5e-3, 5e-3), y_range=(-1e-2, 1e-2),
+                z_range=(-5e-1, 5e-1), nx=32, ny=40, nz=16,
+                deposition_mode=mode)
+        fmap.update_from_particles(
+                x_p=np2ctx(x), y_p=np2ctx(y), z_p=np2ctx(z),
+                ncharges_p=np2ctx(ncharges), state_p=np2ctx(state),
+                q0_coulomb=1.602176634e-19, update_phi=False)
+        rho[mode] = ctx2np(fmap.rho).copy()
+
+    assert np.max(rho['atomic']) > 0
+    assert np.allclose(rho['private_grids'], rho['atomic'],
+                       rtol=0, atol=1e-12 * np.max(rho['atomic']))
+
+
+@for_all_test_contexts
+def test_sort_particles_by_cell(test_context):
+
+    if isinstance(test_context, xo.ContextPyopencl):
+        pytest.skip('Not implemented')
+
+    import xpart as xp
+
+    n_particles = 10000
+    rng = np.random.default_rng(seed=456)
+    particles = xp.Particles(_context=test_context, p0c=7e12,
+            x=rng.normal(0, 1e-3, n_particles),
+            y=rng.normal(0, 1e-3, n_particles),
+            zeta=rng.normal(0, 1e-1, n_particles),
+            px=rng.normal(0, 1e-6, n_particles))
+    ctx2np = test_context.nparray_from_context_array
+    np2ctx = test_context.nparray_to_context_array
+
+    state = ctx2np(particles.state).copy()
+    state[::7] = 0
+    particles.state = np2ctx(state)
+    px_by_id = dict(zip(ctx2np(particles.particle_id),
+                        ctx2np(particles.px)))
+
+    fmap = TriLinearInterpolatedFieldMap(
+            _context=test_context,
+            x_range=(-3e-3, 3e-3), y_range=(-3e-3, 3e-3),
+            z_range=(-3e-1, 3e-1), nx=16, ny=16, nz=8)
+    fmap.sort_particles_by_cell(particles)
+
+    x = ctx2np(particles.x)
+    y = ctx2np(particles.y)
+    z = ctx2np(particles.zeta)
+    state = ctx2np(particles.state)
+    ix = np.floor((x - fmap.x_grid[0]) / fmap.dx).astype(int)
+    iy = np.floor((y - fmap.y_grid[0]) / fmap.dy).astype(int)
+    iz = np.floor((z - fmap.z_grid[0]) / fmap.dz).astype(int)
+    inside = ((ix >= 0) & (ix < fmap.nx - 1) & (iy >= 0) & (iy < fmap.ny - 1)
+              & (iz >= 0) & (iz < fmap.nz - 1))
+    ncells = fmap.nx * fmap.ny * fmap.nz
+    keys = np.where(inside, ix + iy * fmap.nx + iz * fmap.nx * fmap.ny,
+                    ncells)
+    keys[state <= 0] = ncells + 1
+
+    assert np.all(np.diff(keys) >= 0)
+    # All particle variables are permuted consistently
+    for pid, px in zip(ctx2np(particles.particle_id), ctx2np(particles.px)):
+        assert px_by_id[pid] == px
+
+
+@pytest.mark.parametrize('solver', ['FFTSolver2p5D', 'FFTSolver3D'])
+@for_all_test_contexts
+def test_fused_phi_and_gradient(solver, test_context):
+
+    nx, ny, nz = 32, 24, 10
+    x_grid = np.linspace(-1e-2, 1e-2, nx)
+    y_grid = np.linspace(-8e-3, 8e-3, ny)
+    z_grid = np.linspace(-3e-1, 3e-1, nz)
+    XX, YY, ZZ = np.meshgrid(x_grid, y_grid, z_grid, indexing='ij')
+    rho = np.exp(-XX**2/(2*2e-3**2) - YY**2/(2*1e-3**2) - ZZ**2/(2*1e-1**2))
+
+    fmap = TriLinearInterpolatedFieldMap(
+            _context=test_context, x_grid=x_grid, y_grid=y_grid,
+            z_grid=z_grid, solver=solver)
+
+    ctx2np = test_context.nparray_from_context_array
+    np2ctx = test_context.nparray_to_context_array
+
+    # Reference: solve, copy phi, three central differences
+    fmap.update_rho(np2ctx(rho))
+    fmap.update_phi(fmap.solver.solve(fmap.rho))
+    ref = [ctx2np(vv).copy() for vv in
+           [fmap.phi, fmap.dphi_dx, fmap.dphi_dy, fmap.dphi_dz]]
+
+    # Fused path (called twice to check that the workspace is reset)
+    fmap.update_phi_from_rho()
+    fmap.update_phi_from_rho()
+    res = [ctx2np(vv) for vv in
+           [fmap.phi, fmap.dphi_dx, fmap.dphi_dy, fmap.dphi_dz]]
+
+    for rr, ff in zip(ref, res):
+        assert np.allclose(ff, rr, rtol=0, atol=1e-12*np.max(np.abs(rr)))
+
+
+@pytest.mark.parametrize('solvers', [('FFTSolver2p5D', 'FFTSolver2p5DR2C'),
+                                     ('FFTSolver3D', 'FFTSolver3DR2C'),
+                                     ('FFTSolver3D', 'FFTSolver3DPruned')])
+@for_all_test_contexts
+def test_r2c_solvers(solvers, test_context):
+
+    if isinstance(test_context, xo.ContextPyopencl):
+        pytest.skip('Not implemented')
+
+    nx, ny, nz = 32, 24, 10
+    x_grid = np.linspace(-1e-2, 1e-2, nx)
+    y_grid = np.linspace(-8e-3, 8e-3, ny)
+    z_grid = np.linspace(-3e-1, 3e-1, nz)
+    XX, YY, ZZ = np.meshgrid(x_grid, y_grid, z_grid, indexing='ij')
+    rho = np.exp(-XX**2/(2*2e-3**2) - YY**2/(2*1e-3**2) - ZZ**2/(2*1e-1**2))
+
+    ctx2np = test_context.nparray_from_context_array
+    np2ctx = test_context.nparray_to_context_array
+
+    res = []
+    for solver in solvers:
+        fmap = TriLinearInterpolatedFieldMap(
+                _context=test_context, x_grid=x_grid, y_grid=y_grid,
+                z_grid=z_grid, solver=solver, rho=np2ctx(rho))
+        res.append([ctx2np(vv).copy() for vv in
+                    [fmap.phi, fmap.dphi_dx, fmap.dphi_dy, fmap.dphi_dz]])
+
+    for rr, ff in zip(*res):
+        assert np.allclose(ff, rr, rtol=0, atol=1e-10*np.max(np.abs(rr)))
+
+
+@pytest.mark.parametrize('fused_solve', [True, False])
+@for_all_test_contexts
+def test_interleaved_gradient(fused_solve, test_context):
+
+    import xpart as xp
+    from xfieldsdev import SpaceCharge3D
+
+    n_particles = 10000
+    rng = np.random.default_rng(seed=789)
+    coords = dict(x=rng.normal(0, 1e-3, n_particles),
+                  y=rng.normal(0, 1e-3, n_particles),
+                  zeta=rng.normal(0, 1e-1, n_particles))
+
+    px = {}
+    py = {}
+    for interleaved in [False, True]:
+        particles = xp.Particles(_context=test_context, p0c=26e9,
+                                 weight=1e7, **coords)
+        spcharge = SpaceCharge3D(
+                _context=test_context,
+                length=1, update_on_track=fused_solve,
+                apply_z_kick=False,
+                x_range=(-5e-3, 5e-3), y_range=(-5e-3, 5e-3),
+                z_range=(-5e-1, 5e-1), nx=32, ny=32, nz=16,
+                solver='FFTSolver2p5D',
+                interleaved_gradient=interleaved)
+        assert spcharge.fieldmap.interleaved_gradient == interleaved
+        if not fused_solve:
+            # Non-fused path (phi given by the user, not updated on track)
+            spcharge.fieldmap.update_from_particles(particles=particles,
+                                                    update_phi=False,
+                                                    force=True)
+            spcharge.fieldmap.update_phi(
+                    spcharge.fieldmap.solver.solve(spcharge.fieldmap.rho),
+                    force=True)
+        spcharge.track(particles)
+        px[interleaved] = test_context.nparray_from_context_array(
+                                                    particles.px).copy()
+        py[interleaved] = test_context.nparray_from_context_array(
+                                                    particles.py).copy()
+
+    assert np.max(np.abs(px[False])) > 0
+    assert np.allclose(px[True], px[False], rtol=1e-14, atol=0)
+    assert np.allclose(py[True], py[False], rtol=1e-14, atol=0)
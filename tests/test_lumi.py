@@ -619,3 +619,294 @@ def test_beambeam3d_bhabha_ss(test_context):
     # test if relative error is smaller than 15%
     assert np.allclose(lumi_ss_b1, lumi_ip, rtol=1.5e-1, atol=0)
     assert np.allclose(lumi_ss_b2, lumi_ip, rtol=1.5e-1, atol=0)
+
+
+@for_all_test_contexts
+def test_beambeam3d_combilumi_qss(test_context):
+
+    if isinstance(test_context, xo.ContextPyopencl):
+        pytest.skip("Not implemented for OpenCL")
+        return
+
+    if isinstance(test_context, xo.ContextCupy):
+        pytest.skip("Not implemented for cupy")
+        return
+
+    print(repr(test_context))
+
+    ###########
+    # ttbar 2 #
+    ###########
+    bunch_intensity     = 2.3e11  # [1]
+    p0c                 = 182.5e9  # [eV]
+    mass0               = .511e6  # [eV]
+    phi                 = 15e-3  # [rad] half xing
+    physemit_x          = 1.46e-09  # [m]
+    physemit_y          = 2.9e-12  # [m]
+    beta_x              = 1  # [m]
+    beta_y              = .0016  # [m]
+    sigma_x             = np.sqrt(physemit_x*beta_x)  # [m]
+    sigma_px            = np.sqrt(physemit_x/beta_x)  # [m]
+    sigma_y             = np.sqrt(physemit_y*beta_y)  # [m]
+    sigma_py            = np.sqrt(physemit_y/beta_y)  # [m]
+    sigma_z_tot         = .00254  # [m] sr+bs
+    sigma_delta_tot     = .00192  # [m]
+    n_macroparticles_b1 = int(1e5)
+    n_macroparticles_b2 = int(1e5)
+
+    n_slices = 20
+    n_lumigrid_cells = 64
+
+    #############
+    # particles #
+    #############
+
+    particles = []
+    for q0, n_macroparticles in [(-1, n_macroparticles_b1),
+                                 (1, n_macroparticles_b2)]:
+        particles.append(xp.Particles(
+                _context = test_context,
+                q0        = q0,
+                p0c       = p0c,
+                mass0     = mass0,
+                x         = sigma_x        *np.random.randn(n_macroparticles),
+                y         = sigma_y        *np.random.randn(n_macroparticles),
+                zeta      = sigma_z_tot    *np.random.randn(n_macroparticles),
+                px        = sigma_px       *np.random.randn(n_macroparticles),
+                py        = sigma_py       *np.random.randn(n_macroparticles),
+                delta     = sigma_delta_tot*np.random.randn(n_macroparticles),
+                weight=bunch_intensity/n_macroparticles,
+                ))
+    particles_b1, particles_b2 = particles
+
+    particles_b1.name = "b1"
+    particles_b2.name = "b2"
+
+    particles_b1.init_pipeline('b1')
+    particles_b2.init_pipeline('b2')
+
+    slicer = xf.TempSlicer(_context=test_context, n_slices=n_slices, sigma_z=sigma_z_tot, mode="unicharge")
+
+    pipeline_manager = xt.PipelineManager()
+    pipeline_manager.add_particles('b1',0)
+    pipeline_manager.add_particles('b2',0)
+    pipeline_manager.add_element('IP1')
+
+    elements = []
+    for name, partner, other_beam_q0, sign in [
+            ('b1', 'b2', particles_b2.q0, 1), ('b2', 'b1', particles_b1.q0, -1)]:
+        config_for_update=xf.ConfigForUpdateBeamBeamBiGaussian3D(
+            pipeline_manager=pipeline_manager,
+            element_name='IP1',
+            partner_particles_name = partner,
+            slicer=slicer,
+            update_every=1,
+            quasistrongstrong=True,
+            n_lumigrid_cells=n_lumigrid_cells,
+            )
+        elements.append(xf.BeamBeamBiGaussian3D(
+            _context=test_context,
+            other_beam_q0 = other_beam_q0,
+            phi = sign*phi,
+            alpha=0,
+            config_for_update = config_for_update,
+            flag_combilumi=1,
+            x_rms=sigma_x,
+            y_rms=sigma_y,
+            ))
+    bbeamIP1_b1, bbeamIP1_b2 = elements
+
+    # histograms are preallocated in the element buffer
+    assert len(bbeamIP1_b1._lumigrid_my_beam) == n_lumigrid_cells**2*n_slices
+    assert len(bbeamIP1_b1._lumigrid_other_beam) == n_lumigrid_cells**2*n_slices
+
+    #########################
+    # track for 1 collision #
+    #########################
+
+    line_b1 = xt.Line(elements = [bbeamIP1_b1,])
+    line_b2 = xt.Line(elements = [bbeamIP1_b2,])
+
+    line_b1.build_tracker(_context=test_context)
+    line_b2.build_tracker(_context=test_context)
+
+    branch_b1 = xt.PipelineBranch(line_b1, particles_b1)
+    branch_b2 = xt.PipelineBranch(line_b2, particles_b2)
+    multitracker = xt.PipelineMultiTracker(branches=[branch_b1,branch_b2])
+
+    records = [line.start_internal_logging_for_elements_of_type(
+                    xf.BeamBeamBiGaussian3D,
+                    capacity={"beamstrahlungtable": int(0),
+                              "bhabhatable": int(0),
+                              "lumitable": int(0),
+                              "combilumitable": int(1)})
+               for line in [line_b1, line_b2]]
+
+    multitracker.track(num_turns=1)
+    line_b1.stop_internal_logging_for_elements_of_type(xf.BeamBeamBiGaussian3D)
+    line_b2.stop_internal_logging_for_elements_of_type(xf.BeamBeamBiGaussian3D)
+
+    for record in records:
+        record.move(_context=xo.context_default)
+
+    ###############################################
+    # test 1: compare lumi to analytical estimate #
+    ###############################################
+
+    # lumi [m^-2]
+    piwi    = sigma_z_tot / sigma_x * phi  # [1]
+    lumi_ip = bunch_intensity**2 / (4*np.pi*sigma_x*np.sqrt(1 + piwi**2)*sigma_y)  # [m^-2] for 1 IP
+
+    for record in records:
+        combilumi = record.combilumitable.combilumi[0]
+        print("combi lumi:", combilumi, 100*(combilumi - lumi_ip) / lumi_ip, "[%]")
+
+        # test if relative error is smaller than 15%
+        assert np.allclose(combilumi, lumi_ip, rtol=1.5e-1, atol=0)
+
+
+@for_all_test_contexts
+def test_lumigrid_kernels(test_context):
+
+    if not isinstance(test_context, xo.ContextCpu):
+        pytest.skip('Private grids binning is available only on CPU')
+
+    from xfieldsdev.beam_elements.beambeam3d import _add_lumicalc_kernels
+    _add_lumicalc_kernels(test_context)
+
+    n_particles = int(1e5)
+    n_slices = 4
+    n_cells = 32
+    half_width_x = 4e-5
+    half_width_y = 3e-7
+    rng = np.random.default_rng(seed=123)
+    x = rng.normal(0, 1e-5, n_particles)
+    y = rng.normal(0, 1e-7, n_particles)
+    weight = rng.uniform(0.5, 1.5, n_particles)
+    state = np.ones(n_particles, dtype=np.int64)
+    state[::13] = 0
+    slice_index = rng.integers(-1, n_slices, n_particles)
+
+    ctx2np = test_context.nparray_from_context_array
+    np2ctx = test_context.nparray_to_context_array
+
+    # reference with numpy
+    edges_x = np.linspace(-half_width_x, half_width_x, n_cells + 1)
+    edges_y = np.linspace(-half_width_y, half_width_y, n_cells + 1)
+    lumigrid_ref = np.zeros((n_slices, n_cells, n_cells))
+    for ii in range(n_slices):
+        mask = (state > 0) & (slice_index == ii)
+        lumigrid_ref[ii], _, _ = np.histogram2d(y[mask], x[mask],
+                        bins=[edges_y, edges_x], weights=weight[mask])
+
+    # bin slices 1 and 2 with 3 private grids
+    lumigrid = np2ctx(np.zeros(n_slices*n_cells**2))
+    test_context.kernels.lumigrid_fill_private_grids(
+            nparticles=n_particles,
+            x=np2ctx(x), y=np2ctx(y), weight=np2ctx(weight),
+            state=np2ctx(state), slice_index=np2ctx(slice_index),
+            i_slice_min=1, i_slice_max=2, n_cells=n_cells,
+            half_width_x=half_width_x, half_width_y=half_width_y,
+            n_private_grids=3,
+            private_grids=np2ctx(np.zeros(3*2*n_cells**2)),
+            lumigrid=lumigrid)
+    lumigrid = ctx2np(lumigrid).reshape(n_slices, n_cells, n_cells)
+
+    assert np.all(lumigrid[[0, 3]] == 0)
+    assert np.allclose(lumigrid[1:3], lumigrid_ref[1:3], rtol=1e-14, atol=0)
+
+    # overlap at step 3 (slice 1 with 2 and slice 2 with 1)
+    n_rows = 2*n_cells
+    row_sums = np2ctx(np.zeros(n_rows))
+    test_context.kernels.lumigrid_overlap_rows(
+            n_rows=n_rows, n_cells=n_cells, timestep=3, i_slice_min=1,
+            lumigrid_my_beam=np2ctx(lumigrid_ref.ravel()),
+            lumigrid_other_beam=np2ctx(lumigrid_ref.ravel()),
+            row_sums=row_sums)
+
+    w_trap = np.ones(n_cells)
+    w_trap[[0, -1]] = 0.5
+    w_trap = np.outer(w_trap, w_trap)
+    overlap_ref = (np.sum(w_trap * lumigrid_ref[1] * lumigrid_ref[2])
+                   + np.sum(w_trap * lumigrid_ref[2] * lumigrid_ref[1]))
+    assert np.isclose(np.sum(ctx2np(row_sums)), overlap_ref, rtol=1e-13, atol=0)
+
+
+@for_all_test_contexts
+def test_beambeam3d_lumi_deterministic(test_context):
+
+    bunch_intensity     = 2.3e11  # [1]
+    p0c                 = 182.5e9  # [eV]
+    mass0               = .511e6  # [eV]
+    phi                 = 15e-3  # [rad] half xing
+    sigma_x             = np.sqrt(1.46e-09*1)  # [m]
+    sigma_px            = np.sqrt(1.46e-09/1)  # [m]
+    sigma_y             = np.sqrt(2.9e-12*.0016)  # [m]
+    sigma_py            = np.sqrt(2.9e-12/.0016)  # [m]
+    sigma_z_tot         = .00254  # [m] sr+bs
+    sigma_delta_tot     = .00192  # [m]
+    n_macroparticles_b1 = int(1e4)
+    n_slices = 50
+    num_turns = 3
+
+    slicer = xf.TempSlicer(n_slices=n_slices, sigma_z=sigma_z_tot, mode="unicharge")
+
+    rng = np.random.default_rng(seed=321)
+    coords = dict(
+        x     = sigma_x        *rng.standard_normal(n_macroparticles_b1),
+        y     = sigma_y        *rng.standard_normal(n_macroparticles_b1),
+        zeta  = sigma_z_tot    *rng.standard_normal(n_macroparticles_b1),
+        px    = sigma_px       *rng.standard_normal(n_macroparticles_b1),
+        py    = sigma_py       *rng.standard_normal(n_macroparticles_b1),
+        delta = sigma_delta_tot*rng.standard_normal(n_macroparticles_b1),
+        )
+
+    lumi = {}
+    for deterministic in [False, True]:
+        el_beambeam_b1 = xf.BeamBeamBiGaussian3D(
+                _context=test_context,
+                other_beam_q0=1,
+                phi=phi,
+                alpha=0,
+                slices_other_beam_num_particles = slicer.bin_weights * bunch_intensity,
+                slices_other_beam_zeta_center = slicer.bin_centers,
+                slices_other_beam_Sigma_11    = n_slices*[sigma_x**2],
+                slices_other_beam_Sigma_22    = n_slices*[sigma_px**2],
+                slices_other_beam_Sigma_33    = n_slices*[sigma_y**2],
+                slices_other_beam_Sigma_44    = n_slices*[sigma_py**2],
+                slices_other_beam_Sigma_12    = n_slices*[0],
+                slices_other_beam_Sigma_34    = n_slices*[0],
+                flag_luminosity=1,
+        )
+
+        line = xt.Line(elements = [el_beambeam_b1])
+        if deterministic:
+            line.config.XFIELDS_BB3D_LUMI_DETERMINISTIC = True
+        line.build_tracker(_context=test_context)
+
+        particles_b1 = xp.Particles(_context=test_context, q0=-1, p0c=p0c,
+                mass0=mass0, weight=bunch_intensity/n_macroparticles_b1,
+                **coords)
+
+        record = line.start_internal_logging_for_elements_of_type(
+            xf.BeamBeamBiGaussian3D, capacity={"beamstrahlungtable": int(0),
+                "bhabhatable": int(0), "lumitable": int(n_macroparticles_b1*num_turns)})
+        line.track(particles_b1, num_turns=num_turns)
+        line.stop_internal_logging_for_elements_of_type(xf.BeamBeamBiGaussian3D)
+        record.move(_context=xo.context_default)
+
+        if deterministic:
+            # nothing is added to the turn-indexed array
+            assert np.all(record.lumitable.luminosity == 0)
+            lumi[deterministic] = record.lumitable.get_luminosity_from_partial_sums(
+                                                        num_turns=num_turns)
+            # a second reduction gives the same bits
+            assert np.all(lumi[deterministic]
+                == record.lumitable.get_luminosity_from_partial_sums(
+                                                        num_turns=num_turns))
+        else:
+            lumi[deterministic] = record.lumitable.luminosity[:num_turns].copy()
+
+    assert np.all(lumi[False] > 0)
+    # identical up to the summation order
+    assert np.allclose(lumi[True], lumi[False], rtol=1e-12, atol=0)
@@ -11,6 +11,7 @@ from scipy.constants import e as qe
 from scipy.constants import c as clight
 
 import xpart as xp
+import xtrack as xt
 
 import ducktrack as dtk
 
@@ -138,12 +139,15 @@ def test_spacecharge_gauss_qgauss(frozen, test_context):
 
 
 @pytest.mark.parametrize('solver',
-        ['FFTSolver2p5D', 'FFTSolver2p5DAveraged', 'FFTSolver3D'])
+        ['FFTSolver2p5D', 'FFTSolver2p5DAveraged', 'FFTSolver3D',
+         'FFTSolver2p5DR2C', 'FFTSolver3DR2C', 'FFTSolver3DPruned'])
 @for_all_test_contexts
 def test_spacecharge_pic(solver, test_context):
 
     if (isinstance(test_context, xo.ContextPyopencl)
-                and solver=='FFTSolver2p5DAveraged'):
+                and solver in ['FFTSolver2p5DAveraged',
+                               'FFTSolver2p5DR2C', 'FFTSolver3DR2C',
+                               'FFTSolver3DPruned']):
         pytest.skip('Not implemented')
 
     #################################
@@ -237,3 +241,124 @@ def test_spacecharge_pic(solver, test_context):
             p2np(particles.py[:n_probes])[mask_inside_grid],
             p_dtk.py[mask_inside_grid],
             atol=3e-2*np.max(np.abs(p_dtk.py[mask_inside_grid])))
+
+
+@for_all_test_contexts
+def test_spacecharge_gauss_field_table(test_context):
+
+    from xfieldsdev import LongitudinalProfileQGaussian, SpaceChargeBiGaussian
+
+    sigma_x = 3e-3
+    sigma_y = 1e-3
+    x0 = 1e-3
+    y0 = -4e-3
+    p0c = 25.92e9
+
+    # Probes inside and outside the table (8 sigma_x)
+    n_probes = 10000
+    rng = np.random.default_rng(seed=123)
+    r_probes = sigma_x * np.concatenate([
+                            rng.uniform(0, 8, n_probes // 2),
+                            rng.uniform(8, 20, n_probes // 2)])
+    theta_probes = rng.uniform(0, 2 * np.pi, n_probes)
+
+    px = {}
+    py = {}
+    for field_engine in ['exact', 'table']:
+        lprofile = LongitudinalProfileQGaussian(
+                _context=test_context,
+                number_of_particles=2.5e11,
+                sigma_z=30e-2,
+                z0=0.,
+                q_parameter=1.)
+
+        scgauss = SpaceChargeBiGaussian(
+                        _context=test_context,
+                        update_on_track=False,
+                        length=1.,
+                        apply_z_kick=False,
+                        longitudinal_profile=lprofile,
+                        mean_x=x0,
+                        mean_y=y0,
+                        sigma_x=sigma_x,
+                        sigma_y=sigma_y,
+                        min_sigma_diff=1e-10,
+                        field_engine=field_engine)
+        assert scgauss.fieldmap.field_engine == field_engine
+
+        particles = xp.Particles(_context=test_context, p0c=p0c,
+                mass0=pmass,
+                x=x0 + r_probes * np.cos(theta_probes),
+                y=y0 + r_probes * np.sin(theta_probes),
+                zeta=0.1)
+        scgauss.track(particles)
+
+        p2np = test_context.nparray_from_context_array
+        px[field_engine] = p2np(particles.px)
+        py[field_engine] = p2np(particles.py)
+
+    assert scgauss.fieldmap.table_max_error < 1e-6
+
+    # Errors relative to the peak kick (table_tolerance)
+    kick_max = max(np.max(np.abs(px['exact'])), np.max(np.abs(py['exact'])))
+    assert np.allclose(px['table'], px['exact'], rtol=0, atol=1e-6 * kick_max)
+    assert np.allclose(py['table'], py['exact'], rtol=0, atol=1e-6 * kick_max)
+
+
+@for_all_test_contexts
+def test_spacecharge_gauss_field_tiles(test_context):
+
+    from xfieldsdev import LongitudinalProfileQGaussian, SpaceChargeBiGaussian
+
+    # The exact field is evaluated for tiles of particles on the cpu contexts
+    # (get_Ex_Ey_gauss_vec), BIGAUSSIAN_VEC_SCALAR selects the per-particle
+    # evaluation
+    x0 = 1e-3
+    y0 = -4e-3
+    p0c = 25.92e9
+    n_probes = 1001 # not a multiple of the tile size
+    rng = np.random.default_rng(seed=321)
+    coords = dict(x=rng.normal(x0, 1e-2, n_probes),
+                  y=rng.normal(y0, 1e-2, n_probes),
+                  zeta=rng.normal(0, 0.3, n_probes))
+
+    p2np = test_context.nparray_from_context_array
+
+    for sigma_x, sigma_y in [(3e-3, 1e-3), (1e-3, 3e-3), (2e-3, 2e-3)]:
+        px = {}
+        py = {}
+        for scalar in [True, False]:
+            lprofile = LongitudinalProfileQGaussian(
+                    _context=test_context,
+                    number_of_particles=2.5e11,
+                    sigma_z=30e-2,
+                    z0=0.,
+                    q_parameter=1.)
+
+            scgauss = SpaceChargeBiGaussian(
+                            _context=test_context,
+                            update_on_track=False,
+                            length=1.,
+                            apply_z_kick=False,
+                            longitudinal_profile=lprofile,
+                            mean_x=x0,
+                            mean_y=y0,
+                            sigma_x=sigma_x,
+                            sigma_y=sigma_y,
+                            min_sigma_diff=1e-10)
+            line = xt.Line(elements=[scgauss])
+            line.config.BIGAUSSIAN_VEC_SCALAR = scalar
+            line.build_tracker(_context=test_context)
+
+            particles = xp.Particles(_context=test_context, p0c=p0c,
+                    mass0=pmass, **coords)
+            line.track(particles)
+            px[scalar] = p2np(particles.px)
+            py[scalar] = p2np(particles.py)
+
+        # Same formula, the Faddeeva function evaluations differ by less
+        # than 1e-9 (see test_cerrf.py)
+        kick_max = max(np.max(np.abs(px[True])), np.max(np.abs(py[True])))
+        assert kick_max > 0
+        assert np.allclose(px[False], px[True], rtol=0, atol=1e-8 * kick_max)
+        assert np.allclose(py[False], py[True], rtol=0, atol=1e-8 * kick_max)
@@ -9,6 +9,8 @@ import xobjects as xo
 import xtrack as xt
 
 from ..general import _pkg_root
+from ..fieldmaps.bigaussian import (_FIELD_ENGINES, _FIELD_TABLE_XOFIELDS,
+                                    _field_engine_kwargs)
 
 class BeamBeamBiGaussian2D(xt.BeamElement):
 
@@ -37,6 +39,8 @@ class BeamBeamBiGaussian2D(xt.BeamElement):
 
         'min_sigma_diff': xo.Float64,
 
+        **_FIELD_TABLE_XOFIELDS,
+
     }
 
     _extra_c_sources= [
@@ -72,6 +76,11 @@ class BeamBeamBiGaussian2D(xt.BeamElement):
 
                     min_sigma_diff=1e-10,
 
+                    field_engine='exact',
+                    table_n_sigma=8.,
+                    table_step=0.1,
+                    table_tolerance=1e-6,
+
                     config_for_update=None,
 
                     **kwargs):
@@ -99,13 +108,6 @@ class BeamBeamBiGaussian2D(xt.BeamElement):
 
         params = self._handle_init_old_interface(kwargs)
 
-        self.xoinitialize(**kwargs)
-
-        if self.iscollective:
-            if not isinstance(self._buffer.context, xo.ContextCpu):
-                raise NotImplementedError(
-                    'BeamBeamBiGaussian3D only works with CPU context for now')
-
         # Handle old interface
         if 'other_beam_num_particles' in params.keys(): other_beam_num_particles = params['other_beam_num_particles']
         if 'other_beam_q0' in params.keys(): other_beam_q0 = params['other_beam_q0']
@@ -117,7 +119,25 @@ class BeamBeamBiGaussian2D(xt.BeamElement):
         if 'post_subtract_px' in params.keys(): post_subtract_px = params['post_subtract_px']
         if 'post_subtract_py' in params.keys(): post_subtract_py = params['post_subtract_py']
 
-        
+        # The field table (see BiGaussianFieldMap) is built for the
+        # sigma_y/sigma_x of the other beam at initialization
+        if '_field_engine' in kwargs.keys():
+            table_kwargs = {} # e.g. from to_dict, table given in kwargs
+        else:
+            table_kwargs = _field_engine_kwargs(field_engine,
+                    (np.sqrt(other_beam_Sigma_11)
+                        if other_beam_Sigma_11 is not None else None),
+                    (np.sqrt(other_beam_Sigma_33)
+                        if other_beam_Sigma_33 is not None else None),
+                    min_sigma_diff, table_n_sigma, table_step, table_tolerance)
+
+        self.xoinitialize(**table_kwargs, **kwargs)
+
+        if self.iscollective:
+            if not isinstance(self._buffer.context, xo.ContextCpu):
+                raise NotImplementedError(
+                    'BeamBeamBiGaussian3D only works with CPU context for now')
+
         # Mandatory sigmas
         assert other_beam_Sigma_11 is not None, ("`other_beam_Sigma_11` must be provided")
         assert other_beam_Sigma_33 is not None, ("`other_beam_Sigma_33` must be provided")
@@ -292,6 +312,21 @@ class BeamBeamBiGaussian2D(xt.BeamElement):
         self.other_beam_Sigma_33 = self.partner_moments[5]
         
 
+    @property
+    def field_engine(self):
+        return {vv: kk for kk, vv in _FIELD_ENGINES.items()}[
+                                                    self._field_engine]
+
+    @property
+    def table_max_error(self):
+        '''
+        Maximum error of the tabulated field (relative to the peak field)
+        found on the check points when the table was built.
+        '''
+        if self.field_engine != 'table':
+            return None
+        return self._table_max_error
+
     # Properties to mimic the old interfece (to be removed)
     @property
     def n_particles(self):
@@ -5,12 +5,16 @@
 
 import numpy as np
 import time
+from pathlib import Path
 
 import xobjects as xo
 import xtrack as xt
 import xpart as xp
 
 from ..general import _pkg_root
+from ..fieldmaps.interpolated import (PRIVATE_GRIDS_MAX_BYTES,
+                                      _get_cpu_num_threads)
+from .temp_slicer import IncrementalSliceMoments
 
 
 
@@ -58,8 +62,34 @@ class LumiTable(xo.HybridClass):
       'at_turn': xo.Int64[:],
       'particle_id': xo.Int64[:],
       'luminosity': xo.Float64[:],
+      'partial_luminosity': xo.Float64[:],
       }
 
+    def get_luminosity_from_partial_sums(self, num_turns=None):
+        '''
+        Returns the luminosity per turn [m^-2] when the tracking code is
+        compiled with XFIELDS_BB3D_LUMI_DETERMINISTIC. In that case each
+        thread stores its partial sum in a slot of the table (instead of
+        adding it to luminosity[at_turn]) and the slots are summed here
+        sorted by turn, element and particle id, so that the result does not
+        depend on the order in which the threads filled the table.
+        '''
+        ctx2np = self._context.nparray_from_context_array
+        n_slots = min(int(self._index.num_recorded), len(self.at_turn))
+        at_turn = ctx2np(self.at_turn)[:n_slots]
+        at_element = ctx2np(self.at_element)[:n_slots]
+        particle_id = ctx2np(self.particle_id)[:n_slots]
+        partial = ctx2np(self.partial_luminosity)[:n_slots]
+
+        if num_turns is None:
+            num_turns = int(at_turn.max()) + 1 if n_slots > 0 else 0
+        order = np.lexsort((particle_id, at_element, at_turn))
+        order = order[at_turn[order] < num_turns]
+        luminosity = np.zeros(num_turns)
+        # np.add.at accumulates sequentially in the given order
+        np.add.at(luminosity, at_turn[order], partial[order])
+        return luminosity
+
 class CombiLumiTable(xo.HybridClass):
     _xofields = {
       '_index': xt.RecordIndex,
@@ -69,14 +99,370 @@ class CombiLumiTable(xo.HybridClass):
       'combilumi': xo.Float64[:],
         }
     
+# Event codes of the debug trace, kept in sync with XF_TRACE_* in
+# beambeam_src/beambeam3d_trace.h
+TRACE_EVENTS = {
+    1: 'bb3d_field',            # x_bar_hat_star, y_bar_hat_star, S
+    2: 'bb3d_kick',             # i_slice, Fx_star, Fy_star
+    3: 'bs_negative_photon',    # e_photon [eV], energy [eV], photon id
+    4: 'bs_too_many_photons',   # photon id, Fr, dz
+    5: 'bhabha_zero_loss',      # e_loss_primary [GeV]
+    6: 'lumi_overlap',          # timestep, i_slice, i_slice_other_beam
+    }
+TRACE_DEPTH = 16 # XFIELDS_TRACE_DEPTH
+
+class TraceTable(xo.HybridClass):
+    '''
+    Ring buffers of the debug trace, filled only when the tracking code is
+    compiled with XFIELDS_TRACE (e.g. line.config.XFIELDS_TRACE = True) and
+    internal logging is active. The capacity is split into lanes of
+    XFIELDS_TRACE_DEPTH events, each keeping the last events of the particles
+    with ipart % n_lanes == lane.
+    '''
+    _xofields = {
+      '_index': xt.RecordIndex,
+      'n_events': xo.Int64[:],
+      'event': xo.Int64[:],
+      'at_element': xo.Int64[:],
+      'at_turn': xo.Int64[:],
+      'particle_id': xo.Int64[:],
+      'value_0': xo.Float64[:],
+      'value_1': xo.Float64[:],
+      'value_2': xo.Float64[:],
+        }
+
+    def get_events(self, depth=TRACE_DEPTH):
+        '''
+        Returns the recorded events as a dictionary of numpy arrays, lane by
+        lane in chronological order. The event names are in the 'name' entry.
+        '''
+        ctx2np = self._context.nparray_from_context_array
+        n_events = ctx2np(self.n_events)
+        n_lanes = len(n_events) // depth
+
+        slots = []
+        for lane in range(n_lanes):
+            nn = n_events[lane]
+            n_kept = min(nn, depth)
+            first = nn % depth if nn > depth else 0
+            slots.append(lane * depth + (first + np.arange(n_kept)) % depth)
+        slots = (np.concatenate(slots).astype(np.int64) if slots
+                 else np.zeros(0, dtype=np.int64))
+
+        out = {nn: ctx2np(getattr(self, nn))[slots] for nn in
+               ['event', 'at_element', 'at_turn', 'particle_id',
+                'value_0', 'value_1', 'value_2']}
+        out['name'] = np.array([TRACE_EVENTS.get(ee, 'unknown')
+                                for ee in out['event']])
+        return out
+
 class BeamBeamBiGaussian3DRecord(xo.HybridClass):
     _xofields = {
         'beamstrahlungtable': BeamstrahlungTable,
         'bhabhatable': BhabhaTable,
         'lumitable': LumiTable,
         'combilumitable': CombiLumiTable,
+        'tracetable': TraceTable,
        }
 
+class PhotonRecordWriter:
+    '''
+    Moves the photons of the beamstrahlung and Bhabha tables of an internal
+    record to disk, one binary file per column, so that the photons of a long
+    run can be kept with tables of bounded capacity. flush is called between
+    calls to line.track, e.g.
+
+        record = line.start_internal_logging_for_elements_of_type(
+            xf.BeamBeamBiGaussian3D, capacity={...})
+        writer = xf.PhotonRecordWriter(record, 'photons')
+        for _ in range(n_batches):
+            line.track(particles, num_turns=turns_per_batch)
+            writer.flush()
+
+    The columns are appended to <directory>/<table>/<column>.bin and read back
+    with PhotonRecordWriter.load. The empty slots left by the chunked
+    allocation (XFIELDS_RECORD_CHUNKS, see headers/record_chunks.h) are
+    dropped. If a table is found full at a flush, photons may have been lost
+    and num_full_flushes is increased: flush more often or increase the
+    capacity.
+    '''
+
+    def __init__(self, record, directory,
+                 tables=('beamstrahlungtable', 'bhabhatable')):
+        self.record = record
+        self.directory = Path(directory)
+        self.tables = tuple(tables)
+        self.num_written = {nn: 0 for nn in self.tables}
+        self.num_full_flushes = {nn: 0 for nn in self.tables}
+
+        for nn in self.tables:
+            (self.directory / nn).mkdir(parents=True, exist_ok=True)
+
+    def _columns(self, table):
+        return [cc for cc in type(table)._xofields if cc != '_index']
+
+    def flush(self):
+        '''
+        Appends the recorded photons to the files, clears the tables and
+        returns the number of photons written per table.
+        '''
+        written = {}
+        for nn in self.tables:
+            table = getattr(self.record, nn)
+            ctx2np = table._context.nparray_from_context_array
+            capacity = len(table.at_turn)
+            n_slots = min(int(table._index.num_recorded), capacity)
+            if n_slots == capacity and capacity > 0:
+                self.num_full_flushes[nn] += 1
+
+            used = ctx2np(table.primary_energy[:n_slots]) != 0
+            for cc in self._columns(table):
+                col = ctx2np(getattr(table, cc)[:n_slots])[used]
+                with open(self.directory / nn / f'{cc}.bin', 'ab') as fid:
+                    col.tofile(fid)
+                getattr(table, cc)[:n_slots] = 0
+            table._index.num_recorded = 0
+
+            written[nn] = int(np.sum(used))
+            self.num_written[nn] += written[nn]
+        return written
+
+    @staticmethod
+    def load(directory, table='beamstrahlungtable'):
+        '''
+        Returns the photons written to directory for the given table as a
+        dictionary of numpy arrays.
+        '''
+        table_class = {'beamstrahlungtable': BeamstrahlungTable,
+                       'bhabhatable': BhabhaTable}[table]
+        out = {}
+        for cc, ftype in table_class._xofields.items():
+            if cc == '_index':
+                continue
+            fname = Path(directory) / table / f'{cc}.bin'
+            dtype = np.dtype(ftype._itemtype.__name__.lower())
+            out[cc] = (np.fromfile(fname, dtype=dtype) if fname.exists()
+                       else np.zeros(0, dtype=dtype))
+        return out
+
+# Per-slice quantities of the other beam packed in one record per slice,
+# in the order of the BB3D_SLICE_* indices in beambeam_src/beambeam3d.h.
+# They are followed by the slice invariants tabulated in
+# BeamBeam3D_pack_slices_other_beam, and padded to _SLICE_RECORD_SIZE doubles
+# (four cache lines).
+_SLICE_RECORD_FIELDS = [
+    'slices_other_beam_num_particles',
+    'slices_other_beam_x_center_star',
+    'slices_other_beam_px_center_star',
+    'slices_other_beam_y_center_star',
+    'slices_other_beam_py_center_star',
+    'slices_other_beam_zeta_center_star',
+    'slices_other_beam_pzeta_center_star',
+    'slices_other_beam_Sigma_11_star',
+    'slices_other_beam_Sigma_12_star',
+    'slices_other_beam_Sigma_13_star',
+    'slices_other_beam_Sigma_14_star',
+    'slices_other_beam_Sigma_22_star',
+    'slices_other_beam_Sigma_23_star',
+    'slices_other_beam_Sigma_24_star',
+    'slices_other_beam_Sigma_33_star',
+    'slices_other_beam_Sigma_34_star',
+    'slices_other_beam_Sigma_44_star',
+    'slices_other_beam_zeta_bin_width_star_beamstrahlung',
+    'slices_other_beam_sqrtSigma_11_beamstrahlung',
+    'slices_other_beam_sqrtSigma_33_beamstrahlung',
+    'slices_other_beam_sqrtSigma_55_beamstrahlung',
+    ]
+_SLICE_RECORD_SIZE = 32
+
+# Kernels of the combi luminosity (see headers/lumicalc.h)
+_lumicalc_kernels = {
+    'lumigrid_fill_private_grids': xo.Kernel(
+        args=[
+            xo.Arg(xo.Int64,   pointer=False, name='nparticles'),
+            xo.Arg(xo.Float64, pointer=True,  name='x'),
+            xo.Arg(xo.Float64, pointer=True,  name='y'),
+            xo.Arg(xo.Float64, pointer=True,  name='weight'),
+            xo.Arg(xo.Int64,   pointer=True,  name='state'),
+            xo.Arg(xo.Int64,   pointer=True,  name='slice_index'),
+            xo.Arg(xo.Int64,   pointer=False, name='i_slice_min'),
+            xo.Arg(xo.Int64,   pointer=False, name='i_slice_max'),
+            xo.Arg(xo.Int64,   pointer=False, name='n_cells'),
+            xo.Arg(xo.Float64, pointer=False, name='half_width_x'),
+            xo.Arg(xo.Float64, pointer=False, name='half_width_y'),
+            xo.Arg(xo.Int64,   pointer=False, name='n_private_grids'),
+            xo.Arg(xo.Float64, pointer=True,  name='private_grids'),
+            xo.Arg(xo.Float64, pointer=True,  name='lumigrid'),
+            ],
+        ),
+    'lumigrid_overlap_rows': xo.Kernel(
+        args=[
+            xo.Arg(xo.Int64,   pointer=False, name='n_rows'),
+            xo.Arg(xo.Int64,   pointer=False, name='n_cells'),
+            xo.Arg(xo.Int64,   pointer=False, name='timestep'),
+            xo.Arg(xo.Int64,   pointer=False, name='i_slice_min'),
+            xo.Arg(xo.Float64, pointer=True,  name='lumigrid_my_beam'),
+            xo.Arg(xo.Float64, pointer=True,  name='lumigrid_other_beam'),
+            xo.Arg(xo.Float64, pointer=True,  name='row_sums'),
+            ],
+        n_threads='n_rows'
+        ),
+    }
+
+def _add_lumicalc_kernels(context):
+    if 'lumigrid_overlap_rows' not in context.kernels.keys():
+        context.add_kernels(
+            sources=[_pkg_root.joinpath('headers/lumicalc.h')],
+            kernels=_lumicalc_kernels)
+
+# Messages exchanged by the strong-strong elements are float64 arrays with a
+# header of _WIRE_HEADER_SIZE words (magic, version, number of slices,
+# flags, turn, step, number of histogram cells, reserved), the 17 moments of
+# each slice (as returned by TempSlicer.compute_moments) and, with
+# flag_combilumi, the histograms of all slices. With the 'float32' and
+# 'delta' lumigrid encodings two histogram cells are packed in each word.
+_WIRE_MAGIC = 0x58464242 # 'XFBB'
+_WIRE_VERSION = 1
+_WIRE_HEADER_SIZE = 8
+WIRE_FLAG_LUMIGRID = 1
+WIRE_FLAG_LUMIGRID_FLOAT32 = 2
+WIRE_FLAG_LUMIGRID_DELTA = 4
+_WIRE_LUMIGRID_ENCODINGS = {
+    'float64': 0,
+    'float32': WIRE_FLAG_LUMIGRID_FLOAT32,
+    # float32 differences from the previous message; the sender tracks the
+    # histograms rebuilt by the receiver so that rounding does not accumulate
+    'delta': WIRE_FLAG_LUMIGRID_FLOAT32 | WIRE_FLAG_LUMIGRID_DELTA,
+    }
+
+class StrongStrongWireFormat:
+    '''
+    Encoder and decoder of the messages of one strong-strong element. The
+    send buffers are preallocated and used in turn (a buffer is written again
+    only two messages later, when the partner has necessarily received it),
+    the received moments and histograms are read through views of the
+    receive buffer.
+    '''
+
+    def __init__(self, context, n_slices_send, n_slices_recv,
+                 n_lumigrid_send=0, n_lumigrid_recv=0,
+                 lumigrid_encoding='float64'):
+        assert lumigrid_encoding in _WIRE_LUMIGRID_ENCODINGS, (
+            f'lumigrid_encoding must be one of {list(_WIRE_LUMIGRID_ENCODINGS)}')
+        nplike = context.nplike_lib
+        self._context = context
+        self.lumigrid_encoding = lumigrid_encoding
+        self._encoding_flags = _WIRE_LUMIGRID_ENCODINGS[lumigrid_encoding]
+        self.flags = self._encoding_flags | (
+                            WIRE_FLAG_LUMIGRID if n_lumigrid_send > 0 else 0)
+        self.n_slices_send = n_slices_send
+        self.n_slices_recv = n_slices_recv
+        self.n_lumigrid_send = n_lumigrid_send
+        self.n_lumigrid_recv = n_lumigrid_recv
+
+        self.send_buffers = [
+            nplike.zeros(self._message_size(n_slices_send, n_lumigrid_send),
+                         dtype=np.float64) for _ in range(2)]
+        self._i_send_buffer = 0
+        self.recv_buffer = nplike.zeros(
+            self._message_size(n_slices_recv, n_lumigrid_recv),
+            dtype=np.float64)
+        self.recv_header = self.recv_buffer[:_WIRE_HEADER_SIZE]
+        self.recv_moments = self.recv_buffer[
+            _WIRE_HEADER_SIZE:_WIRE_HEADER_SIZE + 17*n_slices_recv].reshape(
+                                                        17, n_slices_recv)
+
+        # histograms as rebuilt by the receiver, for the delta encoding
+        self._lumigrid_sent = nplike.zeros(n_lumigrid_send, dtype=np.float64)
+        self._lumigrid_received = nplike.zeros(n_lumigrid_recv,
+                                               dtype=np.float64)
+
+    def _packed(self):
+        return bool(self._encoding_flags & WIRE_FLAG_LUMIGRID_FLOAT32)
+
+    def _lumigrid_words(self, n_lumigrid):
+        return (n_lumigrid + 1) // 2 if self._packed() else n_lumigrid
+
+    def _message_size(self, n_slices, n_lumigrid):
+        return (_WIRE_HEADER_SIZE + 17*n_slices
+                + self._lumigrid_words(n_lumigrid))
+
+    def encode(self, moments, lumigrid=None, at_turn=0, i_step=0):
+        '''Writes a message in the next send buffer and returns it.'''
+        buf = self.send_buffers[self._i_send_buffer]
+        self._i_send_buffer = 1 - self._i_send_buffer
+
+        n_moments = 17*self.n_slices_send
+        header = np.array([_WIRE_MAGIC, _WIRE_VERSION, self.n_slices_send,
+                           self.flags, at_turn, i_step, self.n_lumigrid_send,
+                           0], dtype=np.float64)
+        buf[:_WIRE_HEADER_SIZE] = self._context.nparray_to_context_array(header)
+        buf[_WIRE_HEADER_SIZE:_WIRE_HEADER_SIZE + n_moments] = moments
+
+        if self.n_lumigrid_send > 0:
+            payload = buf[_WIRE_HEADER_SIZE + n_moments:]
+            if not self._packed():
+                payload[:] = lumigrid
+            else:
+                packed = payload.view(np.float32)
+                if self._encoding_flags & WIRE_FLAG_LUMIGRID_DELTA:
+                    packed[:self.n_lumigrid_send] = lumigrid - self._lumigrid_sent
+                    self._lumigrid_sent += packed[:self.n_lumigrid_send]
+                else:
+                    packed[:self.n_lumigrid_send] = lumigrid
+        return buf
+
+    def check_received(self):
+        '''Checks the header of the message in recv_buffer and returns it.'''
+        header = self._context.nparray_from_context_array(self.recv_header)
+        expected = {'magic': _WIRE_MAGIC, 'version': _WIRE_VERSION,
+                    'n_slices': self.n_slices_recv,
+                    'flags': self._encoding_flags | (
+                        WIRE_FLAG_LUMIGRID if self.n_lumigrid_recv > 0 else 0),
+                    'n_lumigrid': self.n_lumigrid_recv}
+        received = dict(zip(['magic', 'version', 'n_slices', 'flags',
+                             'at_turn', 'i_step', 'n_lumigrid'], header))
+        for kk, vv in expected.items():
+            if received[kk] != vv:
+                raise ValueError(
+                    f'Unexpected strong-strong message: {kk} = {received[kk]},'
+                    f' expected {vv}')
+        return {kk: int(vv) for kk, vv in received.items()}
+
+    def decode_lumigrid(self):
+        '''Returns the histograms of the message in recv_buffer.'''
+        payload = self.recv_buffer[_WIRE_HEADER_SIZE + 17*self.n_slices_recv:]
+        if not self._packed():
+            return payload
+        packed = payload.view(np.float32)[:self.n_lumigrid_recv]
+        if self._encoding_flags & WIRE_FLAG_LUMIGRID_DELTA:
+            self._lumigrid_received += packed
+        else:
+            self._lumigrid_received[:] = packed
+        return self._lumigrid_received
+
+# rows of the received moments and sign of the transformation to the frame
+# of this element
+_RECEIVED_MOMENTS_ROWS = [
+    ('slices_other_beam_num_particles', 1.),
+    ('slices_other_beam_x_center_star', -1.),
+    ('slices_other_beam_px_center_star', 1.),
+    ('slices_other_beam_y_center_star', 1.),
+    ('slices_other_beam_py_center_star', -1.),
+    ('slices_other_beam_zeta_center_star', 1.),
+    ('slices_other_beam_pzeta_center_star', 1.),
+    ('slices_other_beam_Sigma_11_star', 1.),
+    ('slices_other_beam_Sigma_12_star', -1.),
+    ('slices_other_beam_Sigma_13_star', -1.),
+    ('slices_other_beam_Sigma_14_star', 1.),
+    ('slices_other_beam_Sigma_22_star', 1.),
+    ('slices_other_beam_Sigma_23_star', 1.),
+    ('slices_other_beam_Sigma_24_star', -1.),
+    ('slices_other_beam_Sigma_33_star', 1.),
+    ('slices_other_beam_Sigma_34_star', -1.),
+    ('slices_other_beam_Sigma_44_star', 1.),
+    ]
+
 class BeamBeamBiGaussian3D(xt.BeamElement):
 
     _xofields = {
@@ -144,6 +530,9 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
         'slices_other_beam_sqrtSigma_33_beamstrahlung': xo.Float64[:],
         'slices_other_beam_sqrtSigma_55_beamstrahlung': xo.Float64[:],
 
+        # packed copy of the per-slice arrays above, used in the kick
+        '_slices_other_beam_packed': xo.Float64[:],
+
          #bhabha
         'flag_bhabha': xo.Int64,
         'compt_x_min': xo.Float64,
@@ -157,12 +546,24 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
         'number_of_particles': xo.Float64,
         'x_rms': xo.Float64,
         'y_rms': xo.Float64,
+
+        # combi luminosity: per-slice 2D histograms of both beams in the
+        # boosted frame, [i_slice][iy][ix] with lumigrid_n_cells cells per side
+        'lumigrid_n_cells': xo.Int64,
+        'lumigrid_half_width_x': xo.Float64,
+        'lumigrid_half_width_y': xo.Float64,
+        '_lumigrid_my_beam': xo.Float64[:],
+        '_lumigrid_other_beam': xo.Float64[:],
     }
 
     _internal_record_class = BeamBeamBiGaussian3DRecord
 
+    # The per-slice arrays of the other beam are exposed through properties
+    # that keep the packed slice record up to date (see
+    # _slice_record_property)
     _rename = {'flag_beamstrahlung': '_flag_beamstrahlung',
-               'flag_bhabha': '_flag_bhabha'}
+               'flag_bhabha': '_flag_bhabha',
+               **{nn: '_' + nn for nn in _SLICE_RECORD_FIELDS}}
 
     _depends_on = [xt.RandomUniform]
 
@@ -173,12 +574,14 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
         _pkg_root.joinpath('headers/power_n.h'),
         _pkg_root.joinpath('headers/lumicalc.h'),
         _pkg_root.joinpath('headers','particle_states.h'),
+        _pkg_root.joinpath('beam_elements/beambeam_src/beambeam3d_trace.h'),
         _pkg_root.joinpath('fieldmaps/bigaussian_src/faddeeva.h'),
         _pkg_root.joinpath('fieldmaps/bigaussian_src/bigaussian.h'),
         _pkg_root.joinpath('beam_elements/beambeam_src/beambeam3d_transport_sigmas.h'),
         _pkg_root.joinpath('beam_elements/beambeam_src/beambeam3d_ref_frame_changes.h'),
 
         # beamstrahlung
+        _pkg_root.joinpath('headers/record_chunks.h'),
         _pkg_root.joinpath('headers/beamstrahlung_spectrum.h'),
         _pkg_root.joinpath('headers/bhabha_spectrum.h'),
         _pkg_root.joinpath('beam_elements/beambeam_src/beambeam3d.h'),
@@ -186,23 +589,29 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
             'beam_elements/beambeam_src/beambeam3d_methods_for_strongstrong.h'),
 
    ]
-    #make a new kernel like below for the computation of the grid, put input arguments of c funcgtion too
+    _kernels = {
+        'BeamBeam3D_pack_slices_other_beam': xo.Kernel(
+            args=[
+                xo.Arg(xo.ThisClass, name='el'),
+                xo.Arg(xo.Int64, name='n_slices'),
+            ],
+            n_threads='n_slices'),
+    }
     _per_particle_kernels={
-        'fillHistogram': xo.Kernel(  # NEW
-            c_name='BeamBeam3D_selective_fillHistogram',
+        'fill_lumigrid': xo.Kernel(
+            c_name='BeamBeam3D_selective_fill_lumigrid',
             args=[
-                xo.Arg(xo.Float64, pointer=True, name='particles'),
-                xo.Arg(xo.Int64, pointer=False, name='npart'),
+                xo.Arg(xo.Int64, pointer=False, name='i_slice_min'),
+                xo.Arg(xo.Int64, pointer=False, name='i_slice_max'),
+                xo.Arg(xo.Int64, pointer=True, name='i_slice_for_particles'),
             ]),
-        'lumicalc': xo.Kernel(  # NEW
-            c_name='BeamBeam3D_selective_lumicalc',
+        'compute_lumi_integral': xo.Kernel(
+            c_name='BeamBeam3D_selective_compute_lumi_integral',
             args=[
                 xo.Arg(xo.Int64, pointer=False, name='timestep'),
-                xo.Arg(xo.Float64, pointer=True, name='lumigrid_my_beam'),
-                xo.Arg(xo.Float64, pointer=True, name='lumigrid_other_beam'),
-                xo.Arg(xo.Int64, pointer=False, name='n_lumigrid_cells'),
-                xo.Arg(xo.Int64, pointer=False, name='intensity1'),
-                xo.Arg(xo.Int64, pointer=False, name='intensity2'),
+                xo.Arg(xo.Int64, pointer=False, name='i_slice_min'),
+                xo.Arg(xo.Int64, pointer=False, name='n_rows'),
+                xo.Arg(xo.Float64, pointer=True, name='row_sums'),
             ]),
         'synchro_beam_kick': xo.Kernel(
             c_name='BeamBeam3D_selective_apply_synchrobeam_kick_local_particle',
@@ -249,6 +658,7 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
                     number_of_particles = 0.,
                     x_rms = 0.,
                     y_rms = 0.,
+                    lumigrid_nsig = 12.,
                     
                     slices_other_beam_x_center_star=None,
                     slices_other_beam_px_center_star=None,
@@ -311,8 +721,15 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
 
         if '_xobject' in kwargs.keys():
             self.xoinitialize(**kwargs)
+            self._auto_pack_slices = True
             return
 
+        # Derived from the per-slice arrays, rebuilt below
+        kwargs.pop('_slices_other_beam_packed', None)
+        # Work arrays of the combi luminosity, allocated below
+        kwargs.pop('_lumigrid_my_beam', None)
+        kwargs.pop('_lumigrid_other_beam', None)
+
         # Collective mode (pipeline update)
         if config_for_update is not None:
 
@@ -346,8 +763,6 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
                 slices_other_beam_num_particles = np.zeros_like(
                                             slices_other_beam_zeta_center)
             self.moments = None
-            self.lumigrid_my_beam = None  # NEW
-            self.lumigrid_other_beam = None  # NEW
 
 
         else:
@@ -355,6 +770,8 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
 
         if old_interface is not None:
             self._init_from_old_interface(old_interface=old_interface, **kwargs)
+            self._pack_slices_other_beam()
+            self._auto_pack_slices = True
             return
 
         assert (slices_other_beam_zeta_center is not None
@@ -378,14 +795,35 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
 
         n_slices = len(slices_other_beam_num_particles)
 
-        self._allocate_xobject(n_slices, **kwargs)
+        n_lumigrid_my_beam = 0
+        n_lumigrid_other_beam = 0
+        if flag_combilumi == 1:
+            assert (config_for_update is not None
+                    and config_for_update.n_lumigrid_cells is not None), (
+                'flag_combilumi requires a config_for_update with n_lumigrid_cells')
+            n_cells = config_for_update.n_lumigrid_cells
+            assert n_cells >= 2, 'n_lumigrid_cells must be at least 2'
+            n_lumigrid_my_beam = (
+                n_cells**2 * config_for_update.slicer.num_slices)
+            n_lumigrid_other_beam = n_cells**2 * n_slices
+
+        self._allocate_xobject(n_slices,
+                               n_lumigrid_my_beam=n_lumigrid_my_beam,
+                               n_lumigrid_other_beam=n_lumigrid_other_beam,
+                               **kwargs)
 
         if config_for_update is not None:
-            self.partner_moments = self._buffer.context.nplike_lib.zeros(
-                self.config_for_update.slicer.num_slices*(1+6+10), dtype=float)
-            self.partner_lumigrid = self._buffer.context.nplike_lib.zeros(
-                self.config_for_update.n_lumigrid_cells**2*n_slices, dtype=float)  # NEW, nxn flattened grid, int but concat will make it float anyway
-            self.partner_buffer = np.hstack([self.partner_moments, self.partner_lumigrid])  # NEW
+            # header, moments and histograms of all slices (if any)
+            self._wire = StrongStrongWireFormat(self._buffer.context,
+                n_slices_send=self.config_for_update.slicer.num_slices,
+                n_slices_recv=n_slices,
+                n_lumigrid_send=n_lumigrid_my_beam,
+                n_lumigrid_recv=n_lumigrid_other_beam,
+                lumigrid_encoding=self.config_for_update.lumigrid_encoding)
+            self.partner_buffer = self._wire.recv_buffer
+            self.partner_moments = self.partner_buffer[
+                _WIRE_HEADER_SIZE:_WIRE_HEADER_SIZE + n_slices*(1+6+10)]
+            self.reset_communication_counters()
 
         if phi is None:
             assert _sin_phi is not None and _cos_phi is not None and _tan_phi is not None, (
@@ -454,7 +892,8 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
                     other_beam_intensity,
                     number_of_particles,
                     x_rms,
-                    y_rms
+                    y_rms,
+                    lumigrid_nsig,
         )
         assert other_beam_q0 is not None
         self.other_beam_q0 = other_beam_q0
@@ -490,7 +929,33 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
         self.min_sigma_diff = min_sigma_diff
         self.threshold_singular = threshold_singular
 
-    def _allocate_xobject(self, n_slices, **kwargs):
+        self._pack_slices_other_beam()
+        self._auto_pack_slices = True
+
+    def _slices_other_beam_changed(self):
+        if self.__dict__.get('_auto_pack_slices', False):
+            self._pack_slices_other_beam()
+
+    def _pack_slices_other_beam(self):
+        # The record is built on the context from the per-slice arrays (see
+        # BeamBeam3D_pack_slices_other_beam in beambeam3d.h)
+        context = self._buffer.context
+        self.compile_kernels(only_if_needed=True)
+        context.kernels.BeamBeam3D_pack_slices_other_beam(
+            el=self._xobject,
+            n_slices=len(self._slices_other_beam_num_particles))
+
+    def update_slices_other_beam_record(self):
+        """
+        Updates the packed per-slice record used in tracking. This is done
+        automatically when the per-slice arrays are set or modified through
+        the element, it is only needed after writing to the underlying
+        buffer directly.
+        """
+        self._pack_slices_other_beam()
+
+    def _allocate_xobject(self, n_slices, n_lumigrid_my_beam=0,
+                          n_lumigrid_other_beam=0, **kwargs):
         self.xoinitialize(
             slices_other_beam_Sigma_11_star=n_slices,
             slices_other_beam_Sigma_12_star=n_slices,
@@ -513,6 +978,9 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
             slices_other_beam_sqrtSigma_11_beamstrahlung=n_slices,
             slices_other_beam_sqrtSigma_33_beamstrahlung=n_slices,
             slices_other_beam_sqrtSigma_55_beamstrahlung=n_slices, 
+            _slices_other_beam_packed=n_slices*_SLICE_RECORD_SIZE,
+            _lumigrid_my_beam=n_lumigrid_my_beam,
+            _lumigrid_other_beam=n_lumigrid_other_beam,
             **kwargs
             )
 
@@ -637,7 +1105,8 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
     def _init_luminosity(self, flag_luminosity):
         self.flag_luminosity = flag_luminosity
         
-    def _init_combilumi(self, flag_combilumi, beam_intensity, other_beam_intensity, number_of_particles, x_rms, y_rms):
+    def _init_combilumi(self, flag_combilumi, beam_intensity, other_beam_intensity, number_of_particles, x_rms, y_rms,
+                        lumigrid_nsig=12.):
         self.flag_combilumi = flag_combilumi
         self.beam_intensity = beam_intensity
         self.other_beam_intensity = other_beam_intensity
@@ -645,6 +1114,15 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
         self.x_rms = x_rms
         self.y_rms = y_rms
 
+        if flag_combilumi == 1:
+            if x_rms <= 0 or y_rms <= 0:
+                raise ValueError('flag_combilumi requires x_rms and y_rms > 0')
+            # both beams are binned on the same grid, centred on the
+            # reference orbit and assuming equal rms beam sizes
+            self.lumigrid_n_cells = self.config_for_update.n_lumigrid_cells
+            self.lumigrid_half_width_x = lumigrid_nsig * x_rms
+            self.lumigrid_half_width_y = lumigrid_nsig * y_rms
+
     def _init_from_old_interface(self, old_interface, **kwargs):
 
         params=old_interface
@@ -738,32 +1216,81 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
         self.num_slices_other_beam = len(params["charge_slices"])
 
     def update_from_recieved_moments(self):
+        # the rows of the received moments are written in place into the
+        # slice arrays, the packed slice record is rebuilt once at the end
         # reference frame transformation as in https://github.com/lhcopt/lhcmask/blob/865eaf9d7b9b888c6486de00214c0c24ac93cfd3/pymask/beambeam.py#L310
-        self.slices_other_beam_num_particles = self._arr2ctx(self.partner_moments[:self.num_slices_other_beam]) # this contains num real particles, the total elementary charge per slice
-        self.slices_other_beam_x_center_star = self._arr2ctx(self.partner_moments[self.num_slices_other_beam:2*self.num_slices_other_beam]) * (-1.0)
-        self.slices_other_beam_px_center_star = self._arr2ctx(self.partner_moments[2*self.num_slices_other_beam:3*self.num_slices_other_beam])
-        self.slices_other_beam_y_center_star = self._arr2ctx(self.partner_moments[3*self.num_slices_other_beam:4*self.num_slices_other_beam])
-        self.slices_other_beam_py_center_star = self._arr2ctx(self.partner_moments[4*self.num_slices_other_beam:5*self.num_slices_other_beam]) * (-1.0)
-        self.slices_other_beam_zeta_center_star = self._arr2ctx(self.partner_moments[5*self.num_slices_other_beam:6*self.num_slices_other_beam])
-        self.slices_other_beam_pzeta_center_star = self._arr2ctx(self.partner_moments[6*self.num_slices_other_beam:7*self.num_slices_other_beam])
-
-        self.slices_other_beam_Sigma_11_star = self._arr2ctx(self.partner_moments[7*self.num_slices_other_beam:8*self.num_slices_other_beam])
-        self.slices_other_beam_Sigma_12_star = self._arr2ctx(self.partner_moments[8*self.num_slices_other_beam:9*self.num_slices_other_beam]) * (-1.0)
-        self.slices_other_beam_Sigma_13_star = self._arr2ctx(self.partner_moments[9*self.num_slices_other_beam:10*self.num_slices_other_beam]) * (-1.0)
-        self.slices_other_beam_Sigma_14_star = self._arr2ctx(self.partner_moments[10*self.num_slices_other_beam:11*self.num_slices_other_beam])
-        self.slices_other_beam_Sigma_22_star = self._arr2ctx(self.partner_moments[11*self.num_slices_other_beam:12*self.num_slices_other_beam])
-        self.slices_other_beam_Sigma_23_star = self._arr2ctx(self.partner_moments[12*self.num_slices_other_beam:13*self.num_slices_other_beam])
-        self.slices_other_beam_Sigma_24_star = self._arr2ctx(self.partner_moments[13*self.num_slices_other_beam:14*self.num_slices_other_beam]) * (-1.0)
-        self.slices_other_beam_Sigma_33_star = self._arr2ctx(self.partner_moments[14*self.num_slices_other_beam:15*self.num_slices_other_beam])
-        self.slices_other_beam_Sigma_34_star = self._arr2ctx(self.partner_moments[15*self.num_slices_other_beam:16*self.num_slices_other_beam]) * (-1.0)
-        self.slices_other_beam_Sigma_44_star = self._arr2ctx(self.partner_moments[16*self.num_slices_other_beam:17*self.num_slices_other_beam])
-
-    def update_from_received_lumigrid(self):  # NEW
-        row_start_indices = np.linspace(0, self.config_for_update.n_lumigrid_cells**2*self.num_slices_other_beam, self.config_for_update.n_lumigrid_cells*self.num_slices_other_beam+1, dtype=int)[:-1]  # get index of first element of each row
-        lumigrid_other_beam = self._arr2ctx(self.partner_lumigrid)  # need to flip x dimension
-        self.lumigrid_other_beam = self._buffer.context.nplike_lib.hstack([lumigrid_other_beam[i:i+self.config_for_update.n_lumigrid_cells][::-1] for i in row_start_indices])  # x dim flipped, still 1D buffer
-        print("received lumigrid_other_beam:", self.lumigrid_other_beam)
-        # at this point I have lumigrid_my_beam and lumigrid_other_beam
+        for irow, (name, sign) in enumerate(_RECEIVED_MOMENTS_ROWS):
+            # num_particles is the num real particles, the total elementary charge per slice
+            getattr(self, '_' + name)[:] = sign * self._wire.recv_moments[irow]
+        self._pack_slices_other_beam()
+
+    def update_from_received_lumigrid(self):
+        # x of the other beam is flipped in our boosted frame (as the
+        # centroids above), i.e. the fast index of each histogram row
+        n_cells = self.lumigrid_n_cells
+        partner_lumigrid = self._wire.decode_lumigrid()
+        self._lumigrid_other_beam[:] = partner_lumigrid.reshape(
+                                                -1, n_cells)[:, ::-1].ravel()
+
+    def _fill_lumigrid_my_beam(self, particles, i_slice_min, i_slice_max):
+        # reset and refill the histograms of slices i_slice_min..i_slice_max
+        context = self._buffer.context
+        n_cells2 = self.lumigrid_n_cells**2
+        self._lumigrid_my_beam[i_slice_min*n_cells2:(i_slice_max+1)*n_cells2] = 0
+
+        # on CPU each thread bins on its own copy of the histograms, on GPU
+        # (or if the copies would be too large) atomics are used
+        nelem = (i_slice_max - i_slice_min + 1) * n_cells2
+        n_private_grids = 0
+        if isinstance(context, xo.ContextCpu):
+            n_private_grids = _get_cpu_num_threads(context)
+            if n_private_grids * nelem * 8 > PRIVATE_GRIDS_MAX_BYTES:
+                n_private_grids = 0
+
+        if n_private_grids > 0:
+            _add_lumicalc_kernels(context)
+            if (getattr(self, '_lumigrid_private_grids', None) is None
+                    or len(self._lumigrid_private_grids)
+                                        < n_private_grids * nelem):
+                self._lumigrid_private_grids = context.zeros(
+                        shape=(n_private_grids * nelem,), dtype=np.float64)
+            context.kernels.lumigrid_fill_private_grids(
+                    nparticles=particles._capacity,
+                    x=particles.x, y=particles.y, weight=particles.weight,
+                    state=particles.state,
+                    slice_index=self.config_for_update._particles_slice_index,
+                    i_slice_min=i_slice_min, i_slice_max=i_slice_max,
+                    n_cells=self.lumigrid_n_cells,
+                    half_width_x=self.lumigrid_half_width_x,
+                    half_width_y=self.lumigrid_half_width_y,
+                    n_private_grids=n_private_grids,
+                    private_grids=self._lumigrid_private_grids,
+                    lumigrid=self._lumigrid_my_beam)
+        else:
+            self.fill_lumigrid(particles=particles,
+                    i_slice_min=i_slice_min, i_slice_max=i_slice_max,
+                    i_slice_for_particles=self.config_for_update._particles_slice_index)
+
+    def _compute_combilumi(self, particles, timestep, i_slice_min, i_slice_max):
+        # overlap integrals of the colliding slices, one row per thread,
+        # reduced and recorded by the compute_lumi_integral kernel
+        context = self._buffer.context
+        _add_lumicalc_kernels(context)
+        n_rows = (i_slice_max - i_slice_min + 1) * self.lumigrid_n_cells
+        if (getattr(self, '_lumigrid_row_sums', None) is None
+                or len(self._lumigrid_row_sums) < n_rows):
+            self._lumigrid_row_sums = context.zeros(
+                    shape=(self.config_for_update.slicer.num_slices
+                           * self.lumigrid_n_cells,), dtype=np.float64)
+        context.kernels.lumigrid_overlap_rows(
+                n_rows=n_rows, n_cells=self.lumigrid_n_cells,
+                timestep=timestep, i_slice_min=i_slice_min,
+                lumigrid_my_beam=self._lumigrid_my_beam,
+                lumigrid_other_beam=self._lumigrid_other_beam,
+                row_sums=self._lumigrid_row_sums)
+        self.compute_lumi_integral(particles=particles, timestep=timestep,
+                i_slice_min=i_slice_min, n_rows=n_rows,
+                row_sums=self._lumigrid_row_sums)
 
     def _track_collective(self, particles, _force_suspend=False):
         if self.config_for_update._working_on_bunch is not None:
@@ -824,85 +1351,243 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
                 self.change_back_ref_frame_and_subtract_dipolar(particles)
                 return None
             
-    def _apply_bb_kicks_in_boosted_frame(self, particles, number_of_particles):
+    def _apply_bb_kicks_in_boosted_frame(self, particles):
 
         n_slices_self_beam = self.config_for_update.slicer.num_slices
+        n_steps = n_slices_self_beam + self.num_slices_other_beam - 1
 
         while True:
 
+            # slices of this beam below i_slice_min_kick were already kicked
+            # before the message of this step was received (overlapped
+            # communication only)
+            i_slice_min_kick = None
+
             # recompute and communicate slice moments; if QSS only update before first step
             if (self.config_for_update._do_update and (not self.config_for_update.quasistrongstrong
                 or self.config_for_update._i_step == 0)):
 
-                ii = 0
-                while particles.state[ii] != 1:
-                    ii += 1
-                at_turn = int(particles.at_turn[ii])
-
-                if self.config_for_update.pipeline_manager.is_ready_to_send(self.config_for_update.element_name,
-                                                     particles.name,
-                                                     self.config_for_update.partner_particles_name,
-                                                     at_turn,
-                                                     internal_tag=self.config_for_update._i_step):
-                    # Compute moments
-                    self.config_for_update.slicer.assign_slices(particles)  # in this the bin edges are fixed with TempSlicer
-                    self.moments = self.config_for_update.slicer.compute_moments(particles,update_assigned_slices=False)
-                    
-                    # NEW lumigrid my beam is computed here for all slices
-                    #self.lumigrid_my_beam = particles.q0*self._buffer.context.nplike_lib.array(range(self.config_for_update.n_lumigrid_cells**2*self.num_slices_other_beam)) #delete this and call the grid filling function here  # call C function to compute my beams lumigrid here, e.g. 2 slices, 3 by 3 grid for each slice
-                    self.lumigrid_my_beam = self.config_for_update.compute_distribution_histogram(particles, number_of_particles)
-                    exchange_buffer = self._buffer.context.nplike_lib.hstack([self.moments, self.lumigrid_my_beam])
-                    print("buffer to send: ", exchange_buffer, len(exchange_buffer), " moments: ", self.moments, " lumigrid my beam:", self.lumigrid_my_beam, " n_lumigrid_cells: ", self.config_for_update.n_lumigrid_cells)
-
-                    self.config_for_update.pipeline_manager.send_message(self.moments,
-                                                     self.config_for_update.element_name,
-                                                     particles.name,
-                                                     self.config_for_update.partner_particles_name,
-                                                     at_turn,
-                                                     internal_tag=self.config_for_update._i_step)
+                if self.config_for_update._sent_step != self.config_for_update._i_step:
+                    self._send_moments(particles, self._get_at_turn(particles),
+                                       self.config_for_update._i_step)
+
+                if self._kicks_slice_0_before_receiving():
+                    i_slice_min_kick = 1
+                    if self.config_for_update._early_kick_step != self.config_for_update._i_step:
+                        self._kick_at_step(particles, i_slice_max=0)
+                        self.config_for_update._early_kick_step = self.config_for_update._i_step
+                        self.communication_counters['num_early_kicks'] += 1
+
                 if self.config_for_update.pipeline_manager.is_ready_to_recieve(self.config_for_update.element_name,
                                         self.config_for_update.partner_particles_name,
                                         particles.name,
                                         internal_tag=self.config_for_update._i_step):
-                    # NEW
                     self.config_for_update.pipeline_manager.recieve_message(self.partner_buffer,
                                         self.config_for_update.element_name,
                                         self.config_for_update.partner_particles_name,
                                         particles.name,
                                         internal_tag=self.config_for_update._i_step)
-                    
-                     # NEW
-                    self.partner_moments = self.partner_buffer[:int(self.config_for_update.slicer.num_slices*17)]
-                    self.partner_lumigrid = self.partner_buffer[int(self.config_for_update.slicer.num_slices*17):]
+                    self._wire.check_received()
                     self.update_from_recieved_moments()
-                    self.update_from_received_lumigrid()
-                    
-                else:
-                    return xt.PipelineStatus(on_hold=True)
+                    if self.flag_combilumi == 1:
+                        self.update_from_received_lumigrid()
 
-            # compute interacting other beam slice ID
-            self.config_for_update._other_beam_slice_index_for_particles[:] =(
-                 self.config_for_update._i_step - self.config_for_update._particles_slice_index)
+                    if self.config_for_update._wait_start is not None:
+                        self.communication_counters['wait_time'] += (
+                            time.perf_counter() - self.config_for_update._wait_start)
+                        self.config_for_update._wait_start = None
 
-            self.synchro_beam_kick(particles=particles,
-                        i_slice_for_particles=self.config_for_update._other_beam_slice_index_for_particles)
+                else:
+                    if self.config_for_update._wait_start is None:
+                        self.config_for_update._wait_start = time.perf_counter()
+                        self.communication_counters['num_waits'] += 1
+                    self.communication_counters['num_on_hold'] += 1
+                    return xt.PipelineStatus(on_hold=True)
 
-            self.compute_lumi_integral(particles=particles,
-                 timestep=self.config_for_update._i_step, 
-                 lumigrid_my_beam=self.lumigrid_my_beam, 
-                 lumigrid_other_beam=self.lumigrid_other_beam,
-                 n_lumigrid_cells=self.config_for_update.n_lumigrid_cells)  # NEW, C function to compute integral based on 2 grids at timestep _i_step, grids contain the status at _i_step for every slice but only overlapping will interact
+            self._kick_at_step(particles, i_slice_min=i_slice_min_kick)
+
+            # with overlapped communication the moments of the next step are
+            # sent as soon as the kicks of this step are done, before the
+            # luminosity of this step is computed
+            lumigrid_filled = False
+            if (self._use_overlapped_communication()
+                    and self.config_for_update._i_step < n_steps - 1):
+                lumigrid_filled = self._send_moments(particles,
+                        self._get_at_turn(particles),
+                        self.config_for_update._i_step + 1)
+
+            if self.flag_combilumi == 1:
+                # bin the slices colliding at this step (after their kick)
+                # and add their overlap with the other beam to the record
+                i_step = self.config_for_update._i_step
+                i_slice_min = max(0, i_step - self.num_slices_other_beam + 1)
+                i_slice_max = min(i_step, n_slices_self_beam - 1)
+                if not lumigrid_filled:
+                    self._fill_lumigrid_my_beam(particles, i_slice_min, i_slice_max)
+                self._compute_combilumi(particles, i_step,
+                                        i_slice_min, i_slice_max)
 
 
             self.config_for_update._i_step += 1
-            if self.config_for_update._i_step == (
-                            n_slices_self_beam + self.num_slices_other_beam - 1):
+            if self.config_for_update._i_step == n_steps:
                 self.config_for_update._i_step = 0
+                self.config_for_update._sent_step = -1
+                self.config_for_update._early_kick_step = -1
                 self.config_for_update._working_on_bunch = None
                 break
 
         return None
 
+    def _get_at_turn(self, particles):
+        ii = 0
+        while particles.state[ii] != 1:
+            ii += 1
+        return int(particles.at_turn[ii])
+
+    def _send_moments(self, particles, at_turn, i_step):
+        # Computes and sends the moments of the slices of this beam for step
+        # i_step (if the pipeline manager is ready). Returns True if the
+        # histograms of all slices were refilled for the message.
+        n_slices_self_beam = self.config_for_update.slicer.num_slices
+
+        if not self.config_for_update.pipeline_manager.is_ready_to_send(self.config_for_update.element_name,
+                                             particles.name,
+                                             self.config_for_update.partner_particles_name,
+                                             at_turn,
+                                             internal_tag=i_step):
+            return False
+
+        # Compute moments
+        if self._use_incremental_moments(particles):
+            # full pass at the first step, then only the
+            # particles kicked at the previous steps are updated
+            if i_step == 0:
+                self.moments = self.config_for_update._incremental_moments.reset(particles)
+            else:
+                self.moments = self.config_for_update._incremental_moments.get_moments(particles)
+        else:
+            # slicing (with the bin edges fixed in TempSlicer) and moments in one pass
+            self.moments = self.config_for_update.slicer.compute_moments(particles,
+                                        update_assigned_slices=True, store_slices=False)
+
+        lumigrid = None
+        if self.flag_combilumi == 1:
+            # histograms of all slices are sent with the moments
+            self._fill_lumigrid_my_beam(particles, 0,
+                                        n_slices_self_beam - 1)
+            lumigrid = self._lumigrid_my_beam
+        send_buffer = self._wire.encode(self.moments, lumigrid,
+                                        at_turn=at_turn, i_step=i_step)
+
+        self.config_for_update.pipeline_manager.send_message(send_buffer,
+                                         self.config_for_update.element_name,
+                                         particles.name,
+                                         self.config_for_update.partner_particles_name,
+                                         at_turn,
+                                         internal_tag=i_step)
+        self.config_for_update._sent_step = i_step
+        return lumigrid is not None
+
+    def _kick_at_step(self, particles, i_slice_min=None, i_slice_max=None):
+        # Kicks the particles of slices i_slice_min..i_slice_max of this beam
+        # (unbounded if None, including the particles outside of the bin
+        # edges) with the slices of the other beam colliding with them at
+        # the current step
+        i_step = self.config_for_update._i_step
+        slice_index = self.config_for_update._particles_slice_index
+
+        # compute interacting other beam slice ID (-1 for the particles
+        # that are not kicked)
+        other_beam_slice_index = self.config_for_update._other_beam_slice_index_for_particles
+        other_beam_slice_index[:] = i_step - slice_index
+        if i_slice_min is not None:
+            other_beam_slice_index[slice_index < i_slice_min] = -1
+        if i_slice_max is not None:
+            other_beam_slice_index[slice_index > i_slice_max] = -1
+
+        # the slice moments of the kicked particles are updated around
+        # the kick (not needed after the last step)
+        kicked_ids = None
+        if (self._use_incremental_moments(particles)
+                and i_step < (self.config_for_update.slicer.num_slices
+                              + self.num_slices_other_beam - 2)):
+            kicked_ids = self._get_particles_kicked_at_step(i_step,
+                                i_slice_min=i_slice_min, i_slice_max=i_slice_max)
+            self.config_for_update._incremental_moments.remove(
+                                            particles, kicked_ids)
+
+        self.synchro_beam_kick(particles=particles,
+                    i_slice_for_particles=other_beam_slice_index)
+
+        if kicked_ids is not None:
+            self.config_for_update._incremental_moments.add(
+                                            particles, kicked_ids)
+
+    def _use_overlapped_communication(self):
+        return (self.config_for_update.overlap_communication
+                and self.config_for_update._do_update
+                and not self.config_for_update.quasistrongstrong)
+
+    def _kicks_slice_0_before_receiving(self):
+        # At step i_step > 0 slice 0 of this beam collides with slice i_step
+        # of the other beam (and the particles before the first bin edge
+        # with slice i_step + 1), which was not kicked yet: its moments are
+        # the same as in the message of the previous step, so that these
+        # particles can be kicked while the message of this step is in
+        # flight. The message of this step needs to be sent first, as it
+        # contains the moments of slice 0 before the kick.
+        i_step = self.config_for_update._i_step
+        return (self._use_overlapped_communication()
+                and 1 <= i_step < self.num_slices_other_beam
+                and self.config_for_update._sent_step == i_step)
+
+    def reset_communication_counters(self):
+        '''
+        Resets the counters of the strong-strong communication:
+         - wait_time: wall time [s] between the first time the element is put
+           on hold at a step and the reception of the message of that step
+         - num_waits: number of steps at which the element was put on hold
+         - num_on_hold: number of times the element was put on hold
+         - num_early_kicks: number of kicks done while the message of their
+           step was in flight (see overlap_communication)
+        '''
+        self.communication_counters = {'wait_time': 0., 'num_waits': 0,
+                                       'num_on_hold': 0, 'num_early_kicks': 0}
+
+    def _use_incremental_moments(self, particles):
+        # Strong-strong updates at every step, on CPU
+        if (not self.config_for_update._do_update
+                or self.config_for_update.quasistrongstrong
+                or not isinstance(particles._context, xo.ContextCpu)):
+            return False
+        if self.config_for_update._incremental_moments is None:
+            self.config_for_update._incremental_moments = IncrementalSliceMoments(
+                                                self.config_for_update.slicer)
+        return True
+
+    def _get_particles_kicked_at_step(self, i_step, i_slice_min=None,
+                                      i_slice_max=None):
+        # Indices of the particles whose slice collides with a slice of the
+        # other beam at step i_step (restricted to slices
+        # i_slice_min..i_slice_max), from the particles sorted by slice
+        if i_step == 0 or self.config_for_update._particles_sorted_by_slice is None:
+            slice_index = self.config_for_update._particles_slice_index
+            order = np.argsort(slice_index, kind='stable')
+            self.config_for_update._particles_sorted_by_slice = order
+            self.config_for_update._sorted_slice_index = slice_index[order]
+        sorted_index = self.config_for_update._sorted_slice_index
+        # the particles before the first bin edge (slice -1) are kicked
+        # as long as i_step + 1 is a slice of the other beam
+        i_first = i_step - self.num_slices_other_beam + 1
+        if i_slice_min is not None:
+            i_first = max(i_slice_min, i_first)
+        i_last = i_step
+        if i_slice_max is not None:
+            i_last = min(i_slice_max, i_last)
+        i_start = np.searchsorted(sorted_index, i_first, side='left')
+        i_end = np.searchsorted(sorted_index, i_last, side='right')
+        return self.config_for_update._particles_sorted_by_slice[i_start:i_end]
+
     @property
     def sin_phi(self):
         return self._sin_phi
@@ -1275,7 +1960,8 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
               container_setitem_name='_Sigma_11_setitem')
 
     def _Sigma_11_setitem(self, indx, val):
-        self.slices_other_beam_Sigma_11_star[indx] = val / 1.
+        self._slices_other_beam_Sigma_11_star[indx] = val / 1.
+        self._slices_other_beam_changed()
 
     @slices_other_beam_Sigma_11.setter
     def slices_other_beam_Sigma_11(self, value):
@@ -1291,7 +1977,8 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
               container_setitem_name='_Sigma_12_setitem')
 
     def _Sigma_12_setitem(self, indx, val):
-        self.slices_other_beam_Sigma_12_star[indx] = val / self.cos_phi
+        self._slices_other_beam_Sigma_12_star[indx] = val / self.cos_phi
+        self._slices_other_beam_changed()
 
     @slices_other_beam_Sigma_12.setter
     def slices_other_beam_Sigma_12(self, value):
@@ -1307,7 +1994,8 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
               container_setitem_name='_Sigma_13_setitem')
 
     def _Sigma_13_setitem(self, indx, val):
-        self.slices_other_beam_Sigma_13_star[indx] = val / 1.
+        self._slices_other_beam_Sigma_13_star[indx] = val / 1.
+        self._slices_other_beam_changed()
 
     @slices_other_beam_Sigma_13.setter
     def slices_other_beam_Sigma_13(self, value):
@@ -1323,7 +2011,8 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
               container_setitem_name='_Sigma_14_setitem')
 
     def _Sigma_14_setitem(self, indx, val):
-        self.slices_other_beam_Sigma_14_star[indx] = val / self.cos_phi
+        self._slices_other_beam_Sigma_14_star[indx] = val / self.cos_phi
+        self._slices_other_beam_changed()
 
     @slices_other_beam_Sigma_14.setter
     def slices_other_beam_Sigma_14(self, value):
@@ -1339,7 +2028,8 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
               container_setitem_name='_Sigma_22_setitem')
 
     def _Sigma_22_setitem(self, indx, val):
-        self.slices_other_beam_Sigma_22_star[indx] = val / (self.cos_phi * self.cos_phi)
+        self._slices_other_beam_Sigma_22_star[indx] = val / (self.cos_phi * self.cos_phi)
+        self._slices_other_beam_changed()
 
     @slices_other_beam_Sigma_22.setter
     def slices_other_beam_Sigma_22(self, value):
@@ -1355,7 +2045,8 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
               container_setitem_name='_Sigma_23_setitem')
 
     def _Sigma_23_setitem(self, indx, val):
-        self.slices_other_beam_Sigma_23_star[indx] = val / self.cos_phi
+        self._slices_other_beam_Sigma_23_star[indx] = val / self.cos_phi
+        self._slices_other_beam_changed()
 
     @slices_other_beam_Sigma_23.setter
     def slices_other_beam_Sigma_23(self, value):
@@ -1371,7 +2062,8 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
               container_setitem_name='_Sigma_24_setitem')
 
     def _Sigma_24_setitem(self, indx, val):
-        self.slices_other_beam_Sigma_24_star[indx] = val / (self.cos_phi * self.cos_phi)
+        self._slices_other_beam_Sigma_24_star[indx] = val / (self.cos_phi * self.cos_phi)
+        self._slices_other_beam_changed()
 
     @slices_other_beam_Sigma_24.setter
     def slices_other_beam_Sigma_24(self, value):
@@ -1387,7 +2079,8 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
               container_setitem_name='_Sigma_33_setitem')
 
     def _Sigma_33_setitem(self, indx, val):
-        self.slices_other_beam_Sigma_33_star[indx] = val / 1.
+        self._slices_other_beam_Sigma_33_star[indx] = val / 1.
+        self._slices_other_beam_changed()
 
     @slices_other_beam_Sigma_33.setter
     def slices_other_beam_Sigma_33(self, value):
@@ -1403,7 +2096,8 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
               container_setitem_name='_Sigma_34_setitem')
 
     def _Sigma_34_setitem(self, indx, val):
-        self.slices_other_beam_Sigma_34_star[indx] = val / self.cos_phi
+        self._slices_other_beam_Sigma_34_star[indx] = val / self.cos_phi
+        self._slices_other_beam_changed()
 
     @slices_other_beam_Sigma_34.setter
     def slices_other_beam_Sigma_34(self, value):
@@ -1419,7 +2113,8 @@ class BeamBeamBiGaussian3D(xt.BeamElement):
               container_setitem_name='_Sigma_44_setitem')
 
     def _Sigma_44_setitem(self, indx, val):
-        self.slices_other_beam_Sigma_44_star[indx] = val / (self.cos_phi * self.cos_phi)
+        self._slices_other_beam_Sigma_44_star[indx] = val / (self.cos_phi * self.cos_phi)
+        self._slices_other_beam_changed()
 
     @slices_other_beam_Sigma_44.setter
     def slices_other_beam_Sigma_44(self, value):
@@ -1539,6 +2234,32 @@ _python_inv_boost = np.vectorize(_python_inv_boost_scalar,
     excluded=("sphi", "cphi", "tphi", "salpha", "calpha"))
 
 
+def _slice_record_property(name):
+    # Per-slice array of the other beam, the packed slice record is rebuilt
+    # when it is set or when its elements are modified in place
+    def getter(self):
+        return self._buffer.context.linked_array_type.from_array(
+            getattr(self, '_' + name),
+            mode='setitem_from_container',
+            container=self,
+            container_setitem_name=f'_{name}_setitem')
+
+    def setter(self, value):
+        setattr(self, '_' + name, value)
+        self._slices_other_beam_changed()
+
+    def setitem(self, indx, val):
+        getattr(self, '_' + name)[indx] = val
+        self._slices_other_beam_changed()
+
+    return property(getter, setter), setitem
+
+for _name in _SLICE_RECORD_FIELDS:
+    _prop, _setitem = _slice_record_property(_name)
+    setattr(BeamBeamBiGaussian3D, _name, _prop)
+    setattr(BeamBeamBiGaussian3D, f'_{_name}_setitem', _setitem)
+
+
 class ConfigForUpdateBeamBeamBiGaussian3D:
 
     def __init__(self,
@@ -1548,7 +2269,9 @@ class ConfigForUpdateBeamBeamBiGaussian3D:
         partner_particles_name=None,
         update_every=None,
         quasistrongstrong=None,
-        n_lumigrid_cells=None  # NEW
+        n_lumigrid_cells=None,  # NEW
+        lumigrid_encoding='float64',
+        overlap_communication=False
         ):
 
         self.pipeline_manager = pipeline_manager
@@ -1558,8 +2281,21 @@ class ConfigForUpdateBeamBeamBiGaussian3D:
         self.update_every = update_every
         self.quasistrongstrong = quasistrongstrong
         self.n_lumigrid_cells = n_lumigrid_cells  # NEW
+        # encoding of the histograms sent to the partner, see
+        # StrongStrongWireFormat
+        self.lumigrid_encoding = lumigrid_encoding
+        # send the moments of the next step as soon as the kicks of a step
+        # are done and kick the slices that do not depend on the message in
+        # flight while waiting for it (strong-strong only)
+        self.overlap_communication = overlap_communication
 
         self._i_step = 0
         self._working_on_bunch = None
         self._particles_slice_index = None
+        self._incremental_moments = None
+        self._particles_sorted_by_slice = None
+        self._sorted_slice_index = None
+        self._sent_step = -1
+        self._early_kick_step = -1
+        self._wait_start = None
 
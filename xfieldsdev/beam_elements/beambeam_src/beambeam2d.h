@@ -10,6 +10,38 @@
     #define mysign(a) (((a) >= 0) - ((a) < 0))
 #endif
 
+#ifdef BIGAUSSIAN_VEC_USE_TILES
+/*gpufun*/
+void BeamBeamBiGaussian2D_kick_tile(LocalParticle* part0,
+        BiGaussianParticleTile* tile,
+        double const sigma_x_hat, double const sigma_y_hat,
+        double const min_sigma_diff,
+        double const costheta, double const sintheta,
+        double const post_subtract_px, double const post_subtract_py){
+
+    // Exact field for all the particles of the tile, then kicks
+    get_Ex_Ey_gauss_vec(tile->n, tile->x, tile->y,
+        sigma_x_hat, sigma_y_hat,
+        min_sigma_diff,
+        tile->Ex, tile->Ey);
+
+    LocalParticle lpart = *part0;
+    for (int64_t ii=0; ii<tile->n; ii++){
+        lpart.ipart = tile->ipart[ii];
+
+        double const dpx_hat = tile->factor[ii] * tile->Ex[ii];
+        double const dpy_hat = tile->factor[ii] * tile->Ey[ii];
+
+        double const dpx = dpx_hat*costheta - dpy_hat*sintheta;
+        double const dpy = dpx_hat*sintheta + dpy_hat*costheta;
+
+        LocalParticle_add_to_px(&lpart, dpx - post_subtract_px);
+        LocalParticle_add_to_py(&lpart, dpy - post_subtract_py);
+    }
+    tile->n = 0;
+}
+#endif
+
 /*gpufun*/
 void BeamBeamBiGaussian2D_track_local_particle(
         BeamBeamBiGaussian2DData el, LocalParticle* part0){
@@ -35,6 +67,43 @@ void BeamBeamBiGaussian2D_track_local_particle(
 
     double const min_sigma_diff = BeamBeamBiGaussian2DData_get_min_sigma_diff(el);
 
+    // Rotated frame to account for transverse coupling (if needed)
+    int const coupled = fabs(other_beam_Sigma_13) > 1e-13;
+    double costheta, sintheta, Sig_11_hat, Sig_33_hat;
+    if (coupled) {
+        double const R = other_beam_Sigma_11 - other_beam_Sigma_33;
+        double const W = other_beam_Sigma_11 + other_beam_Sigma_33;
+        double const T = R * R + 4 * other_beam_Sigma_13 * other_beam_Sigma_13;
+        double const sqrtT = sqrt(T);
+        double const signR = mysign(R);
+        double const cos2theta = signR*R/sqrtT;
+        costheta = sqrt(0.5*(1.+cos2theta));
+        sintheta = signR*mysign(other_beam_Sigma_13)*sqrt(0.5*(1.-cos2theta));
+        Sig_11_hat = 0.5*(W+signR*sqrtT);
+        Sig_33_hat = 0.5*(W-signR*sqrtT);
+    }
+    else{
+        sintheta = 0;
+        costheta = 1;
+        Sig_11_hat = other_beam_Sigma_11;
+        Sig_33_hat = other_beam_Sigma_33;
+    }
+    double const sigma_x_hat = sqrt(Sig_11_hat);
+    double const sigma_y_hat = sqrt(Sig_33_hat);
+
+    // Tabulated field (see BiGaussianFieldMap)
+    int const use_table = BeamBeamBiGaussian2DData_get__field_engine(el) == 1
+            && gauss_table_is_valid(sigma_x_hat, sigma_y_hat,
+                        BeamBeamBiGaussian2DData_get__table_sigma_x(el),
+                        BeamBeamBiGaussian2DData_get__table_sigma_y(el),
+                        min_sigma_diff);
+
+    #ifdef BIGAUSSIAN_VEC_USE_TILES
+    // Otherwise the exact field is evaluated for tiles of particles
+    BiGaussianParticleTile tile;
+    tile.n = 0;
+    #endif
+
     //start_per_particle_block (part0->part)
 
         double const x = LocalParticle_get_x(part);
@@ -48,38 +117,17 @@ void BeamBeamBiGaussian2D_track_local_particle(
         double const x_bar = x - ref_shift_x - other_beam_shift_x;
         double const y_bar = y - ref_shift_y - other_beam_shift_y;
 
-        // Move to rotated frame to account for transverse coupling (if needed)
-        double x_hat, y_hat, costheta, sintheta, Sig_11_hat, Sig_33_hat;
-        if (fabs(other_beam_Sigma_13) > 1e-13) {
-            double const R = other_beam_Sigma_11 - other_beam_Sigma_33;
-            double const W = other_beam_Sigma_11 + other_beam_Sigma_33;
-            double const T = R * R + 4 * other_beam_Sigma_13 * other_beam_Sigma_13;
-            double const sqrtT = sqrt(T);
-            double const signR = mysign(R);
-            double const cos2theta = signR*R/sqrtT;
-            costheta = sqrt(0.5*(1.+cos2theta));
-            sintheta = signR*mysign(other_beam_Sigma_13)*sqrt(0.5*(1.-cos2theta));
+        // Move to rotated frame
+        double x_hat, y_hat;
+        if (coupled) {
             x_hat = x_bar*costheta +y_bar*sintheta;
             y_hat = -x_bar*sintheta +y_bar*costheta;
-            Sig_11_hat = 0.5*(W+signR*sqrtT);
-            Sig_33_hat = 0.5*(W-signR*sqrtT);
         }
         else{
-            sintheta = 0;
-            costheta = 1;
             x_hat = x_bar;
             y_hat = y_bar;
-            Sig_11_hat = other_beam_Sigma_11;
-            Sig_33_hat = other_beam_Sigma_33;
         }
 
-        // Get transverse fields
-        double Ex, Ey; // Ex = -dphi/dx, Ey = -dphi/dy
-        get_Ex_Ey_gauss(x_hat, y_hat,
-            sqrt(Sig_11_hat), sqrt(Sig_33_hat),
-            min_sigma_diff,
-            &Ex, &Ey);
-
         const double charge_mass_ratio = part_chi*QELEM*part_q0
                     /(part_mass0*QELEM/(C_LIGHT*C_LIGHT));
         const double factor = (charge_mass_ratio
@@ -88,17 +136,61 @@ void BeamBeamBiGaussian2D_track_local_particle(
                     * (1+other_beam_beta0 * part_beta0)
                     / (other_beam_beta0 + part_beta0));
 
-        double const dpx_hat = factor * Ex;
-        double const dpy_hat = factor * Ey;
-
-        double const dpx = dpx_hat*costheta - dpy_hat*sintheta;
-        double const dpy = dpx_hat*sintheta + dpy_hat*costheta;
-
-        LocalParticle_add_to_px(part, dpx - post_subtract_px);
-        LocalParticle_add_to_py(part, dpy - post_subtract_py);
+        #ifdef BIGAUSSIAN_VEC_USE_TILES
+        if (!use_table){
+            if (BiGaussianParticleTile_add(&tile, part->ipart,
+                                           x_hat, y_hat, factor)){
+                BeamBeamBiGaussian2D_kick_tile(part0, &tile,
+                        sigma_x_hat, sigma_y_hat, min_sigma_diff,
+                        costheta, sintheta,
+                        post_subtract_px, post_subtract_py);
+            }
+        }
+        else
+        #endif
+        {
+            // Get transverse fields
+            double Ex, Ey; // Ex = -dphi/dx, Ey = -dphi/dy
+            if (use_table){
+                get_Ex_Ey_gauss_table(
+                    BeamBeamBiGaussian2DData_getp1__table_ex(el, 0),
+                    BeamBeamBiGaussian2DData_getp1__table_ey(el, 0),
+                    BeamBeamBiGaussian2DData_get__table_n_u(el),
+                    BeamBeamBiGaussian2DData_get__table_n_v(el),
+                    BeamBeamBiGaussian2DData_get__table_du(el),
+                    BeamBeamBiGaussian2DData_get__table_dv(el),
+                    BeamBeamBiGaussian2DData_get__table_n_multipoles(el),
+                    x_hat, y_hat,
+                    sigma_x_hat, sigma_y_hat,
+                    &Ex, &Ey);
+            }
+            else {
+                get_Ex_Ey_gauss(x_hat, y_hat,
+                    sigma_x_hat, sigma_y_hat,
+                    min_sigma_diff,
+                    &Ex, &Ey);
+            }
+
+            double const dpx_hat = factor * Ex;
+            double const dpy_hat = factor * Ey;
+
+            double const dpx = dpx_hat*costheta - dpy_hat*sintheta;
+            double const dpy = dpx_hat*sintheta + dpy_hat*costheta;
+
+            LocalParticle_add_to_px(part, dpx - post_subtract_px);
+            LocalParticle_add_to_py(part, dpy - post_subtract_py);
+        }
 
     //end_per_particle_block
 
+    #ifdef BIGAUSSIAN_VEC_USE_TILES
+    if (tile.n > 0){
+        BeamBeamBiGaussian2D_kick_tile(part0, &tile,
+                sigma_x_hat, sigma_y_hat, min_sigma_diff,
+                costheta, sintheta,
+                post_subtract_px, post_subtract_py);
+    }
+    #endif
 }
 
 #endif
@@ -5,13 +5,143 @@
 
 #ifndef XFIELDS_BEAMBEAM3D_H
 #define XFIELDS_BEAMBEAM3D_H
-#include <stdio.h>
-#include <gsl/gsl_errno.h>
-#include <gsl/gsl_histogram2d.h>
 #ifndef min
 #define min(a,b) ((a) <= (b) ? (a) : (b))
 #endif
 
+// Particle-blocked tracking of the weak beam (compile with
+// XFIELDS_BB3D_PARTICLE_BLOCK). The particles handled by a thread are boosted
+// into a local tile of XFIELDS_BB3D_PARTICLE_BLOCK_SIZE particles (SoA) and,
+// when the tile is full, the slices are looped over outside the particles of
+// the tile, so that each slice record is loaded once per tile instead of once
+// per particle. The results are identical to the particle-outer loop. Only
+// the CPU contexts use it; the GPU contexts keep one particle per thread.
+#ifdef XFIELDS_BB3D_PARTICLE_BLOCK
+#define XFIELDS_BB3D_USE_PARTICLE_BLOCK //only_for_context cpu_serial cpu_openmp
+#endif
+#ifndef XFIELDS_BB3D_PARTICLE_BLOCK_SIZE
+#define XFIELDS_BB3D_PARTICLE_BLOCK_SIZE 128
+#endif
+
+// Luminosity (flag_luminosity): the contributions of all particles and slices
+// handled by one kernel call (a chunk of particles on CPU, a particle on GPU)
+// are summed locally and flushed once to the LumiTable, instead of one atomic
+// addition per particle and slice. With XFIELDS_BB3D_LUMI_DETERMINISTIC each
+// partial sum is stored in its own slot of the table (see
+// LumiTable.get_luminosity_from_partial_sums) so that the reduction is done in
+// a fixed order.
+
+// Layout of the packed per-slice record of the other beam, kept in sync with
+// _SLICE_RECORD_FIELDS in beambeam3d.py. Each record is padded to 32 doubles
+// (four cache lines) so that a slice is read from one contiguous block.
+#define BB3D_SLICE_RECORD_SIZE 32
+#define BB3D_SLICE_NUM_PARTICLES 0
+#define BB3D_SLICE_X_CENTER_STAR 1
+#define BB3D_SLICE_PX_CENTER_STAR 2
+#define BB3D_SLICE_Y_CENTER_STAR 3
+#define BB3D_SLICE_PY_CENTER_STAR 4
+#define BB3D_SLICE_ZETA_CENTER_STAR 5
+#define BB3D_SLICE_PZETA_CENTER_STAR 6
+#define BB3D_SLICE_SIGMA_11_STAR 7
+#define BB3D_SLICE_SIGMA_12_STAR 8
+#define BB3D_SLICE_SIGMA_13_STAR 9
+#define BB3D_SLICE_SIGMA_14_STAR 10
+#define BB3D_SLICE_SIGMA_22_STAR 11
+#define BB3D_SLICE_SIGMA_23_STAR 12
+#define BB3D_SLICE_SIGMA_24_STAR 13
+#define BB3D_SLICE_SIGMA_33_STAR 14
+#define BB3D_SLICE_SIGMA_34_STAR 15
+#define BB3D_SLICE_SIGMA_44_STAR 16
+#define BB3D_SLICE_ZETA_BIN_WIDTH_STAR_BS 17
+#define BB3D_SLICE_SQRTSIGMA_11_BS 18
+#define BB3D_SLICE_SQRTSIGMA_33_BS 19
+#define BB3D_SLICE_SQRTSIGMA_55_BS 20
+// Coefficients of the polynomials in S of the propagated sigma matrix
+// (see Sigmas_propagate_from_coefficients)
+#define BB3D_SLICE_SIGMA_R0 21
+#define BB3D_SLICE_SIGMA_R1 22
+#define BB3D_SLICE_SIGMA_R2 23
+#define BB3D_SLICE_SIGMA_W0 24
+#define BB3D_SLICE_SIGMA_W1 25
+#define BB3D_SLICE_SIGMA_W2 26
+#define BB3D_SLICE_SIGMA_C0 27
+#define BB3D_SLICE_SIGMA_C1 28
+#define BB3D_SLICE_SIGMA_C2 29
+
+// Rebuilds the packed record of each slice from the per-slice arrays of the
+// element, one slice per thread, so that the record stays on the device when
+// the slice arrays are updated during tracking.
+/*gpukern*/
+void BeamBeam3D_pack_slices_other_beam(BeamBeamBiGaussian3DData el,
+                                       const int64_t n_slices){
+
+    #pragma omp parallel for //only_for_context cpu_openmp
+    for (int64_t i_slice=0; i_slice<n_slices; i_slice++){ //vectorize_over i_slice n_slices
+
+        /*gpuglmem*/ double* slice = BeamBeamBiGaussian3DData_getp1__slices_other_beam_packed(
+                                            el, BB3D_SLICE_RECORD_SIZE*i_slice);
+
+        slice[BB3D_SLICE_NUM_PARTICLES] = BeamBeamBiGaussian3DData_get__slices_other_beam_num_particles(el, i_slice);
+        slice[BB3D_SLICE_X_CENTER_STAR] = BeamBeamBiGaussian3DData_get__slices_other_beam_x_center_star(el, i_slice);
+        slice[BB3D_SLICE_PX_CENTER_STAR] = BeamBeamBiGaussian3DData_get__slices_other_beam_px_center_star(el, i_slice);
+        slice[BB3D_SLICE_Y_CENTER_STAR] = BeamBeamBiGaussian3DData_get__slices_other_beam_y_center_star(el, i_slice);
+        slice[BB3D_SLICE_PY_CENTER_STAR] = BeamBeamBiGaussian3DData_get__slices_other_beam_py_center_star(el, i_slice);
+        slice[BB3D_SLICE_ZETA_CENTER_STAR] = BeamBeamBiGaussian3DData_get__slices_other_beam_zeta_center_star(el, i_slice);
+        slice[BB3D_SLICE_PZETA_CENTER_STAR] = BeamBeamBiGaussian3DData_get__slices_other_beam_pzeta_center_star(el, i_slice);
+
+        double const S11 = BeamBeamBiGaussian3DData_get__slices_other_beam_Sigma_11_star(el, i_slice);
+        double const S12 = BeamBeamBiGaussian3DData_get__slices_other_beam_Sigma_12_star(el, i_slice);
+        double const S13 = BeamBeamBiGaussian3DData_get__slices_other_beam_Sigma_13_star(el, i_slice);
+        double const S14 = BeamBeamBiGaussian3DData_get__slices_other_beam_Sigma_14_star(el, i_slice);
+        double const S22 = BeamBeamBiGaussian3DData_get__slices_other_beam_Sigma_22_star(el, i_slice);
+        double const S23 = BeamBeamBiGaussian3DData_get__slices_other_beam_Sigma_23_star(el, i_slice);
+        double const S24 = BeamBeamBiGaussian3DData_get__slices_other_beam_Sigma_24_star(el, i_slice);
+        double const S33 = BeamBeamBiGaussian3DData_get__slices_other_beam_Sigma_33_star(el, i_slice);
+        double const S34 = BeamBeamBiGaussian3DData_get__slices_other_beam_Sigma_34_star(el, i_slice);
+        double const S44 = BeamBeamBiGaussian3DData_get__slices_other_beam_Sigma_44_star(el, i_slice);
+        slice[BB3D_SLICE_SIGMA_11_STAR] = S11;
+        slice[BB3D_SLICE_SIGMA_12_STAR] = S12;
+        slice[BB3D_SLICE_SIGMA_13_STAR] = S13;
+        slice[BB3D_SLICE_SIGMA_14_STAR] = S14;
+        slice[BB3D_SLICE_SIGMA_22_STAR] = S22;
+        slice[BB3D_SLICE_SIGMA_23_STAR] = S23;
+        slice[BB3D_SLICE_SIGMA_24_STAR] = S24;
+        slice[BB3D_SLICE_SIGMA_33_STAR] = S33;
+        slice[BB3D_SLICE_SIGMA_34_STAR] = S34;
+        slice[BB3D_SLICE_SIGMA_44_STAR] = S44;
+
+        slice[BB3D_SLICE_ZETA_BIN_WIDTH_STAR_BS] = BeamBeamBiGaussian3DData_get__slices_other_beam_zeta_bin_width_star_beamstrahlung(el, i_slice);
+        slice[BB3D_SLICE_SQRTSIGMA_11_BS] = BeamBeamBiGaussian3DData_get__slices_other_beam_sqrtSigma_11_beamstrahlung(el, i_slice);
+        slice[BB3D_SLICE_SQRTSIGMA_33_BS] = BeamBeamBiGaussian3DData_get__slices_other_beam_sqrtSigma_33_beamstrahlung(el, i_slice);
+        slice[BB3D_SLICE_SQRTSIGMA_55_BS] = BeamBeamBiGaussian3DData_get__slices_other_beam_sqrtSigma_55_beamstrahlung(el, i_slice);
+
+        // Slice invariants: coefficients of the polynomials in S giving
+        // Sig_11 - Sig_33, Sig_11 + Sig_33 and Sig_13 at the collision point
+        slice[BB3D_SLICE_SIGMA_R0] = S11 - S33;
+        slice[BB3D_SLICE_SIGMA_R1] = 2.*(S12 - S34);
+        slice[BB3D_SLICE_SIGMA_R2] = S22 - S44;
+        slice[BB3D_SLICE_SIGMA_W0] = S11 + S33;
+        slice[BB3D_SLICE_SIGMA_W1] = 2.*(S12 + S34);
+        slice[BB3D_SLICE_SIGMA_W2] = S22 + S44;
+        slice[BB3D_SLICE_SIGMA_C0] = S13;
+        slice[BB3D_SLICE_SIGMA_C1] = S14 + S23;
+        slice[BB3D_SLICE_SIGMA_C2] = S24;
+    }//end_vectorize
+}
+
+// Record slots reserved by one kernel call for the photons it emits
+// (see record_chunks.h)
+typedef struct {
+    RecordChunk beamstrahlung;
+    RecordChunk bhabha;
+} BeamBeam3DRecordChunks;
+
+/*gpufun*/
+void BeamBeam3DRecordChunks_init(BeamBeam3DRecordChunks* chunks){
+    RecordChunk_init(&chunks->beamstrahlung);
+    RecordChunk_init(&chunks->bhabha);
+}
+
 //void BeamPositionMonitor_track_local_particle(BeamBeamBiGaussian3DRecordData el, LocalParticle* part0){
 //    const int64_t flag_centroids = BeamBeamBiGaussian3DData_get_flag_centroids(el);
 //    if (flag_centroids == 1){
@@ -40,94 +170,88 @@
 
 
 
-/*gpufun*/
-void synchrobeam_kick(
-        BeamBeamBiGaussian3DData el, LocalParticle *part,
-        const int i_slice,
-        double const q0, double const p0c,
-        double* x_star,
-        double* px_star,
-        double* y_star,
-        double* py_star,
-        double* zeta_star,
-        double* pzeta_star){
-
-    // Get data from memory
-    double const scale_strength = BeamBeamBiGaussian3DData_get_scale_strength(el);
-    const double q0_bb  = scale_strength*BeamBeamBiGaussian3DData_get_other_beam_q0(el);
-    const double min_sigma_diff = BeamBeamBiGaussian3DData_get_min_sigma_diff(el);
-    const double threshold_singular = BeamBeamBiGaussian3DData_get_threshold_singular(el);
-    const double intensity1 = BeamBeamBiGaussian3DData_get_beam_intensity(el);
-    const double intensity2 = BeamBeamBiGaussian3DData_get_other_beam_intensity(el);
-    const double npart = BeamBeamBiGaussian3DData_get_number_of_particles(el);
-    const double x_rms = BeamBeamBiGaussian3DData_get_x_rms(el);
-    const double y_rms = BeamBeamBiGaussian3DData_get_y_rms(el);
-
-    double const Sig_11_0 = BeamBeamBiGaussian3DData_get_slices_other_beam_Sigma_11_star(el, i_slice);
-    double const Sig_12_0 = BeamBeamBiGaussian3DData_get_slices_other_beam_Sigma_12_star(el, i_slice);
-    double const Sig_13_0 = BeamBeamBiGaussian3DData_get_slices_other_beam_Sigma_13_star(el, i_slice);
-    double const Sig_14_0 = BeamBeamBiGaussian3DData_get_slices_other_beam_Sigma_14_star(el, i_slice);
-    double const Sig_22_0 = BeamBeamBiGaussian3DData_get_slices_other_beam_Sigma_22_star(el, i_slice);
-    double const Sig_23_0 = BeamBeamBiGaussian3DData_get_slices_other_beam_Sigma_23_star(el, i_slice);
-    double const Sig_24_0 = BeamBeamBiGaussian3DData_get_slices_other_beam_Sigma_24_star(el, i_slice);
-    double const Sig_33_0 = BeamBeamBiGaussian3DData_get_slices_other_beam_Sigma_33_star(el, i_slice);
-    double const Sig_34_0 = BeamBeamBiGaussian3DData_get_slices_other_beam_Sigma_34_star(el, i_slice);
-    double const Sig_44_0 = BeamBeamBiGaussian3DData_get_slices_other_beam_Sigma_44_star(el, i_slice);
-
-    double const num_part_slice = BeamBeamBiGaussian3DData_get_slices_other_beam_num_particles(el, i_slice);
-
-
-
-    // no kick if not sufficient macroparticles; should be taken care of when slicing
-    if (num_part_slice == 0){
-        return;
-    }
-
-    const double x_slice_star = BeamBeamBiGaussian3DData_get_slices_other_beam_x_center_star(el, i_slice);
-    const double y_slice_star = BeamBeamBiGaussian3DData_get_slices_other_beam_y_center_star(el, i_slice);
-    const double px_slice_star = BeamBeamBiGaussian3DData_get_slices_other_beam_px_center_star(el, i_slice);
-    const double py_slice_star = BeamBeamBiGaussian3DData_get_slices_other_beam_py_center_star(el, i_slice);
-    const double zeta_slice_star = BeamBeamBiGaussian3DData_get_slices_other_beam_zeta_center_star(el, i_slice);
-    const double pzeta_slice_star = BeamBeamBiGaussian3DData_get_slices_other_beam_pzeta_center_star(el, i_slice);
+// Data of one slice of the other beam used by the kick, loaded once from the
+// packed record
+typedef struct {
+    double num_particles;
+    double x_center_star;
+    double px_center_star;
+    double y_center_star;
+    double py_center_star;
+    double zeta_center_star;
+    double pzeta_center_star;
+    double R0, R1, R2, W0, W1, W2, C0, C1, C2;
+} BeamBeam3DSlice;
 
-    const double P0 = p0c/C_LIGHT*QELEM;
+/*gpufun*/
+void BeamBeam3DSlice_load(/*gpuglmem*/ const double* slice, BeamBeam3DSlice* sl){
+    sl->num_particles = slice[BB3D_SLICE_NUM_PARTICLES];
+    sl->x_center_star = slice[BB3D_SLICE_X_CENTER_STAR];
+    sl->px_center_star = slice[BB3D_SLICE_PX_CENTER_STAR];
+    sl->y_center_star = slice[BB3D_SLICE_Y_CENTER_STAR];
+    sl->py_center_star = slice[BB3D_SLICE_PY_CENTER_STAR];
+    sl->zeta_center_star = slice[BB3D_SLICE_ZETA_CENTER_STAR];
+    sl->pzeta_center_star = slice[BB3D_SLICE_PZETA_CENTER_STAR];
+    sl->R0 = slice[BB3D_SLICE_SIGMA_R0];
+    sl->R1 = slice[BB3D_SLICE_SIGMA_R1];
+    sl->R2 = slice[BB3D_SLICE_SIGMA_R2];
+    sl->W0 = slice[BB3D_SLICE_SIGMA_W0];
+    sl->W1 = slice[BB3D_SLICE_SIGMA_W1];
+    sl->W2 = slice[BB3D_SLICE_SIGMA_W2];
+    sl->C0 = slice[BB3D_SLICE_SIGMA_C0];
+    sl->C1 = slice[BB3D_SLICE_SIGMA_C1];
+    sl->C2 = slice[BB3D_SLICE_SIGMA_C2];
+}
 
-    //Compute force scaling factor
-    const double Ksl = num_part_slice*QELEM*q0_bb*QELEM*q0/(P0 * C_LIGHT);
+/*gpufun*/
+void synchrobeam_forces(
+        const BeamBeam3DSlice* sl,
+        double const Ksl,
+        double const min_sigma_diff,
+        double const threshold_singular,
+        double const x_star, double const px_star,
+        double const y_star, double const py_star,
+        double const zeta_star,
+        double* S_ptr,
+        double* x_bar_hat_star_ptr,
+        double* y_bar_hat_star_ptr,
+        double* sigma_x_hat_star_ptr,
+        double* sigma_y_hat_star_ptr,
+        double* Fx_star_ptr,
+        double* Fy_star_ptr,
+        double* Fz_star_ptr){
+
+    // Kick of one slice (with Ksl its force scaling factor) on a particle,
+    // in the boosted frame
 
     //Identify the Collision Point (CP)
     #ifdef XFIELDS_BEAMBEAM3D_FORCE_CP0
     const double S = 0.0;
     #else
-    const double S = 0.5*(*zeta_star - zeta_slice_star);
+    const double S = 0.5*(zeta_star - sl->zeta_center_star);
     #endif
-    //fflush(stdout);
 
     // Propagate sigma matrix
     double Sig_11_hat_star, Sig_33_hat_star, costheta, sintheta;
     double dS_Sig_11_hat_star, dS_Sig_33_hat_star, dS_costheta, dS_sintheta;
 
-    // Get strong beam shape at the CP
-    Sigmas_propagate(
-            Sig_11_0,
-            Sig_12_0,
-            Sig_13_0,
-            Sig_14_0,
-            Sig_22_0,
-            Sig_23_0,
-            Sig_24_0,
-            Sig_33_0,
-            Sig_34_0,
-            Sig_44_0,
+    // Get strong beam shape at the CP, from the per-slice polynomial
+    // coefficients tabulated when the slice record is built
+    Sigmas_propagate_from_coefficients(
+            sl->R0, sl->R1, sl->R2,
+            sl->W0, sl->W1, sl->W2,
+            sl->C0, sl->C1, sl->C2,
             S, threshold_singular, 1,
             &Sig_11_hat_star, &Sig_33_hat_star,
             &costheta, &sintheta,
             &dS_Sig_11_hat_star, &dS_Sig_33_hat_star,
             &dS_costheta, &dS_sintheta);
+    const double sigma_x_hat_star = sqrt(Sig_11_hat_star);
+    const double sigma_y_hat_star = sqrt(Sig_33_hat_star);
 
     // Evaluate transverse coordinates of the weak baem w.r.t. the strong beam centroid
-    const double x_bar_star = *x_star + *px_star * S - x_slice_star + px_slice_star * S;
-    const double y_bar_star = *y_star + *py_star * S - y_slice_star + py_slice_star * S;
+    const double x_bar_star = x_star + px_star * S - sl->x_center_star + sl->px_center_star * S;
+    const double y_bar_star = y_star + py_star * S - sl->y_center_star + sl->py_center_star * S;
 
     // Move to the uncoupled reference frame
     const double x_bar_hat_star = x_bar_star*costheta + y_bar_star * sintheta;
@@ -140,14 +264,14 @@ void synchrobeam_kick(
     // Get transverse fields
     double Ex, Ey;
     get_Ex_Ey_gauss(x_bar_hat_star, y_bar_hat_star,
-        sqrt(Sig_11_hat_star), sqrt(Sig_33_hat_star),
+        sigma_x_hat_star, sigma_y_hat_star,
         min_sigma_diff,
         &Ex, &Ey);
 
     //compute Gs
     double Gx, Gy;
     compute_Gx_Gy(x_bar_hat_star, y_bar_hat_star,
-          sqrt(Sig_11_hat_star), sqrt(Sig_33_hat_star),
+          sigma_x_hat_star, sigma_y_hat_star,
                       min_sigma_diff, Ex, Ey, &Gx, &Gy);
 
     // Compute kicks
@@ -157,136 +281,109 @@ void synchrobeam_kick(
     double Gy_hat_star = Ksl*Gy;
 
     // Move kicks to coupled reference frame
-    double Fx_star = Fx_hat_star*costheta - Fy_hat_star*sintheta;
-    double Fy_star = Fx_hat_star*sintheta + Fy_hat_star*costheta;
+    *Fx_star_ptr = Fx_hat_star*costheta - Fy_hat_star*sintheta;
+    *Fy_star_ptr = Fx_hat_star*sintheta + Fy_hat_star*costheta;
 
     // Compute longitudinal kick
-    double Fz_star = 0.5*(Fx_hat_star*dS_x_bar_hat_star  + Fy_hat_star*dS_y_bar_hat_star+
+    *Fz_star_ptr = 0.5*(Fx_hat_star*dS_x_bar_hat_star  + Fy_hat_star*dS_y_bar_hat_star+
                    Gx_hat_star*dS_Sig_11_hat_star + Gy_hat_star*dS_Sig_33_hat_star);
 
-    double rho, wgt;
+    *S_ptr = S;
+    *x_bar_hat_star_ptr = x_bar_hat_star;
+    *y_bar_hat_star_ptr = y_bar_hat_star;
+    *sigma_x_hat_star_ptr = sigma_x_hat_star;
+    *sigma_y_hat_star_ptr = sigma_y_hat_star;
+}
 
-    // Stuff for combi lumi
-    double combilumi;
-    
+/*gpufun*/
+void synchrobeam_apply_kick(
+        const BeamBeam3DSlice* sl,
+        double const S,
+        double const Fx_star, double const Fy_star, double const Fz_star,
+        double* x_star,
+        double* px_star,
+        double* y_star,
+        double* py_star,
+        double* pzeta_star){
+
+    // Apply the kicks (Hirata's synchro-beam)
+    *pzeta_star = *pzeta_star + Fz_star + 0.5*(
+                Fx_star*(*px_star+0.5*Fx_star + sl->px_center_star)+
+                Fy_star*(*py_star+0.5*Fy_star + sl->py_center_star));
+    *x_star = *x_star - S*Fx_star;
+    *px_star = *px_star + Fx_star;
+    *y_star = *y_star - S*Fy_star;
+    *py_star = *py_star + Fy_star;
+}
+
+/*gpufun*/
+void synchrobeam_kick(
+        BeamBeamBiGaussian3DData el, LocalParticle *part,
+        const int i_slice,
+        double const q0, double const p0c,
+        double* x_star,
+        double* px_star,
+        double* y_star,
+        double* py_star,
+        double* zeta_star,
+        double* pzeta_star,
+        double* lumi,
+        BeamBeam3DRecordChunks* chunks){
+
+    // Get data from memory
+    double const scale_strength = BeamBeamBiGaussian3DData_get_scale_strength(el);
+    const double q0_bb  = scale_strength*BeamBeamBiGaussian3DData_get_other_beam_q0(el);
+    const double min_sigma_diff = BeamBeamBiGaussian3DData_get_min_sigma_diff(el);
+    const double threshold_singular = BeamBeamBiGaussian3DData_get_threshold_singular(el);
+
+    // All the data of the slice in one contiguous block
+    /*gpuglmem*/ const double* slice = BeamBeamBiGaussian3DData_getp1__slices_other_beam_packed(
+                                                el, BB3D_SLICE_RECORD_SIZE*i_slice);
+    BeamBeam3DSlice sl;
+    BeamBeam3DSlice_load(slice, &sl);
+
+    double const num_part_slice = sl.num_particles;
+
+    // no kick if not sufficient macroparticles; should be taken care of when slicing
+    if (num_part_slice == 0){
+        return;
+    }
+
+    //Compute force scaling factor
+    //(num_part_slice*QELEM*q0_bb*QELEM*q0/(P0*C_LIGHT) with P0 = p0c/C_LIGHT*QELEM)
+    const double Ksl = num_part_slice*q0_bb*q0*QELEM/p0c;
+
+    double S, x_bar_hat_star, y_bar_hat_star, sigma_x_hat_star, sigma_y_hat_star;
+    double Fx_star, Fy_star, Fz_star;
+    synchrobeam_forces(&sl, Ksl, min_sigma_diff, threshold_singular,
+            *x_star, *px_star, *y_star, *py_star, *zeta_star,
+            &S, &x_bar_hat_star, &y_bar_hat_star,
+            &sigma_x_hat_star, &sigma_y_hat_star,
+            &Fx_star, &Fy_star, &Fz_star);
+    XF_TRACE(el, part, XF_TRACE_BB3D_FIELD, x_bar_hat_star, y_bar_hat_star, S);
+
+    double rho, wgt;
 
     // calculate luminosity
     const int64_t flag_luminosity = BeamBeamBiGaussian3DData_get_flag_luminosity(el);
     if (flag_luminosity == 1){
     
         // gaussian charge density: at x, y density given by the 2D gaussian, local lumi depending on x y, total lumi sum of all
-        get_charge_density(x_bar_hat_star, y_bar_hat_star, sqrt(Sig_11_hat_star), sqrt(Sig_33_hat_star), &rho);
+        get_charge_density(x_bar_hat_star, y_bar_hat_star, sigma_x_hat_star, sigma_y_hat_star, &rho);
         wgt = LocalParticle_get_weight(part) * num_part_slice * rho;  // [m^-2] integrated lumi of a single electron colliding with the opposing slice
-
-        // init record table
-        BeamBeamBiGaussian3DRecordData lumi_record = NULL;
-        LumiTableData lumi_table                   = NULL;
-        RecordIndex lumi_table_index               = NULL;
-        lumi_record = BeamBeamBiGaussian3DData_getp_internal_record(el, part);
-        if (lumi_record){
-            lumi_table       = BeamBeamBiGaussian3DRecordData_getp_lumitable(lumi_record);
-            lumi_table_index =                      LumiTableData_getp__index(lumi_table);
-
-        const int at_turn = LocalParticle_get_at_turn(part);
-        /*gpuglmem*/ double* lumi_address = LumiTableData_getp1_luminosity(lumi_table, at_turn);
-        atomicAdd(lumi_address, wgt);
-        }
+        *lumi += wgt;
     }
 
 
-    /*what is going on
-    /* Allocate memory for luminosity calculations*/
-    //gsl_histogram2d* myHistogram;
-    //gsl_histogram2d* partnerHistogram;
-    //if(parserOutput.computeLuminosity){
-    //    myHistogram = gsl_histogram2d_alloc (parserOutput.lumiGridSizeX,parserOutput.lumiGridSizeY);
-    //    partnerHistogram = gsl_histogram2d_alloc (parserOutput.lumiGridSizeX,parserOutput.lumiGridSizeY);
-    //}
-   
-
-    // Resting histogram data
-    //gsl_histogram2d_set_ranges_uniform (myHistogram, -nsig*bunch->rms[0],nsig*bunch->rms[0],-nsig*bunch->rms[2],nsig*bunch->rms[2]);
-    //Computing histogram (B2 only)
-    //int countOutsideOfDomain = fillHistogram(myHistogram,bunch->particleCoordinates,npart);
-    //if(countOutsideOfDomain>0){
-    //    printf("WARNING B%ib%i IP%i turn %i, %i particles are outside of the luminosity computation domain",bunch->ibeam,bunch->ibunch,act->pos,bunch->turn,countOutsideOfDomain);
-    //   }
-
-    // Resets the histogram data
-    //gsl_histogram2d_set_ranges_uniform (myHistogram, -nsig*bunch->rms[0],nsig*bunch->rms[0],-nsig*bunch->rms[2],nsig*bunch->rms[2]);
-    //Computing histogram (B1 only)
-    //int countOutsideOfDomain = fillHistogram(myHistogram,bunch->particleCoordinates,npart);
-    //if(countOutsideOfDomain>0){
-    //    printf("\nWARNING B%ib%i IP%i turn %i, %i particles are outside of the luminosity computation domain\n",bunch->ibeam,bunch->ibunch,act->pos,bunch->turn,countOutsideOfDomain);
-    //    }
-    // Setting histogram'ranges assuming that both beams are initialised with the same rms and reset the histogram data
-    //    gsl_histogram2d_set_ranges_uniform (partnerHistogram, -nsig*bunch->rms[0],nsig*bunch->rms[0],-nsig*bunch->rms[2],nsig*bunch->rms[2]);
-    // Receive histogram from B2
-    //    gsl_histogram2d_set_ranges_uniform (partnerHistogram, -nsig*bunch->rms[0],nsig*bunch->rms[0],-nsig*bunch->rms[2],nsig*bunch->rms[2]);
-
-
-
-    //if(parserOutput.computeLuminosity){
-    //   gsl_histogram2d_free(myHistogram);
-    //   gsl_histogram2d_free(partnerHistogram);
-    //}
-
-    //}else if(strcmp(id,"luminosity computation")==0) {
-    //    parserOutput->computeLuminosity = true;
-    //    parserOutput->lumiFileFormat = (char*) malloc((strlen(allValues[0])+1)*sizeof(char));
-    //    strcpy(parserOutput->lumiFileFormat,allValues[0]);
-    //    parserOutput->lumiNSigma = atof(allValues[1]);
-    //    parserOutput->lumiGridSizeX = atoi(allValues[2]);
-    //    parserOutput->lumiGridSizeY= atoi(allValues[3]);
-
-    //what is going on
-
-
-    // calculate combi luminosity
-    const int64_t flag_combilumi = BeamBeamBiGaussian3DData_get_flag_combilumi(el);
-    if (flag_combilumi == 1){
-        gsl_histogram2d* myHistogram;
-        gsl_histogram2d* partnerHistogram;
-        double lumiGridSizeX = 256;
-        double lumiGridSizeY = 256;
-        double nsig = 12;
-        myHistogram = gsl_histogram2d_alloc (lumiGridSizeX,lumiGridSizeY);
-        partnerHistogram = gsl_histogram2d_alloc (lumiGridSizeX,lumiGridSizeY);
-        //Resting histogram data
-        gsl_histogram2d_set_ranges_uniform (myHistogram, -nsig*x_rms,nsig*x_rms,-nsig*y_rms,nsig*y_rms);
-        //Computing histogram (B2 only)
-        int countOutsideOfDomain = fillHistogram(myHistogram,particles2,npart);
-        if(countOutsideOfDomain>0){
-        //    printf("WARNING B%ib%i IP%i turn %i, %i particles are outside of the luminosity computation domain",bunch->ibeam,bunch->ibunch,act->pos,bunch->turn,countOutsideOfDomain);
-        }
-         //Setting histogram'ranges assuming that both beams are initialised with the same rms and reset the histogram data
-        gsl_histogram2d_set_ranges_uniform (partnerHistogram, -nsig*x_rms,nsig*y_rms,-nsig*x_rms,nsig*y_rms);
-        gsl_histogram2d_free(myHistogram);
-        gsl_histogram2d_free(partnerHistogram);
-        //gaussian charge density: at x, y density given by the 2D gaussian, local lumi depending on x y, total lumi sum of all
-        fillHistogram(gsl_histogram2d* h1, particles1, npart);
-        fillHistogram(gsl_histogram2d* h2, particles2, npart);
-        double combilumi = lumicalc(h1,h2,intensity1,intensity2);
-         //init record table
-        BeamBeamBiGaussian3DRecordData combilumi_record = NULL;
-        CombiLumiTableData combilumi_table                   = NULL;
-        RecordIndex combilumi_table_index               = NULL;
-        combilumi_record = BeamBeamBiGaussian3DData_getp_internal_record(el, part);
-        if (combilumi_record){
-            combilumi_table       = BeamBeamBiGaussian3DRecordData_getp_combilumitable(combilumi_record);
-            combilumi_table_index =                      CombiLumiTableData_getp__index(combilumi_table);
-
-        const int at_turn = LocalParticle_get_at_turn(part);
-        /*gpuglmem*/ double* combilumi_address = CombiLumiTableData_getp1_combilumi(combilumi_table, at_turn);
-        atomicAdd(combilumi_address, combilumi);
-        }
-    }
-
     // emit bhabha photons from single macropart
     #ifndef XFIELDS_BB3D_NO_BHABHA
     const int64_t flag_bhabha = BeamBeamBiGaussian3DData_get_flag_bhabha(el);
     if (flag_bhabha == 1) {
 
+        const double px_slice_star = sl.px_center_star;
+        const double py_slice_star = sl.py_center_star;
+        const double pzeta_slice_star = sl.pzeta_center_star;
+
         // init record table
         BeamBeamBiGaussian3DRecordData bhabha_record = NULL;
         BhabhaTableData bhabha_table                 = NULL;
@@ -302,7 +399,7 @@ void synchrobeam_kick(
 
         // gaussian charge density, we are centered at the strong slice centroid
         if (flag_luminosity != 1 && flag_beamsize_effect == 0){
-          get_charge_density(x_bar_hat_star, y_bar_hat_star, sqrt(Sig_11_hat_star), sqrt(Sig_33_hat_star), &rho);
+          get_charge_density(x_bar_hat_star, y_bar_hat_star, sigma_x_hat_star, sigma_y_hat_star, &rho);
           wgt =  LocalParticle_get_weight(part) * num_part_slice * rho;  // [m^-2] integrated lumi of a single electron colliding with the opposing slice
         }
 
@@ -333,7 +430,7 @@ void synchrobeam_kick(
               y_photon = y_bar_hat_star + theta * radius;
 
               // resample charge density at randomized photon location
-              get_charge_density(x_photon, y_photon, sqrt(Sig_11_hat_star), sqrt(Sig_33_hat_star), &rho);
+              get_charge_density(x_photon, y_photon, sigma_x_hat_star, sigma_y_hat_star, &rho);
               wgt =  LocalParticle_get_weight(part) * num_part_slice * rho;  // [m^-2] integrated lumi of a single electron colliding with the opposing slice
               break;
           }
@@ -346,6 +443,7 @@ void synchrobeam_kick(
 
             // for each virtual photon get compton scatterings; updates pzeta and energy vars inside
             compt_do(part, bhabha_record, bhabha_table_index, bhabha_table,
+                     &chunks->bhabha,
                      e_photon, compt_x_min, q2,
                      x_photon, y_photon, S, px_photon, py_photon, pzeta_photon,
                      wgt, px_star, py_star, pzeta_star, q0);
@@ -375,38 +473,238 @@ void synchrobeam_kick(
         if(flag_beamstrahlung==1){
 
             // get unboosted strong slice RMS [m]
-            double sqrtSigma_11 = BeamBeamBiGaussian3DData_get_slices_other_beam_sqrtSigma_11_beamstrahlung(el, i_slice);
-            double sqrtSigma_33 = BeamBeamBiGaussian3DData_get_slices_other_beam_sqrtSigma_33_beamstrahlung(el, i_slice);
-            double sqrtSigma_55 = BeamBeamBiGaussian3DData_get_slices_other_beam_sqrtSigma_55_beamstrahlung(el, i_slice);
+            double sqrtSigma_11 = slice[BB3D_SLICE_SQRTSIGMA_11_BS];
+            double sqrtSigma_33 = slice[BB3D_SLICE_SQRTSIGMA_33_BS];
+            double sqrtSigma_55 = slice[BB3D_SLICE_SQRTSIGMA_55_BS];
             beamstrahlung_avg(part, beamstrahlung_record, beamstrahlung_table_index, beamstrahlung_table,
+                &chunks->beamstrahlung,
                 num_part_slice, sqrtSigma_11, sqrtSigma_33, sqrtSigma_55); 
         } else if (flag_beamstrahlung==2){
             double const Fr = hypot(Fx_star, Fy_star) * LocalParticle_get_rpp(part); // radial kick [1]
-            double const dz = .5*BeamBeamBiGaussian3DData_get_slices_other_beam_zeta_bin_width_star_beamstrahlung(el, i_slice);  // half slice width [m]
-            beamstrahlung(part, beamstrahlung_record, beamstrahlung_table_index, beamstrahlung_table, Fr, dz);
+            double const dz = .5*slice[BB3D_SLICE_ZETA_BIN_WIDTH_STAR_BS];  // half slice width [m]
+            beamstrahlung(part, beamstrahlung_record, beamstrahlung_table_index, beamstrahlung_table,
+                &chunks->beamstrahlung, Fr, dz);
         }
         *pzeta_star = LocalParticle_get_pzeta(part);  // BS rescales energy vars, so load again before kick
     }
     #endif
 
-    // Apply the kicks (Hirata's synchro-beam)
-    scanf("%lf", & *x_star);
-    scanf("%lf", & *y_star);
-    scanf("%lf", & *px_star);
-    scanf("%lf.", & *py_star);
-    *pzeta_star = *pzeta_star + Fz_star + 0.5*(
-                Fx_star*(*px_star+0.5*Fx_star + px_slice_star)+
-                Fy_star*(*py_star+0.5*Fy_star + py_slice_star));
-    *x_star = *x_star - S*Fx_star;
-    *px_star = *px_star + Fx_star;
-    *y_star = *y_star - S*Fy_star;
-    *py_star = *py_star + Fy_star;
-    scanf("%lf", &*x_star);
-    scanf("%lf", &*y_star);
-    scanf("%lf", &*px_star);
-    scanf("%lf.", &*py_star);
+    synchrobeam_apply_kick(&sl, S, Fx_star, Fy_star, Fz_star,
+            x_star, px_star, y_star, py_star, pzeta_star);
+
+    XF_TRACE(el, part, XF_TRACE_BB3D_KICK, (double) i_slice, Fx_star, Fy_star);
+}
+
+#ifdef XFIELDS_BB3D_USE_PARTICLE_BLOCK
+// Tile of weak-beam particles in the boosted frame (CPU only)
+typedef struct {
+    int64_t n;
+    int64_t ipart[XFIELDS_BB3D_PARTICLE_BLOCK_SIZE];
+    double x[XFIELDS_BB3D_PARTICLE_BLOCK_SIZE];
+    double px[XFIELDS_BB3D_PARTICLE_BLOCK_SIZE];
+    double y[XFIELDS_BB3D_PARTICLE_BLOCK_SIZE];
+    double py[XFIELDS_BB3D_PARTICLE_BLOCK_SIZE];
+    double zeta[XFIELDS_BB3D_PARTICLE_BLOCK_SIZE];
+    double pzeta[XFIELDS_BB3D_PARTICLE_BLOCK_SIZE];
+    double q0[XFIELDS_BB3D_PARTICLE_BLOCK_SIZE];
+    double p0c[XFIELDS_BB3D_PARTICLE_BLOCK_SIZE];
+    double weight[XFIELDS_BB3D_PARTICLE_BLOCK_SIZE];
+    double lumi[XFIELDS_BB3D_PARTICLE_BLOCK_SIZE];
+} BeamBeam3DParticleBlock;
+
+/*gpufun*/
+void synchrobeam_kick_particle_block(
+        BeamBeamBiGaussian3DData el, LocalParticle* part0,
+        BeamBeam3DParticleBlock* block,
+        BeamBeam3DRecordChunks* chunks){
+
+    // Kicks of all slices on the particles of the tile, slice-outer. The
+    // stochastic processes and the trace need the particle itself, in that
+    // case each particle goes through synchrobeam_kick.
+    const int N_slices = BeamBeamBiGaussian3DData_get_num_slices_other_beam(el);
+    int64_t kick_particles = 0;
+    #ifdef XFIELDS_TRACE
+    kick_particles = 1;
+    #endif
+    #ifndef XFIELDS_BB3D_NO_BHABHA
+    kick_particles |= (BeamBeamBiGaussian3DData_get_flag_bhabha(el) != 0);
+    #endif
+    #ifndef XFIELDS_BB3D_NO_BEAMSTR
+    kick_particles |= (BeamBeamBiGaussian3DData_get_flag_beamstrahlung(el) != 0);
+    #endif
+
+    if (kick_particles){
+        LocalParticle lpart = *part0;
+        for (int i_slice=0; i_slice<N_slices; i_slice++){
+            for (int64_t ii=0; ii<block->n; ii++){
+                lpart.ipart = block->ipart[ii];
+                synchrobeam_kick(
+                             el, &lpart,
+                             i_slice, block->q0[ii], block->p0c[ii],
+                             &block->x[ii],
+                             &block->px[ii],
+                             &block->y[ii],
+                             &block->py[ii],
+                             &block->zeta[ii],
+                             &block->pzeta[ii],
+                             &block->lumi[ii],
+                             chunks);
+            }
+        }
+        return;
+    }
+
+    double const scale_strength = BeamBeamBiGaussian3DData_get_scale_strength(el);
+    const double q0_bb  = scale_strength*BeamBeamBiGaussian3DData_get_other_beam_q0(el);
+    const double min_sigma_diff = BeamBeamBiGaussian3DData_get_min_sigma_diff(el);
+    const double threshold_singular = BeamBeamBiGaussian3DData_get_threshold_singular(el);
+    const int64_t flag_luminosity = BeamBeamBiGaussian3DData_get_flag_luminosity(el);
+
+    for (int i_slice=0; i_slice<N_slices; i_slice++){
+
+        BeamBeam3DSlice sl;
+        BeamBeam3DSlice_load(
+            BeamBeamBiGaussian3DData_getp1__slices_other_beam_packed(
+                                    el, BB3D_SLICE_RECORD_SIZE*i_slice), &sl);
+        double const num_part_slice = sl.num_particles;
+        if (num_part_slice == 0){
+            continue;
+        }
+
+        for (int64_t ii=0; ii<block->n; ii++){
+            const double Ksl = num_part_slice*q0_bb*block->q0[ii]*QELEM/block->p0c[ii];
+
+            double S, x_bar_hat_star, y_bar_hat_star, sigma_x_hat_star, sigma_y_hat_star;
+            double Fx_star, Fy_star, Fz_star;
+            synchrobeam_forces(&sl, Ksl, min_sigma_diff, threshold_singular,
+                    block->x[ii], block->px[ii], block->y[ii], block->py[ii],
+                    block->zeta[ii],
+                    &S, &x_bar_hat_star, &y_bar_hat_star,
+                    &sigma_x_hat_star, &sigma_y_hat_star,
+                    &Fx_star, &Fy_star, &Fz_star);
+
+            if (flag_luminosity == 1){
+                double rho;
+                get_charge_density(x_bar_hat_star, y_bar_hat_star, sigma_x_hat_star, sigma_y_hat_star, &rho);
+                block->lumi[ii] += block->weight[ii] * num_part_slice * rho;
+            }
+
+            synchrobeam_apply_kick(&sl, S, Fx_star, Fy_star, Fz_star,
+                    &block->x[ii], &block->px[ii], &block->y[ii],
+                    &block->py[ii], &block->pzeta[ii]);
+        }
+    }
+}
+#endif
+
+/*gpufun*/
+void BeamBeam3D_flush_luminosity(BeamBeamBiGaussian3DData el,
+        LocalParticle* part, const double lumi,
+        const int64_t at_turn, const int64_t particle_id){
+
+    // Adds the partial sum lumi of the particles of turn at_turn handled by
+    // the calling thread to the LumiTable (particle_id is the one of the
+    // first of these particles)
+    if (lumi == 0.) return;
+
+    BeamBeamBiGaussian3DRecordData lumi_record = BeamBeamBiGaussian3DData_getp_internal_record(el, part);
+    if (!lumi_record) return;
+    LumiTableData lumi_table = BeamBeamBiGaussian3DRecordData_getp_lumitable(lumi_record);
+
+    #ifdef XFIELDS_BB3D_LUMI_DETERMINISTIC
+    RecordIndex lumi_table_index = LumiTableData_getp__index(lumi_table);
+    // The returned slot id is negative if record is full
+    const int64_t i_slot = RecordIndex_get_slot(lumi_table_index);
+    if (i_slot >= 0){
+        LumiTableData_set_at_turn(lumi_table, i_slot, at_turn);
+        LumiTableData_set_at_element(lumi_table, i_slot, LocalParticle_get_at_element(part));
+        LumiTableData_set_particle_id(lumi_table, i_slot, particle_id);
+        LumiTableData_set_partial_luminosity(lumi_table, i_slot, lumi);
+    }
+    #else
+    if (at_turn >= 0 && at_turn < LumiTableData_len_luminosity(lumi_table)){
+        atomicAdd(LumiTableData_getp1_luminosity(lumi_table, at_turn), lumi);
+    }
+    #endif
+}
+
+#ifdef XFIELDS_BB3D_USE_PARTICLE_BLOCK
+/*gpufun*/
+void BeamBeam3D_track_particle_block(BeamBeamBiGaussian3DData el,
+        LocalParticle* part0, BeamBeam3DParticleBlock* block,
+        BeamBeam3DRecordChunks* chunks,
+        double* lumi_sum, int64_t* lumi_turn, int64_t* lumi_particle_id){
+
+    // Kicks the particles of the tile (already in the boosted frame), moves
+    // them back to the original reference frame and stores them
+
+    // Get data from memory
+    double const sin_phi = BeamBeamBiGaussian3DData_get__sin_phi(el);
+    double const cos_phi = BeamBeamBiGaussian3DData_get__cos_phi(el);
+    double const tan_phi = BeamBeamBiGaussian3DData_get__tan_phi(el);
+    double const sin_alpha = BeamBeamBiGaussian3DData_get__sin_alpha(el);
+    double const cos_alpha = BeamBeamBiGaussian3DData_get__cos_alpha(el);
+
+    const double shift_x = BeamBeamBiGaussian3DData_get_ref_shift_x(el)
+                           + BeamBeamBiGaussian3DData_get_other_beam_shift_x(el);
+    const double shift_px = BeamBeamBiGaussian3DData_get_ref_shift_px(el)
+                            + BeamBeamBiGaussian3DData_get_other_beam_shift_px(el);
+    const double shift_y = BeamBeamBiGaussian3DData_get_ref_shift_y(el)
+                            + BeamBeamBiGaussian3DData_get_other_beam_shift_y(el);
+    const double shift_py = BeamBeamBiGaussian3DData_get_ref_shift_py(el)
+                            + BeamBeamBiGaussian3DData_get_other_beam_shift_py(el);
+    const double shift_zeta = BeamBeamBiGaussian3DData_get_ref_shift_zeta(el)
+                            + BeamBeamBiGaussian3DData_get_other_beam_shift_zeta(el);
+    const double shift_pzeta = BeamBeamBiGaussian3DData_get_ref_shift_pzeta(el)
+                            + BeamBeamBiGaussian3DData_get_other_beam_shift_pzeta(el);
+
+    double const scale_strength = BeamBeamBiGaussian3DData_get_scale_strength(el);
+    const double post_subtract_x = scale_strength*BeamBeamBiGaussian3DData_get_post_subtract_x(el);
+    const double post_subtract_px = scale_strength*BeamBeamBiGaussian3DData_get_post_subtract_px(el);
+    const double post_subtract_y = scale_strength*BeamBeamBiGaussian3DData_get_post_subtract_y(el);
+    const double post_subtract_py = scale_strength*BeamBeamBiGaussian3DData_get_post_subtract_py(el);
+    const double post_subtract_zeta = scale_strength*BeamBeamBiGaussian3DData_get_post_subtract_zeta(el);
+    const double post_subtract_pzeta = scale_strength*BeamBeamBiGaussian3DData_get_post_subtract_pzeta(el);
+
+    // Synchro beam, one slice at a time over the whole tile
+    synchrobeam_kick_particle_block(el, part0, block, chunks);
 
+    LocalParticle lpart = *part0;
+    LocalParticle* part = &lpart;
+    for (int64_t ii=0; ii<block->n; ii++){
+        part->ipart = block->ipart[ii];
+
+        // Go back to original reference frame and remove dipolar effect
+        change_back_ref_frame_and_subtract_dipolar_coordinates(
+            &block->x[ii], &block->px[ii], &block->y[ii], &block->py[ii],
+            &block->zeta[ii], &block->pzeta[ii],
+            shift_x, shift_px, shift_y, shift_py, shift_zeta, shift_pzeta,
+            post_subtract_x, post_subtract_px,
+            post_subtract_y, post_subtract_py,
+            post_subtract_zeta, post_subtract_pzeta,
+            sin_phi, cos_phi, tan_phi, sin_alpha, cos_alpha);
+
+        // Store
+        LocalParticle_set_x(part, block->x[ii]);
+        LocalParticle_set_px(part, block->px[ii]);
+        LocalParticle_set_y(part, block->y[ii]);
+        LocalParticle_set_py(part, block->py[ii]);
+        LocalParticle_set_zeta(part, block->zeta[ii]);
+        LocalParticle_update_pzeta(part, block->pzeta[ii]);
+
+        // Luminosity, in the order of the particles as in the default loop
+        const int64_t at_turn = LocalParticle_get_at_turn(part);
+        if (at_turn != *lumi_turn){
+            BeamBeam3D_flush_luminosity(el, part, *lumi_sum, *lumi_turn, *lumi_particle_id);
+            *lumi_sum = 0.;
+            *lumi_turn = at_turn;
+            *lumi_particle_id = LocalParticle_get_particle_id(part);
+        }
+        *lumi_sum += block->lumi[ii];
+    }
+    block->n = 0;
 }
+#endif
 
 /*gpufun*/
 void BeamBeamBiGaussian3D_track_local_particle(BeamBeamBiGaussian3DData el, LocalParticle* part0){
@@ -441,6 +739,18 @@ void BeamBeamBiGaussian3D_track_local_particle(BeamBeamBiGaussian3DData el, Loca
     const double post_subtract_zeta = scale_strength*BeamBeamBiGaussian3DData_get_post_subtract_zeta(el);
     const double post_subtract_pzeta = scale_strength*BeamBeamBiGaussian3DData_get_post_subtract_pzeta(el);
 
+    double lumi_sum = 0.;
+    int64_t lumi_turn = -1;
+    int64_t lumi_particle_id = -1;
+
+    BeamBeam3DRecordChunks chunks;
+    BeamBeam3DRecordChunks_init(&chunks);
+
+    #ifdef XFIELDS_BB3D_USE_PARTICLE_BLOCK
+    BeamBeam3DParticleBlock block;
+    block.n = 0;
+    #endif
+
     //start_per_particle_block (part0->part)
         double x = LocalParticle_get_x(part);
         double px = LocalParticle_get_px(part);
@@ -458,6 +768,28 @@ void BeamBeamBiGaussian3D_track_local_particle(BeamBeamBiGaussian3DData el, Loca
             shift_x, shift_px, shift_y, shift_py, shift_zeta, shift_pzeta,
             sin_phi, cos_phi, tan_phi, sin_alpha, cos_alpha);
 
+        #ifdef XFIELDS_BB3D_USE_PARTICLE_BLOCK
+        // Add the particle to the tile, which is tracked when full
+        const int64_t ib = block.n;
+        block.ipart[ib] = part->ipart;
+        block.x[ib] = x;
+        block.px[ib] = px;
+        block.y[ib] = y;
+        block.py[ib] = py;
+        block.zeta[ib] = zeta;
+        block.pzeta[ib] = pzeta;
+        block.q0[ib] = q0;
+        block.p0c[ib] = p0c;
+        block.weight[ib] = LocalParticle_get_weight(part);
+        block.lumi[ib] = 0.;
+        block.n = ib + 1;
+        if (block.n == XFIELDS_BB3D_PARTICLE_BLOCK_SIZE){
+            BeamBeam3D_track_particle_block(el, part0, &block, &chunks,
+                    &lumi_sum, &lumi_turn, &lumi_particle_id);
+        }
+        #else
+        double lumi = 0.;
+
         // Synchro beam
         for (int i_slice=0; i_slice<N_slices; i_slice++)
         {
@@ -469,7 +801,9 @@ void BeamBeamBiGaussian3D_track_local_particle(BeamBeamBiGaussian3DData el, Loca
                              &y,
                              &py,
                              &zeta,
-                             &pzeta);
+                             &pzeta,
+                             &lumi,
+                             &chunks);
         }
 
         // Go back to original reference frame and remove dipolar effect
@@ -489,7 +823,25 @@ void BeamBeamBiGaussian3D_track_local_particle(BeamBeamBiGaussian3DData el, Loca
         LocalParticle_set_zeta(part, zeta);
         LocalParticle_update_pzeta(part, pzeta);
 
+        const int64_t at_turn = LocalParticle_get_at_turn(part);
+        if (at_turn != lumi_turn){
+            BeamBeam3D_flush_luminosity(el, part, lumi_sum, lumi_turn, lumi_particle_id);
+            lumi_sum = 0.;
+            lumi_turn = at_turn;
+            lumi_particle_id = LocalParticle_get_particle_id(part);
+        }
+        lumi_sum += lumi;
+        #endif
+
     //end_per_particle_block
+
+    #ifdef XFIELDS_BB3D_USE_PARTICLE_BLOCK
+    if (block.n > 0){
+        BeamBeam3D_track_particle_block(el, part0, &block, &chunks,
+                &lumi_sum, &lumi_turn, &lumi_particle_id);
+    }
+    #endif
+    BeamBeam3D_flush_luminosity(el, part0, lumi_sum, lumi_turn, lumi_particle_id);
 }
 
 
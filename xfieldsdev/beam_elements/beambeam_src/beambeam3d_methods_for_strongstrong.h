@@ -5,7 +5,6 @@
 
 #ifndef XFIELDS_BEAMBEAM3D_METHODS_FOR_STRONGSTRONG_H
 #define XFIELDS_BEAMBEAM3D_METHODS_FOR_STRONGSTRONG_H
-#include <stdio.h>
 
 
 /*gpufun*/
@@ -128,6 +127,15 @@ void BeamBeam3D_selective_apply_synchrobeam_kick_local_particle(BeamBeamBiGaussi
                 LocalParticle* part0,
                 /*gpuglmem*/ int64_t* i_slice_for_particles){
 
+    // partial sum of the luminosity (see BeamBeam3D_flush_luminosity)
+    double lumi_sum = 0.;
+    int64_t lumi_turn = -1;
+    int64_t lumi_particle_id = -1;
+
+    // record slots of the emitted photons (see record_chunks.h)
+    BeamBeam3DRecordChunks chunks;
+    BeamBeam3DRecordChunks_init(&chunks);
+
     //start_per_particle_block (part0->part)
 
         const int64_t i_slice = i_slice_for_particles[part->ipart];
@@ -144,6 +152,15 @@ void BeamBeam3D_selective_apply_synchrobeam_kick_local_particle(BeamBeamBiGaussi
 
             const double q0 = LocalParticle_get_q0(part);
             const double p0c = LocalParticle_get_p0c(part); // eV
+
+            const int64_t at_turn = LocalParticle_get_at_turn(part);
+            if (at_turn != lumi_turn){
+                BeamBeam3D_flush_luminosity(el, part, lumi_sum, lumi_turn, lumi_particle_id);
+                lumi_sum = 0.;
+                lumi_turn = at_turn;
+                lumi_particle_id = LocalParticle_get_particle_id(part);
+            }
+
             synchrobeam_kick(
                 el, part,
                 i_slice, q0, p0c,
@@ -152,7 +169,9 @@ void BeamBeam3D_selective_apply_synchrobeam_kick_local_particle(BeamBeamBiGaussi
                 &y_star,
                 &py_star,
                 &zeta_star,
-                &pzeta_star);
+                &pzeta_star,
+                &lumi_sum,
+                &chunks);
 
             LocalParticle_set_x(part, x_star);
             LocalParticle_set_px(part, px_star);
@@ -165,53 +184,91 @@ void BeamBeam3D_selective_apply_synchrobeam_kick_local_particle(BeamBeamBiGaussi
 
     //end_per_particle_block
 
+    BeamBeam3D_flush_luminosity(el, part0, lumi_sum, lumi_turn, lumi_particle_id);
+
 }
 
+/*gpufun*/
+void BeamBeam3D_selective_fill_lumigrid(BeamBeamBiGaussian3DData el,
+                LocalParticle* part0,
+                int64_t i_slice_min,
+                int64_t i_slice_max,
+                /*gpuglmem*/ int64_t* i_slice_for_particles){
+
+    // Adds the weight of the particles of slices i_slice_min..i_slice_max
+    // to the histograms of their slice (reset beforehand)
+    const int64_t n_cells = BeamBeamBiGaussian3DData_get_lumigrid_n_cells(el);
+    const double half_width_x = BeamBeamBiGaussian3DData_get_lumigrid_half_width_x(el);
+    const double half_width_y = BeamBeamBiGaussian3DData_get_lumigrid_half_width_y(el);
+    /*gpuglmem*/ double* lumigrid = BeamBeamBiGaussian3DData_getp1__lumigrid_my_beam(el, 0);
+
+    //start_per_particle_block (part0->part)
+
+        const int64_t i_slice = i_slice_for_particles[part->ipart];
+
+        if (i_slice >= i_slice_min && i_slice <= i_slice_max){
+
+            const int64_t icell = lumigrid_cell_index(
+                    LocalParticle_get_x(part), LocalParticle_get_y(part),
+                    n_cells, half_width_x, half_width_y);
+
+            // particles outside of the grid are not counted
+            if (icell >= 0){
+                atomicAdd(&lumigrid[i_slice*n_cells*n_cells + icell],
+                          LocalParticle_get_weight(part));
+            }
+        }
+
+    //end_per_particle_block
+
+}
+
+
 /*gpufun*/
 void BeamBeam3D_selective_compute_lumi_integral(BeamBeamBiGaussian3DData el,
                 LocalParticle* part0,
-                /*gpuglmem*/ int64_t timestep,
-                /*gpuelmem*/ double* lumigrid_my_beam,
-                /*gpuglmem*/ double* lumigrid_other_beam,
-                /*gpuglmem*/ int64_t n_lumigrid_cells){
-    double const intensity1 = BeamBeamBiGaussian3DData_get_beam_intensity(el);
-    double const intensity2 = BeamBeamBiGaussian3DData_get_other_beam_intensity(el);
-
-  FILE *fp;
-  fp = fopen("../test_lumigrid.txt", "a");
-  const int64_t N_slices = BeamBeamBiGaussian3DData_get_num_slices_other_beam(el);
-
-   //loop over all lumigrids of my beam
-  for (int i_slice=0; i_slice<N_slices; i_slice++){
-
-    // get which other beam slice my slice should interact with
-    int64_t i_slice_other_beam = timestep - i_slice;
-
-    // interact only if my slice is overlapping with other beam slice
-    if (i_slice_other_beam >= 0 && i_slice_other_beam < N_slices){
-
-      // get inex range of my beam
-      int64_t lumigrid_my_beam_slice_start_idx    = n_lumigrid_cells*n_lumigrid_cells * i_slice;
-      int64_t lumigrid_my_beam_slice_end_idx      = n_lumigrid_cells*n_lumigrid_cells * (i_slice+1);
-      int64_t lumigrid_other_beam_slice_start_idx = n_lumigrid_cells*n_lumigrid_cells * i_slice_other_beam;
-      int64_t lumigrid_other_beam_slice_end_idx   = n_lumigrid_cells*n_lumigrid_cells * (i_slice_other_beam+1);
-
-      fprintf(fp, "timestep: %lld - ", timestep);
-      for (int j=lumigrid_my_beam_slice_start_idx; j<lumigrid_my_beam_slice_end_idx; j++){
-        fprintf(fp, "%g ", lumigrid_my_beam[j]);
-      }
-      fprintf(fp, "- ");
-      for (int j=lumigrid_other_beam_slice_start_idx; j<lumigrid_other_beam_slice_end_idx; j++){
-        fprintf(fp, "%g ", lumigrid_other_beam[j]);
-      }
-      fprintf(fp, "\n");
-      lumicalc(el, lumigrid_my_beam, lumigrid_other_beam, intensity1, intensity2);
-
-      // need to add to total lumi
-
-    } // end if
-  }  //end for
-  fclose(fp);
+                int64_t timestep,
+                int64_t i_slice_min,
+                int64_t n_rows,
+                /*gpuglmem*/ double* row_sums){
+
+    // Sums the rows of the overlap integrals of the slices colliding at this
+    // step (see lumigrid_overlap_rows) and adds them to the record
+    const int64_t n_cells = BeamBeamBiGaussian3DData_get_lumigrid_n_cells(el);
+    const double dx = 2.*BeamBeamBiGaussian3DData_get_lumigrid_half_width_x(el) / n_cells;
+    const double dy = 2.*BeamBeamBiGaussian3DData_get_lumigrid_half_width_y(el) / n_cells;
+
+    //start_per_particle_block (part0->part)
+
+    // the reduction is done once per step
+    if (part->ipart == 0){
+
+        double combilumi = 0.;
+
+        for (int64_t irow=0; irow<n_rows; irow+=n_cells){
+            const int64_t i_slice = i_slice_min + irow / n_cells;
+            XF_TRACE(el, part, XF_TRACE_LUMI_OVERLAP,
+                     (double) timestep, (double) i_slice, (double) (timestep - i_slice));
+            double integral = 0.;
+            for (int64_t iy=0; iy<n_cells; iy++){
+                integral += row_sums[irow + iy];
+            }
+            combilumi += integral / (dx*dy);
+        }
+
+        BeamBeamBiGaussian3DRecordData combilumi_record = BeamBeamBiGaussian3DData_getp_internal_record(el, part);
+        if (combilumi_record){
+            CombiLumiTableData combilumi_table = BeamBeamBiGaussian3DRecordData_getp_combilumitable(combilumi_record);
+            const int64_t at_turn = LocalParticle_get_at_turn(part);
+            if (at_turn < CombiLumiTableData_len_combilumi(combilumi_table)){
+                /*gpuglmem*/ double* combilumi_address = CombiLumiTableData_getp1_combilumi(combilumi_table, at_turn);
+                *combilumi_address += combilumi;
+            }
+        }
+    }
+
+    //end_per_particle_block
+
 }
 
 #endif
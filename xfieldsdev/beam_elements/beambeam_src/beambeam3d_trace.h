@@ -0,0 +1,74 @@
+// copyright ################################# //
+// This file is part of the Xfields Package.   //
+// Copyright (c) CERN, 2026.                   //
+// ########################################### //
+
+#ifndef XFIELDS_BEAMBEAM3D_TRACE_H
+#define XFIELDS_BEAMBEAM3D_TRACE_H
+
+// Debug trace of the 6D beam-beam element. Compiled out unless XFIELDS_TRACE
+// is defined (e.g. line.config.XFIELDS_TRACE = True). Events are written into
+// the tracetable of the internal record (see TraceTable in beambeam3d.py),
+// which is split into lanes of XFIELDS_TRACE_DEPTH events. Particle ipart
+// writes into lane ipart % n_lanes as a ring buffer, so only the last
+// XFIELDS_TRACE_DEPTH events of each lane are kept and the trace never
+// blocks nor grows. The event counter of a lane is incremented atomically,
+// so that threads sharing a lane get distinct slots. With at least
+// n_particles*XFIELDS_TRACE_DEPTH slots each particle has its own lane.
+
+// Event codes, kept in sync with TRACE_EVENTS in beambeam3d.py
+#define XF_TRACE_BB3D_FIELD 1            // x_bar_hat_star, y_bar_hat_star, S
+#define XF_TRACE_BB3D_KICK 2             // i_slice, Fx_star, Fy_star
+#define XF_TRACE_BS_NEGATIVE_PHOTON 3    // e_photon [eV], energy [eV], photon id
+#define XF_TRACE_BS_TOO_MANY_PHOTONS 4   // photon id, Fr, dz
+#define XF_TRACE_BHABHA_ZERO_LOSS 5      // e_loss_primary [GeV], -, -
+#define XF_TRACE_LUMI_OVERLAP 6          // timestep, i_slice, i_slice_other_beam
+
+#ifndef XFIELDS_TRACE_DEPTH
+#define XFIELDS_TRACE_DEPTH 16
+#endif
+
+#ifdef XFIELDS_TRACE
+
+/*gpufun*/
+void XFieldsTrace_push(BeamBeamBiGaussian3DRecordData record,
+                       LocalParticle* part, const int64_t event,
+                       const double value_0, const double value_1,
+                       const double value_2){
+
+    if (!record) return; // internal logging not active
+
+    TraceTableData table = BeamBeamBiGaussian3DRecordData_getp_tracetable(record);
+    const int64_t capacity = TraceTableData_len_event(table);
+    const int64_t n_lanes = capacity / XFIELDS_TRACE_DEPTH;
+    if (n_lanes == 0) return;
+
+    const int64_t lane = part->ipart % n_lanes;
+    // Reserve the slot (atomicAdd returns the previous count)
+    const int64_t n_events = atomicAdd(
+            TraceTableData_getp1_n_events(table, lane), (int64_t) 1);
+    const int64_t i_slot = lane*XFIELDS_TRACE_DEPTH + n_events % XFIELDS_TRACE_DEPTH;
+
+    TraceTableData_set_event(      table, i_slot, event);
+    TraceTableData_set_particle_id(table, i_slot, LocalParticle_get_particle_id(part));
+    TraceTableData_set_at_turn(    table, i_slot, LocalParticle_get_at_turn(part));
+    TraceTableData_set_at_element( table, i_slot, LocalParticle_get_at_element(part));
+    TraceTableData_set_value_0(    table, i_slot, value_0);
+    TraceTableData_set_value_1(    table, i_slot, value_1);
+    TraceTableData_set_value_2(    table, i_slot, value_2);
+}
+
+#define XF_TRACE_RECORD(record, part, event, v0, v1, v2) \
+    XFieldsTrace_push((record), (part), (event), (v0), (v1), (v2))
+#define XF_TRACE(el, part, event, v0, v1, v2) \
+    XFieldsTrace_push(BeamBeamBiGaussian3DData_getp_internal_record((el), (part)), \
+                      (part), (event), (v0), (v1), (v2))
+
+#else
+
+#define XF_TRACE_RECORD(record, part, event, v0, v1, v2)
+#define XF_TRACE(el, part, event, v0, v1, v2)
+
+#endif // XFIELDS_TRACE
+
+#endif // XFIELDS_BEAMBEAM3D_TRACE_H
@@ -11,17 +11,10 @@
 #endif
 
 /*gpufun*/
-void Sigmas_propagate(
-        double const Sig_11_0,
-        double const Sig_12_0,
-        double const Sig_13_0,
-        double const Sig_14_0,
-        double const Sig_22_0,
-        double const Sig_23_0,
-        double const Sig_24_0,
-        double const Sig_33_0,
-        double const Sig_34_0,
-        double const Sig_44_0,
+void Sigmas_propagate_from_coefficients(
+        double const R0, double const R1, double const R2,
+        double const W0, double const W1, double const W2,
+        double const C0, double const C1, double const C2,
         double const S,
         double const threshold_singular,
         int64_t const handle_singularities,
@@ -34,28 +27,21 @@ void Sigmas_propagate(
         double* dS_costheta_ptr,
         double* dS_sintheta_ptr)
 {
-
-    // Propagate sigma matrix
-    double const Sig_11 = Sig_11_0 + 2.*Sig_12_0*S+Sig_22_0*S*S;
-    double const Sig_33 = Sig_33_0 + 2.*Sig_34_0*S+Sig_44_0*S*S;
-    double const Sig_13 = Sig_13_0 + (Sig_14_0+Sig_23_0)*S+Sig_24_0*S*S;
-
-    double const Sig_12 = Sig_12_0 + Sig_22_0*S;
-    double const Sig_14 = Sig_14_0 + Sig_24_0*S;
-    double const Sig_22 = Sig_22_0 + 0.*S;
-    double const Sig_23 = Sig_23_0 + Sig_24_0*S;
-    double const Sig_24 = Sig_24_0 + 0.*S;
-    double const Sig_34 = Sig_34_0 + Sig_44_0*S;
-    double const Sig_44 = Sig_44_0 + 0.*S;
-
-    double const R = Sig_11-Sig_33;
-    double const W = Sig_11+Sig_33;
+    // Same as Sigmas_propagate, with the sigma matrix at S=0 given through
+    // the coefficients of the polynomials in S (depending only on the slice):
+    // Sig_11 - Sig_33 = R0 + R1*S + R2*S^2
+    // Sig_11 + Sig_33 = W0 + W1*S + W2*S^2
+    // Sig_13          = C0 + C1*S + C2*S^2
+
+    double const R = R0 + (R1 + R2*S)*S;
+    double const W = W0 + (W1 + W2*S)*S;
+    double const Sig_13 = C0 + (C1 + C2*S)*S;
     double const T = R*R+4*Sig_13*Sig_13;
 
     //evaluate derivatives
-    double const dS_R = 2.*(Sig_12_0-Sig_34_0)+2*S*(Sig_22_0-Sig_44_0);
-    double const dS_W = 2.*(Sig_12_0+Sig_34_0)+2*S*(Sig_22_0+Sig_44_0);
-    double const dS_Sig_13 = Sig_14_0 + Sig_23_0 + 2*Sig_24_0*S;
+    double const dS_R = R1 + 2.*R2*S;
+    double const dS_W = W1 + 2.*W2*S;
+    double const dS_Sig_13 = C1 + 2.*C2*S;
     double const dS_T = 2*R*dS_R+8.*Sig_13*dS_Sig_13;
 
     double Sig_11_hat, Sig_33_hat, costheta, sintheta, dS_Sig_11_hat,
@@ -65,10 +51,10 @@ void Sigmas_propagate(
 
 
     if (T<threshold_singular && handle_singularities){
-        double const a = Sig_12-Sig_34;
-        double const b = Sig_22-Sig_44;
-        double const c = Sig_14+Sig_23;
-        double const d = Sig_24;
+        double const a = 0.5*R1 + R2*S;   // Sig_12-Sig_34
+        double const b = R2;              // Sig_22-Sig_44
+        double const c = dS_Sig_13;       // Sig_14+Sig_23
+        double const d = C2;              // Sig_24
 
         double sqrt_a2_c2 = sqrt(a*a+c*c);
 
@@ -134,7 +120,7 @@ void Sigmas_propagate(
 
         if (fabs(sintheta)<threshold_singular && handle_singularities){
         //equivalent to to np.abs(Sig_13)<threshold_singular
-            dS_sintheta = (Sig_14+Sig_23)/R;
+            dS_sintheta = dS_Sig_13/R;
         }
         else{
             dS_sintheta = -1./(4.*sintheta)*dS_cos2theta;
@@ -155,4 +141,37 @@ void Sigmas_propagate(
 
 }
 
+/*gpufun*/
+void Sigmas_propagate(
+        double const Sig_11_0,
+        double const Sig_12_0,
+        double const Sig_13_0,
+        double const Sig_14_0,
+        double const Sig_22_0,
+        double const Sig_23_0,
+        double const Sig_24_0,
+        double const Sig_33_0,
+        double const Sig_34_0,
+        double const Sig_44_0,
+        double const S,
+        double const threshold_singular,
+        int64_t const handle_singularities,
+        double* Sig_11_hat_ptr,
+        double* Sig_33_hat_ptr,
+        double* costheta_ptr,
+        double* sintheta_ptr,
+        double* dS_Sig_11_hat_ptr,
+        double* dS_Sig_33_hat_ptr,
+        double* dS_costheta_ptr,
+        double* dS_sintheta_ptr)
+{
+    Sigmas_propagate_from_coefficients(
+            Sig_11_0 - Sig_33_0, 2.*(Sig_12_0 - Sig_34_0), Sig_22_0 - Sig_44_0,
+            Sig_11_0 + Sig_33_0, 2.*(Sig_12_0 + Sig_34_0), Sig_22_0 + Sig_44_0,
+            Sig_13_0, Sig_14_0 + Sig_23_0, Sig_24_0,
+            S, threshold_singular, handle_singularities,
+            Sig_11_hat_ptr, Sig_33_hat_ptr, costheta_ptr, sintheta_ptr,
+            dS_Sig_11_hat_ptr, dS_Sig_33_hat_ptr, dS_costheta_ptr, dS_sintheta_ptr);
+}
+
 #endif
@@ -44,6 +44,7 @@ class ElectronLensInterpolated(xt.BeamElement):
                  x_grid=None, y_grid=None,
                  rho=None,
                  current=None, voltage=None,
+                 precompute_coefficients=False,
                  ):
 
         if _buffer is not None:
@@ -71,6 +72,7 @@ class ElectronLensInterpolated(xt.BeamElement):
         tc_fieldmap = TriCubicInterpolatedFieldMap(x_grid=fieldmap._x_grid, 
                                                    y_grid=fieldmap._y_grid, 
                                                    z_grid=fieldmap._z_grid,
+                                                   precompute_coefficients=precompute_coefficients,
                                                   )
 
         nx = tc_fieldmap.nx
@@ -127,6 +129,7 @@ class ElectronLensInterpolated(xt.BeamElement):
             index_offset = 8 * nx * ny * iz
             tc_fieldmap._phi_taylor[index_offset:index_offset+len_slice] = flat_slice
         ##############################################################################
+        tc_fieldmap.update_coefficients()
 
         self.xoinitialize(
                  _context=_context,
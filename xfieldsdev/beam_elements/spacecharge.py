@@ -66,7 +66,21 @@ class SpaceCharge3D(xt.BeamElement):
             In case ``update_on_track``is ``False`` and ``phi`` is provided
             by the user, this argument can be omitted.
         gamma0 (float): Relativistic gamma factor of the beam. This is required
-            only if the solver is ``FFTSolver3D``.
+            only if a 3D solver (``FFTSolver3D``, ``FFTSolver3DR2C``,
+            ``FFTSolver3DPruned``) is used.
+        deposition_mode (str): Charge deposition strategy used by the field
+            map (``'auto'``, ``'atomic'`` or ``'private_grids'``). The default
+            is ``'auto'``.
+        interleaved_gradient (bool): If ``True`` the field map stores the
+            gradient of phi interleaved per node, which makes the field
+            interpolation in the tracking read contiguous memory. The default
+            is ``False``.
+        sort_particles_every (int): If provided, the particles are reordered
+            according to their grid cell every ``sort_particles_every``
+            interactions, which makes the charge deposition and the field
+            interpolation cache friendly. In a ring with many space-charge
+            elements it is sufficient to enable it on one of them. The
+            default is ``None`` (no sorting).
     Returns:
         (SpaceCharge3D): A space-charge 3D beam element.
     """
@@ -90,7 +104,8 @@ class SpaceCharge3D(xt.BeamElement):
                 update_on_track=self.update_on_track,
                 length=self.length,
                 apply_z_kick=self.apply_z_kick,
-                fieldmap=self.fieldmap)
+                fieldmap=self.fieldmap,
+                sort_particles_every=self.sort_particles_every)
 
     def __init__(self,
                  _context=None,
@@ -107,12 +122,22 @@ class SpaceCharge3D(xt.BeamElement):
                  rho=None, phi=None,
                  solver=None,
                  gamma0=None,
-                 fftplan=None):
+                 fftplan=None,
+                 fft_workspace=None,
+                 deposition_mode='auto',
+                 interleaved_gradient=False,
+                 sort_particles_every=None):
 
         self.update_on_track = update_on_track
         self.apply_z_kick = apply_z_kick
 
-        if solver=='FFTSolver3D':
+        if sort_particles_every is not None:
+            assert sort_particles_every > 0, (
+                    'sort_particles_every must be a positive integer')
+        self.sort_particles_every = sort_particles_every
+        self._i_interaction = 0
+
+        if solver in ['FFTSolver3D', 'FFTSolver3DR2C', 'FFTSolver3DPruned']:
             assert gamma0 is not None, ('To use FFTSolver3D '
                                         'gamma0 must be provided')
 
@@ -150,7 +175,10 @@ class SpaceCharge3D(xt.BeamElement):
                         solver=solver,
                         scale_coordinates_in_solver=scale_coordinates_in_solver,
                         updatable=update_on_track,
-                        fftplan=fftplan)
+                        fftplan=fftplan,
+                        fft_workspace=fft_workspace,
+                        deposition_mode=deposition_mode,
+                        interleaved_gradient=interleaved_gradient)
 
         self.xoinitialize(
                  _buffer=_buffer,
@@ -162,7 +190,7 @@ class SpaceCharge3D(xt.BeamElement):
 
     @property
     def iscollective(self):
-        return self.update_on_track
+        return self.update_on_track or self.sort_particles_every is not None
 
 
     def track(self, particles):
@@ -175,6 +203,11 @@ class SpaceCharge3D(xt.BeamElement):
             particles (Particles Object): Particles to be tracked.
         """
 
+        if self.sort_particles_every is not None:
+            if self._i_interaction % self.sort_particles_every == 0:
+                self.fieldmap.sort_particles_by_cell(particles)
+            self._i_interaction += 1
+
         if self.update_on_track:
             self.fieldmap.update_from_particles(
                 particles=particles)
@@ -227,6 +260,7 @@ class SpaceChargeBiGaussian(xt.BeamElement):
                  sigma_y=None,
                  fieldmap=None,
                  min_sigma_diff=1e-10,
+                 field_engine='exact',
                  **kwargs # to avoid issues when building form dict
                  ):
 
@@ -237,33 +271,36 @@ class SpaceChargeBiGaussian(xt.BeamElement):
                      _offset=_offset,
                      _xobject=_xobject)
         else:
-            self.xoinitialize(
-                     _context=_context,
-                     _buffer=_buffer,
-                     _offset=_offset)
-
             if apply_z_kick:
                 raise NotImplementedError
 
             assert longitudinal_profile is not None, (
                 'Longitudinal profile must be provided')
 
-            self.length = length
-            self.longitudinal_profile = longitudinal_profile
-            self.apply_z_kick = apply_z_kick
-            self._init_update_on_track(update_on_track)
-
+            # The field map is passed at initialization as its size depends
+            # on the field engine (tables)
             if fieldmap is None:
-                self.fieldmap = BiGaussianFieldMap(
-                         _context=self._buffer.context,
+                fieldmap = BiGaussianFieldMap(
+                         _context=(_buffer.context if _buffer is not None
+                                   else _context),
                          mean_x=mean_x,
                          mean_y=mean_y,
                          sigma_x=sigma_x,
                          sigma_y=sigma_y,
                          min_sigma_diff=min_sigma_diff,
-                         updatable=True)
-            else:
-                self.fieldmap=fieldmap
+                         updatable=True,
+                         field_engine=field_engine)
+
+            self.xoinitialize(
+                     _context=_context,
+                     _buffer=_buffer,
+                     _offset=_offset,
+                     fieldmap=fieldmap)
+
+            self.length = length
+            self.longitudinal_profile = longitudinal_profile
+            self.apply_z_kick = apply_z_kick
+            self._init_update_on_track(update_on_track)
 
         self.iscollective = None # Inferred from _update_flag
 
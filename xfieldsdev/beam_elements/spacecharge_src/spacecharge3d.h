@@ -15,7 +15,10 @@ void SpaceCharge3D_track_local_particle(
     const double length = SpaceCharge3DData_get_length(el);
     /*gpuglmem*/ double* dphi_dx_map = SpaceCharge3DData_getp1_fieldmap_dphi_dx(el, 0);
     /*gpuglmem*/ double* dphi_dy_map = SpaceCharge3DData_getp1_fieldmap_dphi_dy(el, 0);
+    /*gpuglmem*/ double* grad_xyz_map = SpaceCharge3DData_getp1_fieldmap_grad_xyz(el, 0);
     TriLinearInterpolatedFieldMapData fmap = SpaceCharge3DData_getp_fieldmap(el);
+    const int64_t use_interleaved =
+                  TriLinearInterpolatedFieldMapData_len_grad_xyz(fmap) > 0;
 
     //start_per_particle_block (part0->part)
 	double const x = LocalParticle_get_x(part);
@@ -31,10 +34,20 @@ void SpaceCharge3D_track_local_particle(
 	const IndicesAndWeights iw = 
 	    TriLinearInterpolatedFieldMap_compute_indeces_and_weights(fmap, x, y, z);
 
-   	const double dphi_dx = 
-	    TriLinearInterpolatedFieldMap_interpolate_3d_map_scalar(dphi_dx_map, iw);
-   	const double dphi_dy = 
-	    TriLinearInterpolatedFieldMap_interpolate_3d_map_scalar(dphi_dy_map, iw);
+	double dphi_dx, dphi_dy;
+	if (use_interleaved){
+	    double grad[3];
+	    TriLinearInterpolatedFieldMap_interpolate_3d_map_interleaved(
+	                                             grad_xyz_map, 3, iw, grad);
+	    dphi_dx = grad[0];
+	    dphi_dy = grad[1];
+	}
+	else{
+   	    dphi_dx = TriLinearInterpolatedFieldMap_interpolate_3d_map_scalar(
+	                                                      dphi_dx_map, iw);
+   	    dphi_dy = TriLinearInterpolatedFieldMap_interpolate_3d_map_scalar(
+	                                                      dphi_dy_map, iw);
+	}
 
         const double charge_mass_ratio = 
 		             chi*QELEM*q0/(mass0*QELEM/(C_LIGHT*C_LIGHT));
@@ -6,6 +6,28 @@
 #ifndef XFIELDS_SPACECHARGEBIGAUSSIAN_H
 #define XFIELDS_SPACECHARGEBIGAUSSIAN_H
 
+#ifdef BIGAUSSIAN_VEC_USE_TILES
+/*gpufun*/
+void SpaceChargeBiGaussian_kick_tile(BiGaussianFieldMapData fmap,
+        LocalParticle* part0, BiGaussianParticleTile* tile){
+
+    // Exact field for all the particles of the tile, then kicks
+    get_Ex_Ey_gauss_vec(tile->n, tile->x, tile->y,
+             BiGaussianFieldMapData_get_sigma_x(fmap),
+             BiGaussianFieldMapData_get_sigma_y(fmap),
+             BiGaussianFieldMapData_get_min_sigma_diff(fmap),
+             tile->Ex, tile->Ey);
+
+    LocalParticle lpart = *part0;
+    for (int64_t ii=0; ii<tile->n; ii++){
+        lpart.ipart = tile->ipart[ii];
+        LocalParticle_add_to_px(&lpart, tile->factor[ii]*(-tile->Ex[ii]));
+        LocalParticle_add_to_py(&lpart, tile->factor[ii]*(-tile->Ey[ii]));
+    }
+    tile->n = 0;
+}
+#endif
+
 /*gpufun*/
 void SpaceChargeBiGaussian_track_local_particle(
 		 SpaceChargeBiGaussianData el, LocalParticle* part0){
@@ -15,6 +37,15 @@ void SpaceChargeBiGaussian_track_local_particle(
     LongitudinalProfileQGaussianData prof = 
 	    SpaceChargeBiGaussianData_getp_longitudinal_profile(el);
 
+    #ifdef BIGAUSSIAN_VEC_USE_TILES
+    // The exact field is evaluated for tiles of particles
+    int const use_tiles = !BiGaussianFieldMap_uses_table(fmap);
+    const double mean_x = BiGaussianFieldMapData_get_mean_x(fmap);
+    const double mean_y = BiGaussianFieldMapData_get_mean_y(fmap);
+    BiGaussianParticleTile tile;
+    tile.n = 0;
+    #endif
+
     //start_per_particle_block (part0->part)
 	double const x = LocalParticle_get_x(part);
 	double const y = LocalParticle_get_y(part);
@@ -25,10 +56,6 @@ void SpaceChargeBiGaussian_track_local_particle(
 	double const chi = LocalParticle_get_chi(part);
 	double const beta0 = LocalParticle_get_beta0(part);
 	double const gamma0 = LocalParticle_get_gamma0(part);
-	
-   	double dphi_dx, dphi_dy;
-	BiGaussianFieldMap_get_dphi_dx_dphi_dy(fmap, x, y,
-                          &dphi_dx, &dphi_dy);
 
 	const double lambda_z = 
 		LongitudinalProfileQGaussian_line_density_scalar(prof, z);
@@ -39,10 +66,31 @@ void SpaceChargeBiGaussian_track_local_particle(
                                 *length*(1.-beta0*beta0)
                                 /(gamma0*beta0*beta0*C_LIGHT*C_LIGHT));
 
-	LocalParticle_add_to_px(part, factor*lambda_z*dphi_dx);
-	LocalParticle_add_to_py(part, factor*lambda_z*dphi_dy);
+        #ifdef BIGAUSSIAN_VEC_USE_TILES
+        if (use_tiles){
+            if (BiGaussianParticleTile_add(&tile, part->ipart,
+                        x-mean_x, y-mean_y, factor*lambda_z)){
+                SpaceChargeBiGaussian_kick_tile(fmap, part0, &tile);
+            }
+        }
+        else
+        #endif
+        {
+            double dphi_dx, dphi_dy;
+            BiGaussianFieldMap_get_dphi_dx_dphi_dy(fmap, x, y,
+                              &dphi_dx, &dphi_dy);
+
+            LocalParticle_add_to_px(part, factor*lambda_z*dphi_dx);
+            LocalParticle_add_to_py(part, factor*lambda_z*dphi_dy);
+        }
 
     //end_per_particle_block
+
+    #ifdef BIGAUSSIAN_VEC_USE_TILES
+    if (tile.n > 0){
+        SpaceChargeBiGaussian_kick_tile(fmap, part0, &tile);
+    }
+    #endif
 }
 
 
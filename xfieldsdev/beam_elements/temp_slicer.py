@@ -3,6 +3,12 @@ from scipy import special
 import xobjects as xo
 import xpart as xp
 from ..general import _pkg_root
+from ..fieldmaps.interpolated import (PRIVATE_GRIDS_MAX_BYTES,
+                                      _get_cpu_num_threads)
+
+# Doubles per slice of the accumulators of compute_slice_moments
+# (SLICE_MOMENTS_ACC_SIZE in headers/compute_slice_moments.h)
+_SLICE_MOMENTS_ACC_SIZE = 17
 
 _digitize_kernel = xo.Kernel(
             c_name="digitize",
@@ -19,7 +25,9 @@ _compute_slice_moments_kernel = xo.Kernel(
                   xo.Arg(xo.Int64, pointer=True, name='particles_slice'),
                   xo.Arg(xo.Float64, pointer=True, name='moments'),
                   xo.Arg(xo.Int64, name='n_slices'),
-                  xo.Arg(xo.Int64, name='threshold_num_macroparticles')]
+                  xo.Arg(xo.Int64, name='threshold_num_macroparticles'),
+                  xo.Arg(xo.Int64, name='n_chunks'),
+                  xo.Arg(xo.Float64, pointer=True, name='accumulators')]
 )
 
 
@@ -44,8 +52,57 @@ _compute_slice_moments_cuda_moments_from_sums_kernel = xo.Kernel(
             n_threads="n_slices",
 )
 
+_slice_and_compute_moments_kernel = xo.Kernel(
+            c_name="slice_and_compute_moments",
+            args=[xo.Arg(xp.Particles._XoStruct, name='particles'),
+                  xo.Arg(xo.Float64, const=True, pointer=True, name='bin_edges'),
+                  xo.Arg(xo.Int64, name='n_slices'),
+                  xo.Arg(xo.Int64, name='uniform_bins'),
+                  xo.Arg(xo.Int64, name='threshold_num_macroparticles'),
+                  xo.Arg(xo.Int64, name='store_slices'),
+                  xo.Arg(xo.Int64, pointer=True, name='particles_slice'),
+                  xo.Arg(xo.Float64, pointer=True, name='moments'),
+                  xo.Arg(xo.Int64, name='n_chunks'),
+                  xo.Arg(xo.Float64, pointer=True, name='accumulators')]
+)
+
+_slice_moments_remove_particles_kernel = xo.Kernel(
+            c_name="slice_moments_remove_particles",
+            args=[xo.Arg(xp.Particles._XoStruct, name='particles'),
+                  xo.Arg(xo.Int64, const=True, pointer=True, name='particle_ids'),
+                  xo.Arg(xo.Int64, name='n_ids'),
+                  xo.Arg(xo.Int64, name='n_slices'),
+                  xo.Arg(xo.Int64, pointer=True, name='particles_slice'),
+                  xo.Arg(xo.Float64, pointer=True, name='accumulators')]
+)
+
+_slice_moments_add_particles_kernel = xo.Kernel(
+            c_name="slice_moments_add_particles",
+            args=[xo.Arg(xp.Particles._XoStruct, name='particles'),
+                  xo.Arg(xo.Int64, const=True, pointer=True, name='particle_ids'),
+                  xo.Arg(xo.Int64, name='n_ids'),
+                  xo.Arg(xo.Float64, const=True, pointer=True, name='bin_edges'),
+                  xo.Arg(xo.Int64, name='n_slices'),
+                  xo.Arg(xo.Int64, name='uniform_bins'),
+                  xo.Arg(xo.Int64, pointer=True, name='particles_slice'),
+                  xo.Arg(xo.Float64, pointer=True, name='accumulators')]
+)
+
+_slice_moments_from_accumulators_kernel = xo.Kernel(
+            c_name="slice_moments_from_accumulators",
+            args=[xo.Arg(xp.Particles._XoStruct, name='particles'),
+                  xo.Arg(xo.Float64, pointer=True, name='moments'),
+                  xo.Arg(xo.Int64, name='n_slices'),
+                  xo.Arg(xo.Int64, name='threshold_num_macroparticles'),
+                  xo.Arg(xo.Float64, pointer=True, name='accumulators')]
+)
+
 _temp_slicer_kernels = {'digitize': _digitize_kernel,
                         'compute_slice_moments':_compute_slice_moments_kernel,
+                        'slice_and_compute_moments':_slice_and_compute_moments_kernel,
+                        'slice_moments_remove_particles':_slice_moments_remove_particles_kernel,
+                        'slice_moments_add_particles':_slice_moments_add_particles_kernel,
+                        'slice_moments_from_accumulators':_slice_moments_from_accumulators_kernel,
                         'compute_slice_moments_cuda_sums_per_slice':_compute_slice_moments_cuda_sums_per_slice_kernel,
                         'compute_slice_moments_cuda_moments_from_sums':_compute_slice_moments_cuda_moments_from_sums_kernel,
                         }
@@ -93,6 +150,7 @@ class TempSlicer(xo.HybridClass):
         self.bin_edges   = l_k_arr * sigma_z
         self.bin_weights = w_k_arr
         self.bin_widths_beamstrahlung = dz_k_arr * sigma_z
+        self._uniform_bins = (mode == "unibin")
 
         if _xobject is not None:
             self.xoinitialize(_xobject=_xobject, _context=_context,
@@ -271,15 +329,21 @@ class TempSlicer(xo.HybridClass):
     def assign_slices(self, particles):
         particles.slice = self.get_slice_indices(particles)
 
-    def compute_moments(self, particles, update_assigned_slices=True, threshold_num_macroparticles=20):
+    def compute_moments(self, particles, update_assigned_slices=True, threshold_num_macroparticles=20,
+                        store_slices=True):
+        '''
+        Returns the slice moments. With update_assigned_slices the slices
+        are first recomputed from zeta, and written to particles.slice only
+        if store_slices (on CPU the slicing and the moments are computed in
+        the same pass). Otherwise particles.slice is used as is.
+        '''
         context = particles._context
         if isinstance(context, xo.ContextPyopencl):
             raise NotImplementedError
 
-        if update_assigned_slices:
-            self.assign_slices(particles)
-
         if isinstance(context, xo.ContextCupy):
+            if update_assigned_slices:
+                self.assign_slices(particles)
             slice_moments = self._context.zeros(self.num_slices*(6+10+1+6+10),dtype=np.float64)  # sums (16) + count (1) + moments (16)
             self._context.kernels.compute_slice_moments_cuda_sums_per_slice(particles=particles, particles_slice=particles.slice,
                                                            moments=slice_moments, num_macroparticles=np.int64(len(particles.slice)),
@@ -297,7 +361,137 @@ class TempSlicer(xo.HybridClass):
             # np.cumsum[-1] =/= np.sum due to different order of summation
             # use np.isclose instead of ==; np.sum does pariwise sum which orders values differently thus causing a numerical error
             # see: https://stackoverflow.com/questions/69610452/why-does-the-last-entry-of-numpy-cumsum-not-necessarily-equal-numpy-sum
-            self._context.kernels.compute_slice_moments(particles=particles, particles_slice=particles.slice,
+            n_chunks = self._get_n_moments_chunks(len(particles.slice))
+            if update_assigned_slices:
+                self._context.kernels.slice_and_compute_moments(particles=particles,
+                                                    bin_edges=context.nparray_to_context_array(self.bin_edges),
+                                                    n_slices=self.num_slices,
+                                                    uniform_bins=int(self._uniform_bins),
+                                                    threshold_num_macroparticles=threshold_num_macroparticles,
+                                                    store_slices=int(store_slices),
+                                                    particles_slice=particles.slice,
+                                                    moments=slice_moments,
+                                                    n_chunks=n_chunks,
+                                                    accumulators=self._get_moments_accumulators(n_chunks))
+            else:
+                self._context.kernels.compute_slice_moments(particles=particles, particles_slice=particles.slice,
                                                     moments=slice_moments, n_slices=self.num_slices,
-                                                    threshold_num_macroparticles=threshold_num_macroparticles)
+                                                    threshold_num_macroparticles=threshold_num_macroparticles,
+                                                    n_chunks=n_chunks,
+                                                    accumulators=self._get_moments_accumulators(n_chunks))
             return slice_moments
+
+    def _get_moments_accumulators_stride(self):
+        # padded to a multiple of 64 bytes per chunk, as in
+        # slice_moments_accumulators_stride
+        return -(-self.num_slices*_SLICE_MOMENTS_ACC_SIZE // 8) * 8
+
+    def _get_n_moments_chunks(self, nparticles):
+        # One chunk of particles per thread, each with its own accumulators.
+        # The chunks are merged in a fixed order, so the moments do not
+        # depend on the thread scheduling, but their rounding depends on the
+        # number of threads
+        n_chunks = min(_get_cpu_num_threads(self._context), max(nparticles, 1))
+        max_chunks = PRIVATE_GRIDS_MAX_BYTES // (
+                                8 * self._get_moments_accumulators_stride())
+        return int(max(min(n_chunks, max_chunks), 1))
+
+    def _get_moments_accumulators(self, n_chunks):
+        size = n_chunks * self._get_moments_accumulators_stride()
+        if (not hasattr(self, '_moments_accumulators')
+                or len(self._moments_accumulators) < size):
+            self._moments_accumulators = self._context.zeros(
+                                            shape=(size,), dtype=np.float64)
+        return self._moments_accumulators
+
+
+class IncrementalSliceMoments:
+    """
+    Slice moments of one bunch that can be updated when only a subset of its
+    particles moves (CPU only). The per-slice accumulators of the moments
+    (count, means and centred co-moments) are kept between updates:
+
+        moments = inc.reset(particles)      # full pass
+        inc.remove(particles, ids)          # before changing particles ids
+        ...                                 # e.g. kick the particles ids
+        inc.add(particles, ids)             # after, with their new slice
+        moments = inc.get_moments(particles)
+
+    so that an update costs O(len(ids)) instead of a pass over the bunch. The
+    slice in which each particle is accumulated is kept in particles_slice
+    (particles.slice is not used).
+    """
+
+    def __init__(self, slicer, threshold_num_macroparticles=20):
+        self.slicer = slicer
+        self.threshold_num_macroparticles = threshold_num_macroparticles
+        self._context = slicer._context
+        self.bin_edges = self._context.nparray_to_context_array(slicer.bin_edges)
+        n_slices = slicer.num_slices
+        self.accumulators = self._context.zeros(
+                    shape=(n_slices*_SLICE_MOMENTS_ACC_SIZE,), dtype=np.float64)
+        self.particles_slice = None
+
+    def reset(self, particles):
+        """Recomputes all slices and moments from the particles."""
+        slicer = self.slicer
+        nparticles = len(particles.state)
+        if (self.particles_slice is None
+                or len(self.particles_slice) != nparticles):
+            self.particles_slice = self._context.zeros(shape=(nparticles,),
+                                                       dtype=np.int64)
+        n_chunks = slicer._get_n_moments_chunks(nparticles)
+        accumulators = slicer._get_moments_accumulators(n_chunks)
+        moments = self._new_moments()
+        self._context.kernels.slice_and_compute_moments(particles=particles,
+                    bin_edges=self.bin_edges,
+                    n_slices=slicer.num_slices,
+                    uniform_bins=int(slicer._uniform_bins),
+                    threshold_num_macroparticles=self.threshold_num_macroparticles,
+                    store_slices=1,
+                    particles_slice=self.particles_slice,
+                    moments=moments,
+                    n_chunks=n_chunks,
+                    accumulators=accumulators)
+        # the merged accumulators are left in the first chunk
+        self.accumulators[:] = accumulators[:len(self.accumulators)]
+        return moments
+
+    def remove(self, particles, particle_ids):
+        """Removes the particles particle_ids from the accumulators."""
+        self._context.kernels.slice_moments_remove_particles(
+                    particles=particles,
+                    particle_ids=particle_ids,
+                    n_ids=len(particle_ids),
+                    n_slices=self.slicer.num_slices,
+                    particles_slice=self.particles_slice,
+                    accumulators=self.accumulators)
+
+    def add(self, particles, particle_ids):
+        """Slices the particles particle_ids and adds them to the accumulators."""
+        self._context.kernels.slice_moments_add_particles(
+                    particles=particles,
+                    particle_ids=particle_ids,
+                    n_ids=len(particle_ids),
+                    bin_edges=self.bin_edges,
+                    n_slices=self.slicer.num_slices,
+                    uniform_bins=int(self.slicer._uniform_bins),
+                    particles_slice=self.particles_slice,
+                    accumulators=self.accumulators)
+
+    def get_moments(self, particles):
+        """Returns the moments, in the layout of TempSlicer.compute_moments."""
+        moments = self._new_moments()
+        self._context.kernels.slice_moments_from_accumulators(
+                    particles=particles,
+                    moments=moments,
+                    n_slices=self.slicer.num_slices,
+                    threshold_num_macroparticles=self.threshold_num_macroparticles,
+                    accumulators=self.accumulators)
+        return moments
+
+    def _new_moments(self):
+        # a new array each time, as the moments may still be in flight to
+        # the partner element
+        return self._context.zeros(shape=(self.slicer.num_slices*(1+6+10),),
+                                   dtype=np.float64)
@@ -11,7 +11,8 @@ import xtrack as xt
 
 
 def get_electroncloud_fieldmap_from_h5(
-        filename, tau_max=None, buffer=None, ecloud_name="e-cloud"):
+        filename, tau_max=None, buffer=None, ecloud_name="e-cloud",
+        precompute_coefficients=False):
     assert buffer is not None
     import h5py
     ff = h5py.File(filename, "r")
@@ -50,9 +51,14 @@ def get_electroncloud_fieldmap_from_h5(
     mirror2D = ff["settings/symmetric2D"][()]
     # (in GB), 8 bytes per double-precision number
     memory_estimate = (ix2 - ix1) * (iy2 - iy1) * (iz2 - iz1) * 8 * 8 * 1.e-9
+    if precompute_coefficients:
+        # 64 coefficients per cell
+        memory_estimate += ((ix2 - ix1 - 1) * (iy2 - iy1 - 1)
+                            * (iz2 - iz1 - 1) * 64 * 8 * 1.e-9)
     print(f"Creating fieldmap... (Memory estimate = {memory_estimate:.2f} GB)")
     fieldmap = xf.TriCubicInterpolatedFieldMap(x_grid=x_grid, y_grid=y_grid, z_grid=z_grid,
-                                               mirror_x=mirror2D, mirror_y=mirror2D, mirror_z=0, _buffer=buffer)
+                                               mirror_x=mirror2D, mirror_y=mirror2D, mirror_z=0, _buffer=buffer,
+                                               precompute_coefficients=precompute_coefficients)
     print(f"Reading {ecloud_name}: ")
     kk = 0.
     scale = [1., fieldmap.dx, fieldmap.dy, fieldmap.dz,
@@ -88,6 +94,7 @@ def get_electroncloud_fieldmap_from_h5(
     #                 index = ll + 8 * ix + 8 * nx * iy + 8 * nx * ny * (iz - iz1)
     #                 fieldmap._phi_taylor[index] = phi_slice[ix, iy, ll] * scale[ll]
     ##########################################################################
+    fieldmap.update_coefficients()
 
     return fieldmap
 
@@ -163,7 +170,8 @@ def electroncloud_dipolar_kicks_of_fieldmap(fieldmap=None, p0c=None):
 
 
 def full_electroncloud_setup(line=None, ecloud_info=None, filenames=None, context=None,
-                             tau_max=None, subtract_dipolar_kicks=True, shift_to_closed_orbit=True):
+                             tau_max=None, subtract_dipolar_kicks=True, shift_to_closed_orbit=True,
+                             precompute_coefficients=False):
 
     buffer = context.new_buffer()
     fieldmaps = {
@@ -171,7 +179,8 @@ def full_electroncloud_setup(line=None, ecloud_info=None, filenames=None, contex
             filename=filename,
             buffer=buffer,
             tau_max=tau_max,
-            ecloud_name=ecloud_type) for (
+            ecloud_name=ecloud_type,
+            precompute_coefficients=precompute_coefficients) for (
             ecloud_type,
             filename) in filenames.items()}
 
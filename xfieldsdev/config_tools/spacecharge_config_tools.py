@@ -219,6 +219,7 @@ class PICCollection:
 
         self._existing_pics = {}
         self._fftplan = None
+        self._fft_workspace = None
 
 
     def get_pic(self, x_lim, y_lim):
@@ -245,10 +246,14 @@ class PICCollection:
                 z_range=self.z_range,
                 nx=self.nx_grid, ny=self.ny_grid, nz=self.nz_grid,
                 solver=self.solver,
-                fftplan=self._fftplan)
+                fftplan=self._fftplan,
+                fft_workspace=self._fft_workspace)
             new_pic._buffer.grow(10*1024**2) # Add 10 MB for sc copies
             if self._fftplan is None:
                 self._fftplan = new_pic.fieldmap.solver.fftplan
+            if self._fft_workspace is None:
+                # All pics have the same grid size and are used one at a time
+                self._fft_workspace = new_pic.fieldmap.solver._workspace_dev
             self._existing_pics[ix, iy] = new_pic
 
         return self._existing_pics[ix, iy]
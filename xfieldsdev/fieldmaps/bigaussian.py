@@ -8,6 +8,10 @@ import numpy as np
 import xobjects as xo
 import xtrack as xt
 from xobjects import context_default
+from scipy.constants import epsilon_0
+from scipy.special import wofz
+
+_FIELD_ENGINES = {'exact': 0, 'table': 1}
 
 def mean_and_std(a, weights=None):
     if weights is None:
@@ -21,6 +25,220 @@ def mean_and_std(a, weights=None):
 
     return float(mean), float(std)
 
+
+def _bassetti_erskine(x, y, sigma_x, sigma_y, min_sigma_diff):
+    '''
+    Numpy version of get_Ex_Ey_gauss (bigaussian.h), field of a unit line
+    charge density.
+    '''
+
+    x = np.asarray(x, dtype=np.float64)
+    y = np.asarray(y, dtype=np.float64)
+
+    if abs(sigma_x - sigma_y) < min_sigma_diff:
+        sigma = 0.5 * (sigma_x + sigma_y)
+        r2 = x * x + y * y
+        with np.errstate(divide='ignore', invalid='ignore'):
+            temp = np.where(r2 < 1e-20,
+                np.sqrt(r2) / (2 * np.pi * epsilon_0 * sigma),
+                (1 - np.exp(-0.5 * r2 / (sigma * sigma)))
+                / (2 * np.pi * epsilon_0 * r2))
+        return temp * x, temp * y
+
+    swap = sigma_x < sigma_y
+    s1, s2 = (sigma_y, sigma_x) if swap else (sigma_x, sigma_y)
+    ab1, ab2 = (np.abs(y), np.abs(x)) if swap else (np.abs(x), np.abs(y))
+
+    S = np.sqrt(2 * (s1 * s1 - s2 * s2))
+    factBE = 1 / (2 * epsilon_0 * np.sqrt(np.pi) * S)
+    w_zeta = wofz((ab1 + 1j * ab2) / S)
+    w_eta = wofz((s2 / s1 * ab1 + 1j * s1 / s2 * ab2) / S)
+    expBE = np.exp(-ab1 * ab1 / (2 * s1 * s1) - ab2 * ab2 / (2 * s2 * s2))
+
+    E1 = factBE * (w_zeta.imag - w_eta.imag * expBE)
+    E2 = factBE * (w_zeta.real - w_eta.real * expBE)
+    Ex, Ey = (E2, E1) if swap else (E1, E2)
+
+    return np.where(x < 0, -Ex, Ex), np.where(y < 0, -Ey, Ey)
+
+
+def _multipole_field(x, y, sigma_x, sigma_y, n_multipoles):
+    '''
+    Numpy version of the far-field expansion used by the tabulated engine:
+    Ex - i*Ey = 1/(2 pi eps0) sum_k (2k-1)!! Delta^k / z^(2k+1)
+    with Delta = sigma_x^2 - sigma_y^2.
+    '''
+
+    z = np.asarray(x) + 1j * np.asarray(y)
+    delta = sigma_x * sigma_x - sigma_y * sigma_y
+    inv_z2 = 1 / (z * z)
+    term = 1 / z
+    res = term.copy()
+    for kk in range(1, n_multipoles + 1):
+        term = term * (2 * kk - 1) * delta * inv_z2
+        res += term
+    res /= 2 * np.pi * epsilon_0
+
+    return res.real, -res.imag
+
+
+def _cubic_weights(t):
+    return np.array([-t * (t - 1) * (t - 2) / 6,
+                     (t + 1) * (t - 1) * (t - 2) / 2,
+                     -(t + 1) * t * (t - 2) / 2,
+                     (t + 1) * t * (t - 1) / 6])
+
+
+class _FieldTable:
+    '''
+    Normalized field of a Gaussian distribution on a regular grid in
+    (|x|/sigma_x, |y|/sigma_y), with one extra node on each side for the cubic
+    stencil. The stored values are E*sigma_x, so that the table can be used
+    for any sigma_x with the same sigma_y/sigma_x.
+    '''
+
+    def __init__(self, sigma_x, sigma_y, min_sigma_diff, n_sigma, step):
+
+        sigma_max = max(sigma_x, sigma_y)
+        self.du = step
+        self.dv = step
+        self.n_u = int(np.ceil(n_sigma * sigma_max / sigma_x / step))
+        self.n_v = int(np.ceil(n_sigma * sigma_max / sigma_y / step))
+
+        u = (np.arange(self.n_u + 3) - 1) * self.du
+        v = (np.arange(self.n_v + 3) - 1) * self.dv
+        UU, VV = np.meshgrid(u, v, indexing='ij')
+        Ex, Ey = _bassetti_erskine(UU * sigma_x, VV * sigma_y,
+                                   sigma_x, sigma_y, min_sigma_diff)
+        self.ex = Ex * sigma_x
+        self.ey = Ey * sigma_x
+
+    def interpolate(self, x, y, sigma_x, sigma_y):
+        u = np.abs(x) / sigma_x / self.du
+        v = np.abs(y) / sigma_y / self.dv
+        iu = np.floor(u).astype(np.int64)
+        iv = np.floor(v).astype(np.int64)
+        wu = _cubic_weights(u - iu)
+        wv = _cubic_weights(v - iv)
+        Ex = np.zeros_like(u)
+        Ey = np.zeros_like(u)
+        for aa in range(4):
+            for bb in range(4):
+                ww = wu[aa] * wv[bb]
+                Ex += ww * self.ex[iu + aa, iv + bb]
+                Ey += ww * self.ey[iu + aa, iv + bb]
+        Ex /= sigma_x
+        Ey /= sigma_x
+        return np.where(x < 0, -Ex, Ex), np.where(y < 0, -Ey, Ey)
+
+
+def _build_field_table(sigma_x, sigma_y, min_sigma_diff,
+                       n_sigma, step, tolerance, max_refinements=4):
+
+    sigma_max = max(sigma_x, sigma_y)
+
+    # Far field: number of multipoles such that the first neglected term
+    # is below the tolerance at the edge of the table
+    delta_rel = abs(sigma_x**2 - sigma_y**2) / (n_sigma * sigma_max)**2
+    n_multipoles = 0
+    next_term = delta_rel
+    while next_term >= tolerance:
+        n_multipoles += 1
+        next_term *= (2 * n_multipoles + 1) * delta_rel
+        if n_multipoles > 50 or next_term > 1:
+            raise ValueError('Far-field expansion does not reach the '
+                             'tolerance, increase table_n_sigma')
+
+    # Error check points: cell centres inside the table (where the cubic
+    # interpolation error is largest) and points just outside of it
+    for _ in range(max_refinements + 1):
+        table = _FieldTable(sigma_x, sigma_y, min_sigma_diff,
+                            n_sigma, step)
+
+        u_c = (np.arange(table.n_u) + 0.5) * table.du
+        v_c = (np.arange(table.n_v) + 0.5) * table.dv
+        UU, VV = np.meshgrid(u_c, v_c, indexing='ij')
+        x_c = UU.flatten() * sigma_x
+        y_c = VV.flatten() * sigma_y
+        Ex_ref, Ey_ref = _bassetti_erskine(x_c, y_c, sigma_x, sigma_y,
+                                           min_sigma_diff)
+        Ex_tab, Ey_tab = table.interpolate(x_c, y_c, sigma_x, sigma_y)
+        E_max = max(np.max(np.abs(table.ex)),
+                    np.max(np.abs(table.ey))) / sigma_x
+        err_table = max(np.max(np.abs(Ex_tab - Ex_ref)),
+                        np.max(np.abs(Ey_tab - Ey_ref))) / E_max
+        if err_table < tolerance:
+            break
+        step = step / 2
+    else:
+        raise ValueError('Field table does not reach the tolerance '
+                         f'(error {err_table:.2e}), reduce table_step')
+
+    x_edge = np.concatenate([
+            np.linspace(0, table.n_u * table.du, 101) * sigma_x,
+            np.full(101, table.n_u * table.du * sigma_x)])
+    y_edge = np.concatenate([
+            np.full(101, table.n_v * table.dv * sigma_y),
+            np.linspace(0, table.n_v * table.dv, 101) * sigma_y])
+    Ex_ref, Ey_ref = _bassetti_erskine(x_edge, y_edge, sigma_x, sigma_y,
+                                       min_sigma_diff)
+    Ex_mp, Ey_mp = _multipole_field(x_edge, y_edge, sigma_x, sigma_y,
+                                    n_multipoles)
+    err_far = max(np.max(np.abs(Ex_mp - Ex_ref)),
+                  np.max(np.abs(Ey_mp - Ey_ref))) / E_max
+
+    return dict(
+        _table_sigma_x=sigma_x,
+        _table_sigma_y=sigma_y,
+        _table_n_u=table.n_u,
+        _table_n_v=table.n_v,
+        _table_du=table.du,
+        _table_dv=table.dv,
+        _table_n_multipoles=n_multipoles,
+        _table_max_error=max(err_table, err_far),
+        _table_ex=table.ex.flatten(),
+        _table_ey=table.ey.flatten())
+
+
+# Fields of the elements using the tabulated field engine
+_FIELD_TABLE_XOFIELDS = {
+        '_field_engine': xo.Int64,
+        '_table_sigma_x': xo.Float64,
+        '_table_sigma_y': xo.Float64,
+        '_table_n_u': xo.Int64,
+        '_table_n_v': xo.Int64,
+        '_table_du': xo.Float64,
+        '_table_dv': xo.Float64,
+        '_table_n_multipoles': xo.Int64,
+        '_table_max_error': xo.Float64,
+        '_table_ex': xo.Float64[:],
+        '_table_ey': xo.Float64[:],
+    }
+
+
+def _field_engine_kwargs(field_engine, sigma_x, sigma_y, min_sigma_diff,
+                         table_n_sigma, table_step, table_tolerance):
+    '''
+    Returns the values of the _FIELD_TABLE_XOFIELDS to be passed to
+    xoinitialize for the given field engine.
+    '''
+
+    if field_engine not in _FIELD_ENGINES:
+        raise ValueError(f'Unknown field engine {field_engine}, '
+                         f'valid are {list(_FIELD_ENGINES.keys())}')
+
+    kwargs = {'_field_engine': _FIELD_ENGINES[field_engine]}
+    if field_engine == 'table':
+        if sigma_x is None or sigma_y is None or sigma_x <= 0 or sigma_y <= 0:
+            raise ValueError('sigma_x and sigma_y must be provided '
+                             'to build the field table')
+        kwargs.update(_build_field_table(
+                sigma_x, sigma_y, min_sigma_diff,
+                table_n_sigma, table_step, table_tolerance))
+
+    return kwargs
+
+
 class BiGaussianFieldMap(xo.HybridClass):
 
     '''
@@ -46,6 +264,20 @@ class BiGaussianFieldMap(xo.HybridClass):
             meters) below which round distribution is assumed.
         updatable (bool): If ``True`` the field map can be updated after
             creation. Default is ``True``.
+        field_engine (str): ``'exact'`` evaluates the Bassetti-Erskine
+            formula for each particle. ``'table'`` interpolates a
+            precomputed table of the normalized field (bicubic, over
+            ``table_n_sigma`` times the largest sigma) and uses a multipole
+            expansion of the far field outside of it. The table is only used
+            while sigma_y/sigma_x is the one it was built for, otherwise the
+            exact formula is used. Default is ``'exact'``.
+        table_n_sigma (float64): Extent of the table in units of the largest
+            sigma. Default is ``8.``.
+        table_step (float64): Initial grid step of the table in units of
+            the sigma along each plane. It is halved until the error bound
+            is met. Default is ``0.1``.
+        table_tolerance (float64): Required bound on the error of the
+            tabulated field relative to its maximum. Default is ``1e-6``.
     Returns:
         (BiGaussianFieldMap): Field map object.
     '''
@@ -56,7 +288,8 @@ class BiGaussianFieldMap(xo.HybridClass):
             'sigma_x': xo.Float64,
             'sigma_y': xo.Float64,
             'min_sigma_diff': xo.Float64,
-            '_updatable': xo.Int64
+            '_updatable': xo.Int64,
+            **_FIELD_TABLE_XOFIELDS,
         }
 
     def __init__(self,
@@ -67,15 +300,24 @@ class BiGaussianFieldMap(xo.HybridClass):
                  mean_x=0., mean_y=0.,
                  sigma_x=None, sigma_y=None,
                  min_sigma_diff=1e-10,
-                 updatable=True):
+                 updatable=True,
+                 field_engine='exact',
+                 table_n_sigma=8.,
+                 table_step=0.1,
+                 table_tolerance=1e-6):
 
         if _xobject is not None:
             self.xoinitialize(_xobject=_xobject)
         else:
+            table_kwargs = _field_engine_kwargs(field_engine,
+                        sigma_x, sigma_y, min_sigma_diff,
+                        table_n_sigma, table_step, table_tolerance)
+
             self.xoinitialize(
                      _context=_context,
                      _buffer=_buffer,
-                     _offset=_offset)
+                     _offset=_offset,
+                     **table_kwargs)
 
             self.updatable = updatable
             self.mean_x = mean_x
@@ -84,6 +326,21 @@ class BiGaussianFieldMap(xo.HybridClass):
             self.sigma_y = sigma_y
             self.min_sigma_diff=min_sigma_diff
 
+    @property
+    def field_engine(self):
+        return {vv: kk for kk, vv in _FIELD_ENGINES.items()}[
+                                                    self._field_engine]
+
+    @property
+    def table_max_error(self):
+        '''
+        Maximum error of the tabulated field (relative to the peak field)
+        found on the check points when the table was built.
+        '''
+        if self.field_engine != 'table':
+            return None
+        return self._table_max_error
+
     @property
     def updatable(self):
         return bool(self._updatable)
@@ -39,7 +39,6 @@ void get_transv_field_gauss_round(
   double r2, temp;
 
   r2 = (x-Delta_x)*(x-Delta_x)+(y-Delta_y)*(y-Delta_y);
-  printf("round: The r value is %.9lf.\n", r2);
   if (r2<1e-20) temp = sqrt(r2)/(2.*PI*EPSILON_0*sigma); //linearised
   else          temp = (1-exp(-0.5*r2/(sigma*sigma)))/(2.*PI*EPSILON_0*r2);
 
@@ -56,9 +55,6 @@ void get_transv_field_gauss_ellip(
         double* Ex_out,
         double* Ey_out)
 {
-  double r2;
-  r2 = (x-Delta_x)*(x-Delta_x)+(y-Delta_y)*(y-Delta_y);
-  printf("elliptical: The r value is %.9lf.\n", r2);
   double sigmax = sigma_x;
   double sigmay = sigma_y;
 
@@ -147,12 +143,252 @@ void get_Ex_Ey_gauss(
 
         // elliptical beam
 	else{
-      printf("elliptical: The x value is %.9lf.\n", x);
-      printf("elliptical: The y value is %.9lf.\n", y);
 	    get_transv_field_gauss_ellip(
 	            sigma_x, sigma_y, 0., 0., x, y, Ex_ptr, Ey_ptr);
 
 	}
 }
 
+// Exact field for batches of points with common sigmas (e.g. all particles
+// of a tile crossing one bunch), with the Faddeeva function evaluated by
+// faddeeva_w_vec. The elements use it on the cpu contexts unless
+// BIGAUSSIAN_VEC_SCALAR is defined; the gpu contexts keep one particle per
+// thread.
+#ifndef BIGAUSSIAN_VEC_TILE
+#define BIGAUSSIAN_VEC_TILE 64
+#endif
+#if !defined(BIGAUSSIAN_VEC_SCALAR)
+#define BIGAUSSIAN_VEC_USE_TILES //only_for_context cpu_serial cpu_openmp
+#endif
+
+/*gpufun*/
+void get_transv_field_gauss_ellip_vec(
+        int64_t const n,
+        double const sigma_x, double const sigma_y,
+        double const Delta_x, double const Delta_y,
+        const double* x,
+        const double* y,
+        double* Ex_out,
+        double* Ey_out)
+{
+  // Same as get_transv_field_gauss_ellip for n <= BIGAUSSIAN_VEC_TILE points.
+  // The two Faddeeva arguments of each point are stacked in one batch.
+
+  double w_arg_re[2*BIGAUSSIAN_VEC_TILE], w_arg_im[2*BIGAUSSIAN_VEC_TILE];
+  double w_re[2*BIGAUSSIAN_VEC_TILE], w_im[2*BIGAUSSIAN_VEC_TILE];
+  double ab_1[BIGAUSSIAN_VEC_TILE], ab_2[BIGAUSSIAN_VEC_TILE];
+
+  if (sigma_x == sigma_y){
+    for (int64_t ii=0; ii<n; ii++){
+      Ex_out[ii] = 0.;
+      Ey_out[ii] = 0.;
+    }
+    return;
+  }
+
+  // I always go to the first quadrant and then apply the signs a posteriori,
+  // with axis 1 along the larger sigma
+  const int swap_xy = sigma_x < sigma_y;
+  const double sigma_1 = swap_xy ? sigma_y : sigma_x;
+  const double sigma_2 = swap_xy ? sigma_x : sigma_y;
+
+  const double S = sqrt(2.*(sigma_1*sigma_1-sigma_2*sigma_2));
+  const double factBE = 1./(2.*EPSILON_0*SQRT_PI*S);
+
+  for (int64_t ii=0; ii<n; ii++){
+    const double abx = fabs(x[ii] - Delta_x);
+    const double aby = fabs(y[ii] - Delta_y);
+    ab_1[ii] = swap_xy ? aby : abx;
+    ab_2[ii] = swap_xy ? abx : aby;
+
+    // zeta
+    w_arg_re[ii] = ab_1[ii]/S;
+    w_arg_im[ii] = ab_2[ii]/S;
+    // eta
+    w_arg_re[n+ii] = (sigma_2/sigma_1*ab_1[ii])/S;
+    w_arg_im[n+ii] = (sigma_1/sigma_2*ab_2[ii])/S;
+  }
+
+  faddeeva_w_vec(2*n, w_arg_re, w_arg_im, w_re, w_im);
+
+  for (int64_t ii=0; ii<n; ii++){
+    const double expBE = exp(-ab_1[ii]*ab_1[ii]/(2*sigma_1*sigma_1)
+                             -ab_2[ii]*ab_2[ii]/(2*sigma_2*sigma_2));
+
+    const double E1 = factBE*(w_im[ii] - w_im[n+ii]*expBE);
+    const double E2 = factBE*(w_re[ii] - w_re[n+ii]*expBE);
+
+    double Ex = swap_xy ? E2 : E1;
+    double Ey = swap_xy ? E1 : E2;
+
+    if((x[ii] - Delta_x)<0) Ex=-Ex;
+    if((y[ii] - Delta_y)<0) Ey=-Ey;
+
+    Ex_out[ii] = Ex;
+    Ey_out[ii] = Ey;
+  }
+}
+
+/*gpufun*/
+void get_Ex_Ey_gauss_vec(
+             int64_t const n,
+             const double* x,
+             const double* y,
+             const double  sigma_x,
+             const double  sigma_y,
+             const double  min_sigma_diff,
+             double* Ex,
+             double* Ey){
+
+    // Same as get_Ex_Ey_gauss for n <= BIGAUSSIAN_VEC_TILE points
+
+    // round beam
+    if (fabs(sigma_x-sigma_y)< min_sigma_diff){
+        double sigma = 0.5*(sigma_x+sigma_y);
+        for (int64_t ii=0; ii<n; ii++){
+            get_transv_field_gauss_round(sigma, 0., 0., x[ii], y[ii],
+                                         &Ex[ii], &Ey[ii]);
+        }
+    }
+
+    // elliptical beam
+    else{
+        get_transv_field_gauss_ellip_vec(
+                n, sigma_x, sigma_y, 0., 0., x, y, Ex, Ey);
+    }
+}
+
+#ifdef BIGAUSSIAN_VEC_USE_TILES
+// Particles waiting for the field of a bigaussian beam: the particle index,
+// the position w.r.t. the beam centroid and a kick factor (per particle)
+typedef struct {
+    int64_t n;
+    int64_t ipart[BIGAUSSIAN_VEC_TILE];
+    double x[BIGAUSSIAN_VEC_TILE];
+    double y[BIGAUSSIAN_VEC_TILE];
+    double factor[BIGAUSSIAN_VEC_TILE];
+    double Ex[BIGAUSSIAN_VEC_TILE];
+    double Ey[BIGAUSSIAN_VEC_TILE];
+} BiGaussianParticleTile;
+
+/*gpufun*/
+int BiGaussianParticleTile_add(BiGaussianParticleTile* tile,
+        int64_t const ipart, double const x, double const y,
+        double const factor){
+
+    // Returns 1 when the tile is full
+    tile->ipart[tile->n] = ipart;
+    tile->x[tile->n] = x;
+    tile->y[tile->n] = y;
+    tile->factor[tile->n] = factor;
+    tile->n++;
+    return tile->n == BIGAUSSIAN_VEC_TILE;
+}
+#endif
+
+/*gpufun*/
+int gauss_table_is_valid(
+             const double  sigma_x,
+             const double  sigma_y,
+             const double  table_sigma_x,
+             const double  table_sigma_y,
+             const double  min_sigma_diff){
+
+    // A field table can be used only while sigma_y/sigma_x is the one it
+    // was built for (round beams are cheaper with the exact formula)
+    if (fabs(sigma_x-sigma_y) < min_sigma_diff) return 0;
+    return fabs(sigma_y*table_sigma_x - sigma_x*table_sigma_y)
+                <= 1e-12 * sigma_x * table_sigma_y;
+}
+
+/*gpufun*/
+void get_Ex_Ey_gauss_table(
+    /*gpuglmem*/ const double* table_ex,
+    /*gpuglmem*/ const double* table_ey,
+             const int64_t n_u,
+             const int64_t n_v,
+             const double  du,
+             const double  dv,
+             const int64_t n_multipoles,
+             const double  x,
+             const double  y,
+             const double  sigma_x,
+             const double  sigma_y,
+             double* Ex_ptr,
+             double* Ey_ptr){
+
+    // Normalized field tabulated by _build_field_table (bigaussian.py)
+    // on a grid in (|x|/sigma_x, |y|/sigma_y), with one extra node on each
+    // side, stored as E*sigma_x
+    const double u = fabs(x) / sigma_x / du;
+    const double v = fabs(y) / sigma_y / dv;
+
+    double Ex, Ey;
+
+    if (u < n_u && v < n_v){
+
+        const int64_t iu = (int64_t) u;
+        const int64_t iv = (int64_t) v;
+        const double tu = u - iu;
+        const double tv = v - iv;
+
+        // Cubic Lagrange weights on the nodes iu-1 ... iu+2
+        const double wu[4] = {-tu*(tu-1.)*(tu-2.)/6., (tu+1.)*(tu-1.)*(tu-2.)/2.,
+                              -(tu+1.)*tu*(tu-2.)/2., (tu+1.)*tu*(tu-1.)/6.};
+        const double wv[4] = {-tv*(tv-1.)*(tv-2.)/6., (tv+1.)*(tv-1.)*(tv-2.)/2.,
+                              -(tv+1.)*tv*(tv-2.)/2., (tv+1.)*tv*(tv-1.)/6.};
+
+        const int64_t stride = n_v + 3;
+
+        Ex = 0.;
+        Ey = 0.;
+        for (int aa=0; aa<4; aa++){
+            const int64_t row = (iu + aa) * stride + iv;
+            double ex_row = 0.;
+            double ey_row = 0.;
+            for (int bb=0; bb<4; bb++){
+                ex_row += wv[bb] * table_ex[row + bb];
+                ey_row += wv[bb] * table_ey[row + bb];
+            }
+            Ex += wu[aa] * ex_row;
+            Ey += wu[aa] * ey_row;
+        }
+        Ex /= sigma_x;
+        Ey /= sigma_x;
+
+        if (x < 0) Ex = -Ex;
+        if (y < 0) Ey = -Ey;
+    }
+    else {
+        // Far field, multipole expansion of the Gaussian distribution:
+        // Ex - i*Ey = 1/(2 pi eps0) sum_k (2k-1)!! Delta^k / z^(2k+1)
+        const double delta = sigma_x*sigma_x - sigma_y*sigma_y;
+        const double inv_r2 = 1. / (x*x + y*y);
+        // 1/z and 1/z^2
+        const double inv_z_re = x * inv_r2;
+        const double inv_z_im = -y * inv_r2;
+        const double inv_z2_re = inv_z_re*inv_z_re - inv_z_im*inv_z_im;
+        const double inv_z2_im = 2.*inv_z_re*inv_z_im;
+
+        double term_re = inv_z_re;
+        double term_im = inv_z_im;
+        double sum_re = term_re;
+        double sum_im = term_im;
+        for (int64_t kk=1; kk<=n_multipoles; kk++){
+            const double fact = (2*kk - 1) * delta;
+            const double re = fact * (term_re*inv_z2_re - term_im*inv_z2_im);
+            const double im = fact * (term_re*inv_z2_im + term_im*inv_z2_re);
+            term_re = re;
+            term_im = im;
+            sum_re += term_re;
+            sum_im += term_im;
+        }
+        Ex = sum_re / (2.*PI*EPSILON_0);
+        Ey = -sum_im / (2.*PI*EPSILON_0);
+    }
+
+    *Ex_ptr = Ex;
+    *Ey_ptr = Ey;
+}
+
 #endif // XFIELDS_BIGAUSSIAN_H
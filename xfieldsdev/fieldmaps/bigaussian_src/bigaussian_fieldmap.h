@@ -6,6 +6,20 @@
 #ifndef XFIELDS_BIGAUSSIAN_H_FIELDMAP
 #define XFIELDS_BIGAUSSIAN_H_FIELDMAP
 
+/*gpufun*/
+int BiGaussianFieldMap_uses_table(BiGaussianFieldMapData fmap){
+
+    // The tabulated field is used if it is enabled and valid for the
+    // current sigmas, otherwise the exact formula is used
+    return BiGaussianFieldMapData_get__field_engine(fmap) == 1
+            && gauss_table_is_valid(
+                        BiGaussianFieldMapData_get_sigma_x(fmap),
+                        BiGaussianFieldMapData_get_sigma_y(fmap),
+                        BiGaussianFieldMapData_get__table_sigma_x(fmap),
+                        BiGaussianFieldMapData_get__table_sigma_y(fmap),
+                        BiGaussianFieldMapData_get_min_sigma_diff(fmap));
+}
+
 /*gpufun*/
 void BiGaussianFieldMap_get_dphi_dx_dphi_dy(
            BiGaussianFieldMapData fmap,
@@ -21,7 +35,24 @@ void BiGaussianFieldMap_get_dphi_dx_dphi_dy(
     const double min_sigma_diff = BiGaussianFieldMapData_get_min_sigma_diff(fmap);
 
     double Ex, Ey;
-    get_Ex_Ey_gauss(
+    if (BiGaussianFieldMap_uses_table(fmap)){
+        get_Ex_Ey_gauss_table(
+             BiGaussianFieldMapData_getp1__table_ex(fmap, 0),
+             BiGaussianFieldMapData_getp1__table_ey(fmap, 0),
+             BiGaussianFieldMapData_get__table_n_u(fmap),
+             BiGaussianFieldMapData_get__table_n_v(fmap),
+             BiGaussianFieldMapData_get__table_du(fmap),
+             BiGaussianFieldMapData_get__table_dv(fmap),
+             BiGaussianFieldMapData_get__table_n_multipoles(fmap),
+             x-mean_x,
+             y-mean_y,
+             sigma_x,
+             sigma_y,
+             &Ex,
+             &Ey);
+    }
+    else {
+        get_Ex_Ey_gauss(
              x-mean_x,
              y-mean_y,
              sigma_x,
@@ -29,6 +60,7 @@ void BiGaussianFieldMap_get_dphi_dx_dphi_dy(
              min_sigma_diff,
              &Ex,
              &Ey);
+    }
 
     *dphi_dx = -Ex;
     *dphi_dy = -Ey;
@@ -8,6 +8,7 @@
 
 //include_file faddeeva_cernlib.h for_context opencl cuda cpu_openmp
 //include_file faddeeva_mit.h for_context cpu_serial
+//include_file faddeeva_vec.h for_context opencl cuda cpu_openmp cpu_serial
 
 #endif /* XFIELDS_FADDEEVA_H */
 
@@ -0,0 +1,261 @@
+// copyright ################################# //
+// This file is part of the Xfields Package.   //
+// Copyright (c) CERN, 2026.                   //
+// ########################################### //
+
+#ifndef XFIELDS_FADDEEVA_VEC_H
+#define XFIELDS_FADDEEVA_VEC_H
+
+/** \file faddeeva_vec.h
+  * \brief batch evaluation of the Faddeeva function w(z)
+  * \note always include headers/constants.h, headers/sincos.h and
+  *       faddeeva.h first! */
+
+#include <stdint.h>   //only_for_context cpu_serial cpu_openmp
+#include <math.h>     //only_for_context cpu_serial cpu_openmp
+
+/* Same parameters as faddeeva_cernlib.h (Gautschi's algorithm with a target
+ * accuracy of < 0.5 x 10^{-10} in the *absolute* error). They are repeated
+ * here since on cpu_serial the scalar faddeeva_w comes from faddeeva_mit.h */
+
+#if !defined( FADDEEVA_X_LIMIT )
+    #define FADDEEVA_X_LIMIT 5.33
+#endif /* !defined( FADDEEVA_X_LIMIT ) */
+
+#if !defined( FADDEEVA_Y_LIMIT )
+    #define FADDEEVA_Y_LIMIT 4.29
+#endif /* !defined( FADDEEVA_Y_LIMIT ) */
+
+#if !defined( FADDEEVA_H0 )
+    #define FADDEEVA_H0 1.6
+#endif /* !defined( FADDEEVA_H0 ) */
+
+#if !defined( FADDEEVA_NU_0 )
+    #define FADDEEVA_NU_0 10
+#endif /* !defined( FADDEEVA_NU_0 ) */
+
+#if !defined( FADDEEVA_NU_1 )
+    #define FADDEEVA_NU_1 21
+#endif /* !defined( FADDEEVA_NU_1 ) */
+
+#if !defined( FADDEEVA_N0 )
+    #define FADDEEVA_N0 7
+#endif /* !defined( FADDEEVA_N0 ) */
+
+#if !defined( FADDEEVA_N1 )
+    #define FADDEEVA_N1 23
+#endif /* !defined( FADDEEVA_N1 ) */
+
+#if !defined( FADDEEVA_CONT_FRAC_K )
+    #define FADDEEVA_CONT_FRAC_K 9
+#endif /* !defined( FADDEEVA_CONT_FRAC_K ) */
+
+/* Number of arguments processed together. 8 doubles fill one AVX-512
+ * register (two AVX2 registers) */
+#if !defined( FADDEEVA_VEC_LANES )
+    #define FADDEEVA_VEC_LANES 8
+#endif /* !defined( FADDEEVA_VEC_LANES ) */
+
+/* On the cpu contexts the masked lane kernel is used unless
+ * FADDEEVA_VEC_SCALAR is defined; gpu contexts always use the scalar loop */
+#if !defined( FADDEEVA_VEC_SCALAR )
+    #define FADDEEVA_VEC_USE_LANES //only_for_context cpu_serial cpu_openmp
+#endif /* !defined( FADDEEVA_VEC_SCALAR ) */
+
+#ifdef FADDEEVA_VEC_USE_LANES
+
+/** \fn void faddeeva_w_q1_lanes( double const*, double const*, double*, double* )
+ *  \brief calculates w(z) for FADDEEVA_VEC_LANES arguments z = x + i * y in Q1
+ *
+ *  Branch-free formulation of faddeeva_w_q1 from faddeeva_cernlib.h: all
+ *  lanes run the recursion steps of the deepest lane and the continued
+ *  fraction and Taylor updates are masked per lane, so that the compiler can
+ *  map the lane loops onto SIMD registers (AVX2 / AVX-512).
+ *
+ *  \warning assumes x >= 0 and y >= 0
+ */
+
+/*gpufun*/ void faddeeva_w_q1_lanes(
+    double const* /*restrict*/ x, double const* /*restrict*/ y,
+    double* /*restrict*/ out_x, double* /*restrict*/ out_y )
+{
+    int const N_max  = ( int )FADDEEVA_N0 + ( int )FADDEEVA_N1;
+
+    double y_plus_h[ FADDEEVA_VEC_LANES ];
+    double inv_h2[ FADDEEVA_VEC_LANES ];
+    double h2_n[ FADDEEVA_VEC_LANES ];
+    double two_h[ FADDEEVA_VEC_LANES ];
+    double Rx[ FADDEEVA_VEC_LANES ];
+    double Ry[ FADDEEVA_VEC_LANES ];
+    double Sx[ FADDEEVA_VEC_LANES ];
+    double Sy[ FADDEEVA_VEC_LANES ];
+    int nu[ FADDEEVA_VEC_LANES ];
+    int N[ FADDEEVA_VEC_LANES ];
+    int use_taylor_sum[ FADDEEVA_VEC_LANES ];
+
+    /* Region split: inside R_0 truncated Taylor expansion, outside
+     * continued fraction only (N = 0) */
+    for( int ll = 0 ; ll < FADDEEVA_VEC_LANES ; ++ll )
+    {
+        int const in_r0 = ( y[ ll ] < ( double )FADDEEVA_Y_LIMIT ) &&
+                          ( x[ ll ] < ( double )FADDEEVA_X_LIMIT );
+
+        #if !defined( FADDEEVA_NO_GZ_WEIGHT_FN )
+        double temp = x[ ll ] * ( ( double )1. / ( double )FADDEEVA_X_LIMIT );
+        temp  = ( ( double )1.0 + temp ) * ( ( double )1.0 - temp );
+        temp  = sqrt( in_r0 ? temp : ( double )0. );
+        temp *= ( double )1. - y[ ll ] * ( ( double )1. / ( double )FADDEEVA_Y_LIMIT );
+        #else /* !defined( FADDEEVA_NO_GZ_WEIGHT_FN ) */
+        double temp = ( double )1.;
+        #endif /* defined( FADDEEVA_NO_GZ_WEIGHT_FN ) */
+        temp = in_r0 ? temp : ( double )0.; /* g(z) */
+
+        double const h = ( double )FADDEEVA_H0 * temp;
+
+        nu[ ll ] = in_r0
+            ? ( int )FADDEEVA_NU_0 + ( int )( ( double )FADDEEVA_NU_1 * temp )
+            : ( int )FADDEEVA_CONT_FRAC_K;
+        N[ ll ]  = in_r0
+            ? ( int )FADDEEVA_N0 + ( int )( ( double )FADDEEVA_N1 * temp ) : 0;
+
+        y_plus_h[ ll ] = y[ ll ] + h;
+        two_h[ ll ]    = ( double )2. * h;
+        inv_h2[ ll ]   = in_r0 ? ( double )1. / two_h[ ll ] : ( double )1.;
+        h2_n[ ll ]     = ( double )1.;
+        Rx[ ll ] = Ry[ ll ] = Sx[ ll ] = Sy[ ll ] = ( double )0.;
+    }
+
+    /* h2_n = (2*h(z))^(N-1), with a fixed trip count */
+    for( int kk = 1 ; kk < N_max ; ++kk )
+    {
+        for( int ll = 0 ; ll < FADDEEVA_VEC_LANES ; ++ll )
+        {
+            h2_n[ ll ] = ( kk < N[ ll ] ) ? h2_n[ ll ] * two_h[ ll ] : h2_n[ ll ];
+        }
+    }
+
+    /* As in faddeeva_w_q1: if h(z) is practically 0, keep the continued
+     * fraction result */
+    for( int ll = 0 ; ll < FADDEEVA_VEC_LANES ; ++ll )
+    {
+        use_taylor_sum[ ll ] = ( N[ ll ] > 0 ) &&
+                               ( h2_n[ ll ] > ( double )REAL_EPSILON );
+    }
+
+    /* The group only needs as many steps as its deepest lane */
+    int n_start = 0;
+    for( int ll = 0 ; ll < FADDEEVA_VEC_LANES ; ++ll )
+    {
+        n_start = ( nu[ ll ] > n_start ) ? nu[ ll ] : n_start;
+    }
+
+    /* Masked recursion: the continued fraction is active for n <= nu,
+     * the Taylor sum for n <= N */
+    for( int n = n_start ; n > 0 ; --n )
+    {
+        double const nn = ( double )n;
+
+        for( int ll = 0 ; ll < FADDEEVA_VEC_LANES ; ++ll )
+        {
+            double const Wx   = y_plus_h[ ll ] + nn * Rx[ ll ];
+            double const Wy   = x[ ll ] - nn * Ry[ ll ];
+            double const temp = ( double )1.0 / ( ( Wx * Wx ) + ( Wy * Wy ) );
+            double const Rx_n = ( double )0.5 * Wx * temp;
+            double const Ry_n = ( double )0.5 * Wy * temp;
+
+            double const Tx   = h2_n[ ll ] + Sx[ ll ];
+            double const Sx_n = Rx_n * Tx - Ry_n * Sy[ ll ];
+            double const Sy_n = Ry_n * Tx + Rx_n * Sy[ ll ];
+
+            int const use_cf = ( n <= nu[ ll ] );
+            int const use_t  = ( n <= N[ ll ] );
+
+            Rx[ ll ]   = use_cf ? Rx_n : Rx[ ll ];
+            Ry[ ll ]   = use_cf ? Ry_n : Ry[ ll ];
+            Sx[ ll ]   = use_t ? Sx_n : Sx[ ll ];
+            Sy[ ll ]   = use_t ? Sy_n : Sy[ ll ];
+            h2_n[ ll ] = use_t ? h2_n[ ll ] * inv_h2[ ll ] : h2_n[ ll ];
+        }
+    }
+
+    for( int ll = 0 ; ll < FADDEEVA_VEC_LANES ; ++ll )
+    {
+        out_x[ ll ] = ( double )TWO_OVER_SQRT_PI *
+                      ( use_taylor_sum[ ll ] ? Sx[ ll ] : Rx[ ll ] );
+        out_y[ ll ] = ( double )TWO_OVER_SQRT_PI *
+                      ( use_taylor_sum[ ll ] ? Sy[ ll ] : Ry[ ll ] );
+    }
+}
+
+#endif /* FADDEEVA_VEC_USE_LANES */
+
+/** \fn void faddeeva_w_vec( int64_t, double const*, double const*, double*, double* )
+ *  \brief calculates w(z) for n arguments z = x[i] + i * y[i]
+ *
+ *  On the cpu contexts the arguments are processed in groups of
+ *  FADDEEVA_VEC_LANES by faddeeva_w_q1_lanes, followed by the same
+ *  quadrant transformation as faddeeva_w. On the gpu contexts (or with
+ *  FADDEEVA_VEC_SCALAR defined) it loops over faddeeva_w.
+ *
+ *  \param[in] n number of arguments
+ *  \param[in] x real components of the arguments
+ *  \param[in] y imaginary components of the arguments
+ *  \param[out] wr real components of the results
+ *  \param[out] wi imaginary components of the results
+ */
+
+/*gpufun*/ void faddeeva_w_vec( int64_t const n,
+    double const* /*restrict*/ x, double const* /*restrict*/ y,
+    double* /*restrict*/ wr, double* /*restrict*/ wi )
+{
+    #ifdef FADDEEVA_VEC_USE_LANES
+    double ax[ FADDEEVA_VEC_LANES ];
+    double ay[ FADDEEVA_VEC_LANES ];
+    double Wx[ FADDEEVA_VEC_LANES ];
+    double Wy[ FADDEEVA_VEC_LANES ];
+
+    for( int64_t i0 = 0 ; i0 < n ; i0 += FADDEEVA_VEC_LANES )
+    {
+        int64_t const n_lanes = ( n - i0 < FADDEEVA_VEC_LANES )
+                              ? n - i0 : FADDEEVA_VEC_LANES;
+
+        /* Move to Q1; unused lanes of the last group get a dummy argument */
+        for( int ll = 0 ; ll < FADDEEVA_VEC_LANES ; ++ll )
+        {
+            ax[ ll ] = ( ll < n_lanes ) ? fabs( x[ i0 + ll ] ) : ( double )1.;
+            ay[ ll ] = ( ll < n_lanes ) ? fabs( y[ i0 + ll ] ) : ( double )1.;
+        }
+
+        faddeeva_w_q1_lanes( ax, ay, Wx, Wy );
+
+        for( int64_t ll = 0 ; ll < n_lanes ; ++ll )
+        {
+            double const xx = ax[ ll ];
+            double const yy = ay[ ll ];
+
+            if( y[ i0 + ll ] < ( double )0.0 )  /* Quadrants Q3 and Q4 */
+            {
+                double const exp_arg  = ( yy - xx ) * ( yy + xx );
+                double const trig_arg = ( double )2. * xx * yy;
+                double const exp_factor = ( double )2. * exp( exp_arg );
+                double sin_arg, cos_arg;
+
+                xsuite_sincos( trig_arg, &sin_arg, &cos_arg );
+                Wx[ ll ] = exp_factor * cos_arg - Wx[ ll ];
+                Wy[ ll ] = exp_factor * sin_arg + Wy[ ll ];
+            }
+
+            wr[ i0 + ll ] = Wx[ ll ];
+            /* Takes care of Quadrants Q2 and Q3 */
+            wi[ i0 + ll ] = ( x[ i0 + ll ] < ( double )0. ) ? -Wy[ ll ] : Wy[ ll ];
+        }
+    }
+    #else /* FADDEEVA_VEC_USE_LANES */
+    for( int64_t ii = 0 ; ii < n ; ++ii )
+    {
+        faddeeva_w( x[ ii ], y[ ii ], &wr[ ii ], &wi[ ii ] );
+    }
+    #endif /* FADDEEVA_VEC_USE_LANES */
+}
+
+#endif /* XFIELDS_FADDEEVA_VEC_H */
@@ -3,15 +3,25 @@
 # Copyright (c) CERN, 2021.                   #
 # ########################################### #
 
+import os
+
 import numpy as np
 
 import xobjects as xo
 import xpart as xp
 import xtrack as xt
+from scipy.constants import e as qe
 
-from ..solvers.fftsolvers import FFTSolver3D, FFTSolver2p5D, FFTSolver2p5DAveraged
+from ..solvers.fftsolvers import (FFTSolver3D, FFTSolver2p5D,
+                                  FFTSolver2p5DAveraged,
+                                  FFTSolver3DR2C, FFTSolver2p5DR2C,
+                                  FFTSolver3DPruned)
 from ..general import _pkg_root
 
+# Upper limit for the memory used by the per-thread grids in the charge
+# deposition (see ``deposition_mode``)
+PRIVATE_GRIDS_MAX_BYTES = 256 * 2**20
+
 _TriLinearInterpolatedFielmap_kernels = {
     'central_diff': xo.Kernel(
         args=[
@@ -66,6 +76,62 @@ _TriLinearInterpolatedFielmap_kernels = {
             ],
         n_threads='nparticles'
         ),
+    'p2m_rectmesh3d_private_grids': xo.Kernel(
+        args=[
+            xo.Arg(xo.Int32,   pointer=False, name='nparticles'),
+            xo.Arg(xo.Float64, pointer=True, name='x'),
+            xo.Arg(xo.Float64, pointer=True, name='y'),
+            xo.Arg(xo.Float64, pointer=True, name='z'),
+            xo.Arg(xo.Float64, pointer=True, name='part_weights'),
+            xo.Arg(xo.Float64, pointer=False, name='weight_factor'),
+            xo.Arg(xo.Int64,   pointer=True, name='part_state'),
+            xo.Arg(xo.Float64, pointer=False, name='x0'),
+            xo.Arg(xo.Float64, pointer=False, name='y0'),
+            xo.Arg(xo.Float64, pointer=False, name='z0'),
+            xo.Arg(xo.Float64, pointer=False, name='dx'),
+            xo.Arg(xo.Float64, pointer=False, name='dy'),
+            xo.Arg(xo.Float64, pointer=False, name='dz'),
+            xo.Arg(xo.Int32,   pointer=False, name='nx'),
+            xo.Arg(xo.Int32,   pointer=False, name='ny'),
+            xo.Arg(xo.Int32,   pointer=False, name='nz'),
+            xo.Arg(xo.Int32,   pointer=False, name='n_private_grids'),
+            xo.Arg(xo.Float64, pointer=True,  name='private_grids'),
+            xo.Arg(xo.Int8,    pointer=True,  name='grid1d_buffer'),
+            xo.Arg(xo.Int64,   pointer=False, name='grid1d_offset'),
+            ],
+        ),
+    'TriLinearInterpolatedFieldMap_phi_and_gradient_from_workspace': xo.Kernel(
+        args=[
+            xo.Arg(xo.ThisClass, pointer=False, name='fmap'),
+            xo.Arg(xo.Int64,   pointer=False, name='nelem'),
+            xo.Arg(xo.Int64,   pointer=False, name='ws_nx'),
+            xo.Arg(xo.Int64,   pointer=False, name='ws_ny'),
+            xo.Arg(xo.Int64,   pointer=False, name='ws_elem_size'),
+            xo.Arg(xo.Float64, pointer=True,  name='workspace'),
+            ],
+        n_threads='nelem'
+        ),
+    'TriLinearInterpolatedFieldMap_cell_keys': xo.Kernel(
+        args=[
+            xo.Arg(xo.ThisClass, pointer=False, name='fmap'),
+            xo.Arg(xo.Int64,   pointer=False, name='nparticles'),
+            xo.Arg(xo.Float64, pointer=True,  name='x'),
+            xo.Arg(xo.Float64, pointer=True,  name='y'),
+            xo.Arg(xo.Float64, pointer=True,  name='z'),
+            xo.Arg(xo.Int64,   pointer=True,  name='part_state'),
+            xo.Arg(xo.Int64,   pointer=True,  name='keys'),
+            ],
+        n_threads='nparticles'
+        ),
+    'cell_counting_sort': xo.Kernel(
+        args=[
+            xo.Arg(xo.Int64,   pointer=False, name='nparticles'),
+            xo.Arg(xo.Int64,   pointer=True,  name='keys'),
+            xo.Arg(xo.Int64,   pointer=False, name='n_keys'),
+            xo.Arg(xo.Int64,   pointer=True,  name='key_count'),
+            xo.Arg(xo.Int64,   pointer=True,  name='sorted_indices'),
+            ],
+        ),
     'TriLinearInterpolatedFieldMap_interpolate_3d_map_vector': xo.Kernel(
         args=[
             xo.Arg(xo.ThisClass, pointer=False, name='fmap'),
@@ -122,8 +188,13 @@ class TriLinearInterpolatedFieldMap(xo.HybridClass):
             Volts. If not provided the ``phi`` is calculated from ``rho``
             using the Poisson solver (if available).
         solver (str or solver object): Defines the Poisson solver to be used
-            to compute phi from rho. Accepted values are ``FFTSolver3D`` and
-            ``FFTSolver2p5D``. A Xfields solver object can also be provided.
+            to compute phi from rho. Accepted values are ``FFTSolver3D``,
+            ``FFTSolver2p5D``, ``FFTSolver2p5DAveraged`` and the
+            real-to-complex variants ``FFTSolver3DR2C`` and
+            ``FFTSolver2p5DR2C`` (half memory, CPU and cupy only) and
+            ``FFTSolver3DPruned`` (skips the FFTs on the zero padding, CPU
+            and cupy only).
+            A Xfields solver object can also be provided.
             In case ``update_on_track``is ``False`` and ``phi`` is provided
             by the user, this argument can be omitted.
         scale_coordinates_in_solver (tuple): Three coefficients used to rescale
@@ -131,6 +202,24 @@ class TriLinearInterpolatedFieldMap(xo.HybridClass):
             (1.,1.,1.).
         updatable (bool): If ``True`` the field map can be updated after
             creation. Default is ``True``.
+        fftplan (FFT plan): FFT plan to be used by the generated solver.
+        fft_workspace (complex128 array): Workspace to be used by the
+            generated solver (can be shared among maps with the same grid
+            size).
+        deposition_mode (str): Strategy used to deposit the charge of the
+            particles on the grid. With ``'atomic'`` all threads add to the
+            same grid using atomic operations. With ``'private_grids'``
+            (CPU contexts only) each thread deposits on its own copy of the
+            grid and the copies are summed at the end, which avoids the
+            contention on the atomics and gives a result that does not depend
+            on the thread scheduling. With ``'auto'`` (default) private grids
+            are used on multi-threaded CPU contexts when the grid is small
+            compared to the number of particles.
+        interleaved_gradient (bool): If ``True`` the three components of the
+            gradient of phi are also stored interleaved per grid node, so that
+            the tracking reads them from a contiguous memory chunk per node.
+            It requires three more arrays of the size of the grid. The
+            default is ``False``.
     Returns:
         (TriLinearInterpolatedFieldMap): Interpolator object.
     """
@@ -150,6 +239,7 @@ class TriLinearInterpolatedFieldMap(xo.HybridClass):
         'dphi_dx': xo.Float64[:],
         'dphi_dy': xo.Float64[:],
         'dphi_dz': xo.Float64[:],
+        'grad_xyz': xo.Float64[:],
     }
 
     # I add undescores in front of the names so that I can define custom
@@ -162,6 +252,8 @@ class TriLinearInterpolatedFieldMap(xo.HybridClass):
         _pkg_root.joinpath('fieldmaps/interpolated_src/central_diff.h'),
         _pkg_root.joinpath('fieldmaps/interpolated_src/linear_interpolators.h'),
         _pkg_root.joinpath('fieldmaps/interpolated_src/charge_deposition.h'),
+        _pkg_root.joinpath('fieldmaps/interpolated_src/cell_sort.h'),
+        _pkg_root.joinpath('fieldmaps/interpolated_src/phi_and_gradient.h'),
         ]
 
     _depends_on = [xp.Particles]
@@ -181,7 +273,10 @@ class TriLinearInterpolatedFieldMap(xo.HybridClass):
                  solver=None,
                  scale_coordinates_in_solver=(1.,1.,1.),
                  updatable=True,
-                 fftplan=None
+                 fftplan=None,
+                 fft_workspace=None,
+                 deposition_mode='auto',
+                 interleaved_gradient=False
                  ):
 
         if _xobject is not None:
@@ -189,7 +284,11 @@ class TriLinearInterpolatedFieldMap(xo.HybridClass):
                              _buffer=_buffer, _offset=_offset)
             return
 
+        assert deposition_mode in ['auto', 'atomic', 'private_grids'], (
+                f'deposition_mode {deposition_mode} not recognized')
+
         self.updatable = updatable
+        self.deposition_mode = deposition_mode
         self.scale_coordinates_in_solver = scale_coordinates_in_solver
 
         self._x_grid = _configure_grid('x', x_grid, dx, x_range, nx)
@@ -214,12 +313,13 @@ class TriLinearInterpolatedFieldMap(xo.HybridClass):
                  phi = nelem,
                  dphi_dx = nelem,
                  dphi_dy = nelem,
-                 dphi_dz = nelem)
+                 dphi_dz = nelem,
+                 grad_xyz = (3*nelem if interleaved_gradient else 0))
 
         self.compile_kernels(only_if_needed=True)
 
         if isinstance(solver, str):
-            self.solver = self.generate_solver(solver, fftplan)
+            self.solver = self.generate_solver(solver, fftplan, fft_workspace)
         else:
             #TODO: consistency check to be added
             self.solver = solver
@@ -358,9 +458,39 @@ class TriLinearInterpolatedFieldMap(xo.HybridClass):
                 state_p = context.zeros(shape=x_p.shape, dtype=np.int64) + 1
             else:
                 assert len(state_p) == len(x_p)
-
+            nparticles = len(x_p)
+        else:
+            assert (x_p is None and y_p is None and z_p is None
+                    and ncharges_p is None and state_p is None)
+            nparticles = particles._capacity
+
+        n_private_grids = self._get_n_private_grids(nparticles)
+
+        if n_private_grids > 0:
+            if particles is not None:
+                x_p = particles.x
+                y_p = particles.y
+                z_p = particles.zeta
+                ncharges_p = particles.weight
+                state_p = particles.state
+                q0_coulomb = qe * particles.q0
+            context.kernels.p2m_rectmesh3d_private_grids(
+                    nparticles=nparticles,
+                    x=x_p, y=y_p, z=z_p,
+                    part_weights=ncharges_p,
+                    weight_factor=q0_coulomb,
+                    part_state=state_p,
+                    x0=self.x_grid[0], y0=self.y_grid[0], z0=self.z_grid[0],
+                    dx=self.dx, dy=self.dy, dz=self.dz,
+                    nx=self.nx, ny=self.ny, nz=self.nz,
+                    n_private_grids=n_private_grids,
+                    private_grids=self._get_private_grids(n_private_grids),
+                    grid1d_buffer=self._xobject.rho._buffer.buffer,
+                    grid1d_offset=self._xobject.rho._offset
+                                 +self._xobject.rho._data_offset)
+        elif particles is None:
             context.kernels.p2m_rectmesh3d(
-                    nparticles=len(x_p),
+                    nparticles=nparticles,
                     x=x_p, y=y_p, z=z_p,
                     part_weights=q0_coulomb*ncharges_p,
                     part_state=state_p,
@@ -371,10 +501,8 @@ class TriLinearInterpolatedFieldMap(xo.HybridClass):
                     grid1d_offset=self._xobject.rho._offset
                                  +self._xobject.rho._data_offset)
         else:
-            assert (x_p is None and y_p is None and z_p is None
-                    and ncharges_p is None and state_p is None)
             context.kernels.p2m_rectmesh3d_xparticles(
-                    nparticles=particles._capacity,
+                    nparticles=nparticles,
                     particles=particles,
                     x0=self.x_grid[0], y0=self.y_grid[0], z0=self.z_grid[0],
                     dx=self.dx, dy=self.dy, dz=self.dz,
@@ -391,6 +519,98 @@ class TriLinearInterpolatedFieldMap(xo.HybridClass):
         if update_phi:
             self.update_phi_from_rho(solver=solver)
 
+    def sort_particles_by_cell(self, particles):
+
+        """
+        Reorders the particles in place according to the grid cell in which
+        they are located, so that the charge deposition and the field
+        interpolation access the grid with a regular memory pattern.
+        Particles outside the grid follow the ones inside, lost particles are
+        moved to the end. The sort is stable, hence the outcome depends only
+        on the particle coordinates and on the initial order.
+
+        Args:
+            particles (xpart.Particles): Particles to be reordered.
+        Returns:
+            (int64 array): Permutation applied to the particles (new position
+                ``i`` holds the particle previously at ``sorted_indices[i]``).
+        """
+
+        context = self._buffer.context
+        nparticles = particles._capacity
+        n_keys = self.nx * self.ny * self.nz + 2
+
+        keys = context.zeros(shape=(nparticles,), dtype=np.int64)
+        context.kernels.TriLinearInterpolatedFieldMap_cell_keys(
+                fmap=self._xobject,
+                nparticles=nparticles,
+                x=particles.x, y=particles.y, z=particles.zeta,
+                part_state=particles.state,
+                keys=keys)
+
+        if isinstance(context, xo.ContextCpu):
+            if (not hasattr(self, '_sort_key_count')
+                    or len(self._sort_key_count) != n_keys):
+                self._sort_key_count = np.zeros(n_keys, dtype=np.int64)
+            sorted_indices = np.zeros(nparticles, dtype=np.int64)
+            context.kernels.cell_counting_sort(
+                    nparticles=nparticles,
+                    keys=keys,
+                    n_keys=n_keys,
+                    key_count=self._sort_key_count,
+                    sorted_indices=sorted_indices)
+        elif isinstance(context, xo.ContextCupy):
+            sorted_indices = context.nplike_lib.argsort(keys)
+        else:
+            raise NotImplementedError(
+                'Particle sorting is not available on this context')
+
+        for _, nn in particles.per_particle_vars:
+            vv = getattr(particles, nn)
+            vv[:] = vv[sorted_indices]
+
+        return sorted_indices
+
+    def _get_n_private_grids(self, nparticles):
+
+        """
+        Returns the number of per-thread grids to be used for the charge
+        deposition (0 means that the atomic deposition is used).
+        """
+
+        mode = getattr(self, 'deposition_mode', 'auto')
+        if mode == 'atomic':
+            return 0
+
+        context = self._buffer.context
+        if not isinstance(context, xo.ContextCpu):
+            if mode == 'private_grids':
+                raise NotImplementedError(
+                    'Private grids deposition is available only on CPU')
+            return 0
+
+        n_threads = _get_cpu_num_threads(context)
+        if mode == 'private_grids':
+            return n_threads
+
+        # auto: the private grids need to be cleared and summed, which costs
+        # n_threads * nelem operations against the 8 * nparticles atomic
+        # additions that they replace
+        nelem = self.nx * self.ny * self.nz
+        if (n_threads > 1
+                and n_threads * nelem <= 8 * nparticles
+                and n_threads * nelem * 8 <= PRIVATE_GRIDS_MAX_BYTES):
+            return n_threads
+        return 0
+
+    def _get_private_grids(self, n_private_grids):
+        nelem = self.nx * self.ny * self.nz
+        if (not hasattr(self, '_private_grids')
+                or len(self._private_grids) < n_private_grids * nelem):
+            self._private_grids = self._buffer.context.zeros(
+                    shape=(n_private_grids * nelem,), dtype=np.float64)
+        return self._private_grids
+
     def update_rho(self, rho, reset=True, force=False):
         """
         Updates the charge density on the grid.
@@ -473,6 +693,12 @@ class TriLinearInterpolatedFieldMap(xo.HybridClass):
                 res_offset = (self._xobject.dphi_dz._offset
                             + self._xobject.dphi_dz._data_offset))
 
+        if self.interleaved_gradient:
+            grad_xyz = self._grad_xyz.reshape((3, self.phi.size), order='F')
+            grad_xyz[0, :] = self._dphi_dx
+            grad_xyz[1, :] = self._dphi_dy
+            grad_xyz[2, :] = self._dphi_dz
+
     #@profile
     def update_phi_from_rho(self, solver=None):
 
@@ -495,18 +721,41 @@ class TriLinearInterpolatedFieldMap(xo.HybridClass):
             else:
                 raise ValueError('I have no solver to compute phi!')
 
-        new_phi = solver.solve(self.rho)
-        self.update_phi(new_phi)
+        context = self._buffer.context
+
+        if (hasattr(solver, 'solve_in_workspace')
+                and not isinstance(context, xo.ContextPyopencl)):
+            # Fused path: phi and its gradient are written directly from the
+            # solver workspace into the map in a single kernel
+            workspace = solver.solve_in_workspace(self.rho)
+            if workspace.dtype == np.complex128:
+                ws_elem_size = 2
+                ws_flat = workspace.ravel(order='F').view(np.float64)
+            else:
+                ws_elem_size = 1
+                ws_flat = workspace.ravel(order='F')
+            context.kernels.TriLinearInterpolatedFieldMap_phi_and_gradient_from_workspace(
+                    fmap=self._xobject,
+                    nelem=self.nx*self.ny*self.nz,
+                    ws_nx=workspace.shape[0],
+                    ws_ny=workspace.shape[1],
+                    ws_elem_size=ws_elem_size,
+                    workspace=ws_flat)
+        else:
+            new_phi = solver.solve(self.rho)
+            self.update_phi(new_phi)
 
-    def generate_solver(self, solver, fftplan):
+    def generate_solver(self, solver, fftplan, fft_workspace=None):
 
         """
         Generates a Poisson solver associated to the defined grid.
 
         Args:
             solver (str): Defines the Poisson solver to be used
-            to compute phi from rho. Accepted values are ``FFTSolver3D`` and
-            ``FFTSolver2p5D``.
+            to compute phi from rho. Accepted values are ``FFTSolver3D``,
+            ``FFTSolver2p5D``, ``FFTSolver2p5DAveraged``,
+            ``FFTSolver3DR2C``, ``FFTSolver2p5DR2C`` and
+            ``FFTSolver3DPruned``.
         Returns:
             (Solver): Solver object associated to the defined grid.
         """
@@ -520,7 +769,8 @@ class TriLinearInterpolatedFieldMap(xo.HybridClass):
                     dz=self.dz*scale_dz,
                     nx=self.nx, ny=self.ny, nz=self.nz,
                     context=self._buffer.context,
-                    fftplan=fftplan)
+                    fftplan=fftplan,
+                    workspace=fft_workspace)
         elif solver == 'FFTSolver2p5D':
             solver = FFTSolver2p5D(
                     dx=self.dx*scale_dx,
@@ -528,7 +778,31 @@ class TriLinearInterpolatedFieldMap(xo.HybridClass):
                     dz=self.dz*scale_dz,
                     nx=self.nx, ny=self.ny, nz=self.nz,
                     context=self._buffer.context,
-                    fftplan=fftplan)
+                    fftplan=fftplan,
+                    workspace=fft_workspace)
+        elif solver == 'FFTSolver3DR2C':
+            solver = FFTSolver3DR2C(
+                    dx=self.dx*scale_dx,
+                    dy=self.dy*scale_dy,
+                    dz=self.dz*scale_dz,
+                    nx=self.nx, ny=self.ny, nz=self.nz,
+                    context=self._buffer.context,
+                    workspace=fft_workspace)
+        elif solver == 'FFTSolver2p5DR2C':
+            solver = FFTSolver2p5DR2C(
+                    dx=self.dx*scale_dx,
+                    dy=self.dy*scale_dy,
+                    dz=self.dz*scale_dz,
+                    nx=self.nx, ny=self.ny, nz=self.nz,
+                    context=self._buffer.context,
+                    workspace=fft_workspace)
+        elif solver == 'FFTSolver3DPruned':
+            solver = FFTSolver3DPruned(
+                    dx=self.dx*scale_dx,
+                    dy=self.dy*scale_dy,
+                    dz=self.dz*scale_dz,
+                    nx=self.nx, ny=self.ny, nz=self.nz,
+                    context=self._buffer.context)
         elif solver == 'FFTSolver2p5DAveraged':
             solver = FFTSolver2p5DAveraged(
                     dx=self.dx*scale_dx,
@@ -536,7 +810,8 @@ class TriLinearInterpolatedFieldMap(xo.HybridClass):
                     dz=self.dz*scale_dz,
                     nx=self.nx, ny=self.ny, nz=self.nz,
                     context=self._buffer.context,
-                    fftplan=fftplan)
+                    fftplan=fftplan,
+                    workspace=fft_workspace)
         else:
             raise ValueError(f'solver name {solver} not recognized')
 
@@ -605,6 +880,13 @@ class TriLinearInterpolatedFieldMap(xo.HybridClass):
         """
         return self.z_grid[1] - self.z_grid[0]
 
+    @property
+    def interleaved_gradient(self):
+        """
+        ``True`` if the gradient of phi is also stored interleaved per node.
+        """
+        return len(self._grad_xyz) > 0
+
     # TODO: these reshapes can be avoided by allocating 3d arrays directly in the xobject
     @property
     def rho(self):
@@ -636,6 +918,12 @@ class TriLinearInterpolatedFieldMap(xo.HybridClass):
 
 
 
+def _get_cpu_num_threads(context):
+    n_threads = getattr(context, 'omp_num_threads', 0)
+    if n_threads == 'auto':
+        n_threads = os.cpu_count()
+    return max(int(n_threads), 1)
+
 def _configure_grid(vname, v_grid, dv, v_range, nv):
 
     # Check input consistency
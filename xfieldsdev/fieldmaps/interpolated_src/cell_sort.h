@@ -0,0 +1,83 @@
+// copyright ################################# //
+// This file is part of the Xfields Package.   //
+// Copyright (c) CERN, 2021.                   //
+// ########################################### //
+
+#ifndef XFIELDS_CELL_SORT_H
+#define XFIELDS_CELL_SORT_H
+
+// Key of the cell containing each particle, numbered as the grid nodes in
+// memory (ix + iy*nx + iz*nx*ny) so that walking the particles in key order
+// walks the grid linearly. Particles outside the grid get nx*ny*nz, lost
+// particles get nx*ny*nz + 1 (they end up after the active ones).
+/*gpukern*/ void TriLinearInterpolatedFieldMap_cell_keys(
+        TriLinearInterpolatedFieldMapData fmap,
+        const int64_t nparticles,
+        /*gpuglmem*/ const double* x,
+        /*gpuglmem*/ const double* y,
+        /*gpuglmem*/ const double* z,
+        /*gpuglmem*/ const int64_t* part_state,
+        /*gpuglmem*/ int64_t* keys){
+
+    const double dx = TriLinearInterpolatedFieldMapData_get_dx(fmap);
+    const double dy = TriLinearInterpolatedFieldMapData_get_dy(fmap);
+    const double dz = TriLinearInterpolatedFieldMapData_get_dz(fmap);
+    const double x0 = TriLinearInterpolatedFieldMapData_get_x_min(fmap);
+    const double y0 = TriLinearInterpolatedFieldMapData_get_y_min(fmap);
+    const double z0 = TriLinearInterpolatedFieldMapData_get_z_min(fmap);
+    const int64_t nx = TriLinearInterpolatedFieldMapData_get_nx(fmap);
+    const int64_t ny = TriLinearInterpolatedFieldMapData_get_ny(fmap);
+    const int64_t nz = TriLinearInterpolatedFieldMapData_get_nz(fmap);
+    const int64_t ncells = nx*ny*nz;
+
+    #pragma omp parallel for //only_for_context cpu_openmp
+    for (int64_t pidx=0; pidx<nparticles; pidx++){ //vectorize_over pidx nparticles
+        if (part_state[pidx] > 0){
+            const int64_t ix = floor((x[pidx] - x0) / dx);
+            const int64_t iy = floor((y[pidx] - y0) / dy);
+            const int64_t iz = floor((z[pidx] - z0) / dz);
+            if (ix >= 0 && ix < nx - 1 && iy >= 0 && iy < ny - 1
+                    && iz >= 0 && iz < nz - 1){
+                keys[pidx] = ix + iy*nx + iz*nx*ny;
+            }
+            else{
+                keys[pidx] = ncells;
+            }
+        }
+        else{
+            keys[pidx] = ncells + 1;
+        }
+    }//end_vectorize
+}
+
+// CPU only: stable counting sort of the particle indices by key.
+// key_count needs to hold n_keys elements.
+/*gpukern*/ void cell_counting_sort(
+        const int64_t nparticles,
+        /*gpuglmem*/ const int64_t* keys,
+        const int64_t n_keys,
+        /*gpuglmem*/ int64_t* key_count,
+        /*gpuglmem*/ int64_t* sorted_indices){
+
+    for (int64_t ik=0; ik<n_keys; ik++){
+        key_count[ik] = 0;
+    }
+
+    for (int64_t pidx=0; pidx<nparticles; pidx++){
+        key_count[keys[pidx]]++;
+    }
+
+    // Exclusive prefix sum: first position of each key in the output
+    int64_t acc = 0;
+    for (int64_t ik=0; ik<n_keys; ik++){
+        const int64_t this_count = key_count[ik];
+        key_count[ik] = acc;
+        acc += this_count;
+    }
+
+    for (int64_t pidx=0; pidx<nparticles; pidx++){
+        sorted_indices[key_count[keys[pidx]]++] = pidx;
+    }
+}
+
+#endif
@@ -6,7 +6,7 @@
 #ifndef XFIELDS_CHARGE_DEPOSITION_H
 #define XFIELDS_CHARGE_DEPOSITION_H
 
-/*gpufun*/ void p2m_rectmesh3d_one_particle(
+/*gpufun*/ int p2m_rectmesh3d_indices_and_weights(
         // INPUTS:
         const double x, 
 	const double y, 
@@ -20,8 +20,12 @@
           // mesh dimension (number of cells)
         const int nx, const int ny, const int nz,
         // OUTPUTS:
-        /*gpuglmem*/ double *grid1d
+          // index in grid1d of the lower corner of the cell
+        int64_t* ind0,
+          // weights in the order ijk, ij1k, i1jk, i1j1k, ijk1, ij1k1, ...
+        double* w
 ) {
+    // Returns 0 if the particle does not deposit on the grid
 
     double vol_m1 = 1/(dx*dy*dz);
 
@@ -30,32 +34,100 @@
     int ix = floor((y - y0) / dy);
     int kx = floor((z - z0) / dz);
 
+    if (!(jx >= 0 && jx < nx - 1 && ix >= 0 && ix < ny - 1
+        	    && kx >= 0 && kx < nz - 1)){
+        return 0;
+    }
+
     // distances
     double dxi = x - (x0 + jx * dx);
     double dyi = y - (y0 + ix * dy);
     double dzi = z - (z0 + kx * dz);
 
     // weights
-    double wijk =    pwei * vol_m1 * (1.-dxi/dx) * (1.-dyi/dy) * (1.-dzi/dz);
-    double wi1jk =   pwei * vol_m1 * (1.-dxi/dx) * (dyi/dy)    * (1.-dzi/dz);
-    double wij1k =   pwei * vol_m1 * (dxi/dx)    * (1.-dyi/dy) * (1.-dzi/dz);
-    double wi1j1k =  pwei * vol_m1 * (dxi/dx)    * (dyi/dy)    * (1.-dzi/dz);
-    double wijk1 =   pwei * vol_m1 * (1.-dxi/dx) * (1.-dyi/dy) * (dzi/dz);
-    double wi1jk1 =  pwei * vol_m1 * (1.-dxi/dx) * (dyi/dy)    * (dzi/dz);
-    double wij1k1 =  pwei * vol_m1 * (dxi/dx)    * (1.-dyi/dy) * (dzi/dz);
-    double wi1j1k1 = pwei * vol_m1 * (dxi/dx)    * (dyi/dy)    * (dzi/dz);
-
-    if (jx >= 0 && jx < nx - 1 && ix >= 0 && ix < ny - 1
-        	    && kx >= 0 && kx < nz - 1)
-    {
-        atomicAdd(&grid1d[jx   + ix*nx     + kx*nx*ny],     wijk);
-        atomicAdd(&grid1d[jx+1 + ix*nx     + kx*nx*ny],     wij1k);
-        atomicAdd(&grid1d[jx   + (ix+1)*nx + kx*nx*ny],     wi1jk);
-        atomicAdd(&grid1d[jx+1 + (ix+1)*nx + kx*nx*ny],     wi1j1k);
-        atomicAdd(&grid1d[jx   + ix*nx     + (kx+1)*nx*ny], wijk1);
-        atomicAdd(&grid1d[jx+1 + ix*nx     + (kx+1)*nx*ny], wij1k1);
-        atomicAdd(&grid1d[jx   + (ix+1)*nx + (kx+1)*nx*ny], wi1jk1);
-        atomicAdd(&grid1d[jx+1 + (ix+1)*nx + (kx+1)*nx*ny], wi1j1k1);
+    w[0] = pwei * vol_m1 * (1.-dxi/dx) * (1.-dyi/dy) * (1.-dzi/dz); // ijk
+    w[1] = pwei * vol_m1 * (dxi/dx)    * (1.-dyi/dy) * (1.-dzi/dz); // ij1k
+    w[2] = pwei * vol_m1 * (1.-dxi/dx) * (dyi/dy)    * (1.-dzi/dz); // i1jk
+    w[3] = pwei * vol_m1 * (dxi/dx)    * (dyi/dy)    * (1.-dzi/dz); // i1j1k
+    w[4] = pwei * vol_m1 * (1.-dxi/dx) * (1.-dyi/dy) * (dzi/dz);    // ijk1
+    w[5] = pwei * vol_m1 * (dxi/dx)    * (1.-dyi/dy) * (dzi/dz);    // ij1k1
+    w[6] = pwei * vol_m1 * (1.-dxi/dx) * (dyi/dy)    * (dzi/dz);    // i1jk1
+    w[7] = pwei * vol_m1 * (dxi/dx)    * (dyi/dy)    * (dzi/dz);    // i1j1k1
+
+    *ind0 = jx + ix*nx + kx*nx*ny;
+
+    return 1;
+}
+
+/*gpufun*/ void p2m_rectmesh3d_one_particle(
+        // INPUTS:
+        const double x, 
+	const double y, 
+	const double z,
+	  // particle weight
+	const double pwei,
+          // mesh origin
+        const double x0, const double y0, const double z0,
+          // mesh distances per cell
+        const double dx, const double dy, const double dz,
+          // mesh dimension (number of cells)
+        const int nx, const int ny, const int nz,
+        // OUTPUTS:
+        /*gpuglmem*/ double *grid1d
+) {
+
+    int64_t i0;
+    double w[8];
+
+    if (p2m_rectmesh3d_indices_and_weights(x, y, z, pwei,
+                x0, y0, z0, dx, dy, dz, nx, ny, nz, &i0, w)){
+        const int64_t sy = nx;
+        const int64_t sz = ((int64_t) nx)*ny;
+        atomicAdd(&grid1d[i0],           w[0]);
+        atomicAdd(&grid1d[i0+1],         w[1]);
+        atomicAdd(&grid1d[i0+sy],        w[2]);
+        atomicAdd(&grid1d[i0+1+sy],      w[3]);
+        atomicAdd(&grid1d[i0+sz],        w[4]);
+        atomicAdd(&grid1d[i0+1+sz],      w[5]);
+        atomicAdd(&grid1d[i0+sy+sz],     w[6]);
+        atomicAdd(&grid1d[i0+1+sy+sz],   w[7]);
+    }
+
+}
+
+/*gpufun*/ void p2m_rectmesh3d_one_particle_private(
+        // INPUTS:
+        const double x, 
+	const double y, 
+	const double z,
+	  // particle weight
+	const double pwei,
+          // mesh origin
+        const double x0, const double y0, const double z0,
+          // mesh distances per cell
+        const double dx, const double dy, const double dz,
+          // mesh dimension (number of cells)
+        const int nx, const int ny, const int nz,
+        // OUTPUTS:
+          // grid owned by the calling thread (no atomics needed)
+        /*gpuglmem*/ double *grid1d
+) {
+
+    int64_t i0;
+    double w[8];
+
+    if (p2m_rectmesh3d_indices_and_weights(x, y, z, pwei,
+                x0, y0, z0, dx, dy, dz, nx, ny, nz, &i0, w)){
+        const int64_t sy = nx;
+        const int64_t sz = ((int64_t) nx)*ny;
+        grid1d[i0]           += w[0];
+        grid1d[i0+1]         += w[1];
+        grid1d[i0+sy]        += w[2];
+        grid1d[i0+1+sy]      += w[3];
+        grid1d[i0+sz]        += w[4];
+        grid1d[i0+1+sz]      += w[5];
+        grid1d[i0+sy+sz]     += w[6];
+        grid1d[i0+1+sy+sz]   += w[7];
     }
 
 }
@@ -136,5 +208,82 @@
 	}
     }//end_vectorize
 
+}
+
+// CPU only: the particles are split in n_private_grids contiguous chunks,
+// each chunk is deposited without atomics on its own grid and the grids are
+// then summed with a pairwise tree reduction. The result is added to grid1d.
+// private_grids needs to hold n_private_grids*nx*ny*nz doubles.
+/*gpukern*/ void p2m_rectmesh3d_private_grids(
+        // INPUTS:
+          // length of x, y, z arrays
+        const int nparticles,
+          // particle positions
+        /*gpuglmem*/ const double* x, 
+	/*gpuglmem*/ const double* y, 
+	/*gpuglmem*/ const double* z,
+	  // particle weights (multiplied by weight_factor) and stat flags
+	/*gpuglmem*/ const double* part_weights,
+	const double weight_factor,
+	/*gpuglmem*/ const int64_t* part_state,
+          // mesh origin
+        const double x0, const double y0, const double z0,
+          // mesh distances per cell
+        const double dx, const double dy, const double dz,
+          // mesh dimension (number of cells)
+        const int nx, const int ny, const int nz,
+          // scratch grids
+        const int n_private_grids,
+        /*gpuglmem*/ double* private_grids,
+        // OUTPUTS:
+        /*gpuglmem*/ int8_t*  grid1d_buffer,
+	             int64_t  grid1d_offset){
+
+    /*gpuglmem*/ double* grid1d = 
+		(/*gpuglmem*/ double*)(grid1d_buffer + grid1d_offset);
+
+    const int64_t nelem = ((int64_t) nx)*ny*nz;
+    const int64_t chunk = (nparticles + n_private_grids - 1) / n_private_grids;
+
+    // Each grid is cleared by the thread that fills it (first touch)
+    #pragma omp parallel for schedule(static, 1) //only_for_context cpu_openmp
+    for (int igrid=0; igrid<n_private_grids; igrid++){
+        /*gpuglmem*/ double* this_grid = private_grids + igrid*nelem;
+        for (int64_t ii=0; ii<nelem; ii++){
+            this_grid[ii] = 0.;
+        }
+
+        const int64_t pstart = igrid*chunk;
+        const int64_t pend = (pstart + chunk < nparticles) ?
+                                            pstart + chunk : nparticles;
+        for (int64_t pidx=pstart; pidx<pend; pidx++){
+            if (part_state[pidx] > 0){
+                double pwei = part_weights[pidx] * weight_factor;
+
+                p2m_rectmesh3d_one_particle_private(
+                        x[pidx], y[pidx], z[pidx], pwei,
+                        x0, y0, z0, dx, dy, dz, nx, ny, nz,
+                        this_grid);
+            }
+        }
+    }
+
+    // Pairwise tree reduction into grid 0 (for a given number of grids the
+    // summation order is fixed, it does not depend on the thread scheduling)
+    for (int stride=1; stride<n_private_grids; stride*=2){
+        #pragma omp parallel for //only_for_context cpu_openmp
+        for (int64_t ii=0; ii<nelem; ii++){
+            for (int igrid=0; igrid+stride<n_private_grids; igrid+=2*stride){
+                private_grids[igrid*nelem + ii] +=
+                                private_grids[(igrid+stride)*nelem + ii];
+            }
+        }
+    }
+
+    #pragma omp parallel for //only_for_context cpu_openmp
+    for (int64_t ii=0; ii<nelem; ii++){
+        grid1d[ii] += private_grids[ii];
+    }
+
 }
 #endif
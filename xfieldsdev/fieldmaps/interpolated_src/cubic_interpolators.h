@@ -33,12 +33,70 @@ void TriCubicInterpolatedFieldMap_construct_b(
     return ;
 }
 
+/*gpukern*/
+void TriCubicInterpolatedFieldMap_precompute_coefficients(
+        TriCubicInterpolatedFieldMapData fmap,
+        const int64_t n_cells){
+
+    // Fills the coefficient cache: 64 coefficients for each of the
+    // (nx-1)*(ny-1)*(nz-1) cells, stored contiguously cell after cell
+    const int64_t nx = TriCubicInterpolatedFieldMapData_get_nx(fmap);
+    const int64_t ny = TriCubicInterpolatedFieldMapData_get_ny(fmap);
+    /*gpuglmem*/ double* cached_coefs = TriCubicInterpolatedFieldMapData_getp1_coefs(fmap, 0);
+
+    #pragma omp parallel for //only_for_context cpu_openmp
+    for (int64_t icell=0; icell<n_cells; icell++){ //vectorize_over icell n_cells
+        const int64_t ix = icell % (nx - 1);
+        const int64_t iy = (icell / (nx - 1)) % (ny - 1);
+        const int64_t iz = icell / ((nx - 1) * (ny - 1));
+
+        double b_vector[64];
+        double coefs[64];
+        TriCubicInterpolatedFieldMap_construct_b(fmap, ix, iy, iz, b_vector);
+        TriCubicInterpolatedFieldMap_construct_coefficients(b_vector, coefs);
+
+        for (int l = 0; l < 64; l++){
+            cached_coefs[64 * icell + l] = coefs[l];
+        }
+    } //end_vectorize
+}
+
 /*gpufun*/
-int TriCubicInterpolatedFieldMap_interpolate_grad(
+void TriCubicInterpolatedFieldMap_evaluate_polynomial(
+        const double* coefs, const double xn, const double yn, const double zn,
+        double* phi, double* dphi_dxn, double* dphi_dyn, double* dphi_dzn){
+
+    // Tensor-product Horner scheme for the polynomial
+    // sum_ijk coefs[i + 4*j + 16*k] * xn^i * yn^j * zn^k
+    // and its derivatives w.r.t. the normalized coordinates
+    double p = 0., px = 0., py = 0., pz = 0.;
+    for (int i = 3; i >= 0; i--){
+        double h = 0., hy = 0., hz = 0.;
+        for (int j = 3; j >= 0; j--){
+            const double* c = coefs + i + 4 * j;
+            const double g = c[0] + zn * (c[16] + zn * (c[32] + zn * c[48]));
+            const double gz = c[16] + zn * (2. * c[32] + zn * 3. * c[48]);
+            hy = hy * yn + h;
+            h = h * yn + g;
+            hz = hz * yn + gz;
+        }
+        px = px * xn + p;
+        p = p * xn + h;
+        py = py * xn + hy;
+        pz = pz * xn + hz;
+    }
+    *phi = p;
+    *dphi_dxn = px;
+    *dphi_dyn = py;
+    *dphi_dzn = pz;
+}
+
+/*gpufun*/
+int TriCubicInterpolatedFieldMap_interpolate(
 	TriCubicInterpolatedFieldMapData fmap,
-	   const double x, const double y, const double z, 
-	   double* dphi_dx, double* dphi_dy, double* dphi_dtau){
-	
+	   const double x, const double y, const double z,
+	   double* phi, double* dphi_dx, double* dphi_dy, double* dphi_dtau){
+
     double const x_min = TriCubicInterpolatedFieldMapData_get_x_min(fmap);
     double const y_min = TriCubicInterpolatedFieldMapData_get_y_min(fmap);
     double const z_min = TriCubicInterpolatedFieldMapData_get_z_min(fmap);
@@ -87,60 +145,71 @@ int TriCubicInterpolatedFieldMap_interpolate_grad(
         return 1;                // no need for interpolation
     }
 
-    double b_vector[64];
-    TriCubicInterpolatedFieldMap_construct_b(fmap, ix, iy, iz, b_vector);
-
     double coefs[64];
-    TriCubicInterpolatedFieldMap_construct_coefficients(b_vector, coefs);
-
-    double x_power[4], y_power[4], z_power[4];
-    x_power[0] = 1;
-    y_power[0] = 1;
-    z_power[0] = 1;
-
-    x_power[1] = xn;
-    y_power[1] = yn;
-    z_power[1] = zn;
-
-    x_power[2] = xn * xn;
-    y_power[2] = yn * yn;
-    z_power[2] = zn * zn;
-
-    x_power[3] = x_power[2] * xn;
-    y_power[3] = y_power[2] * yn;
-    z_power[3] = z_power[2] * zn;
-
-    for( int i = 1; i < 4; i++ ){
-        for( int j = 0; j < 4; j++ ){
-            for( int k = 0; k < 4; k++ ){
-                *dphi_dx += i * ( ( ( coefs[i + 4 * j + 16 * k] * x_power[i-1] ) 
-                                    * y_power[j] ) * z_power[k] );
-            }
-        }
-    }
-    *dphi_dx *= sign_x * inv_dx; 
-
-    for( int i = 0; i < 4; i++ ){
-        for( int j = 1; j < 4; j++ ){
-            for( int k = 0; k < 4; k++ ){
-                *dphi_dy += j * ( ( ( coefs[i + 4 * j + 16 * k] * x_power[i] ) 
-                                    * y_power[j-1] ) * z_power[k] );
-            }
+    if (TriCubicInterpolatedFieldMapData_len_coefs(fmap) > 0){
+        // coefficients precomputed when the map was filled
+        const int64_t nx = TriCubicInterpolatedFieldMapData_get_nx(fmap);
+        const int64_t ny = TriCubicInterpolatedFieldMapData_get_ny(fmap);
+        const int64_t icell = ix + (nx - 1) * (iy + (ny - 1) * iz);
+        /*gpuglmem*/ double* cached_coefs =
+            TriCubicInterpolatedFieldMapData_getp1_coefs(fmap, 64 * icell);
+        for (int l = 0; l < 64; l++){
+            coefs[l] = cached_coefs[l];
         }
     }
-    *dphi_dy *= sign_y * inv_dy; 
-
-    for( int i = 0; i < 4; i++){
-        for( int j = 0; j < 4; j++){
-            for( int k = 1; k < 4; k++){
-                *dphi_dtau += k * ( ( ( coefs[i + 4 * j + 16 * k] * x_power[i] ) 
-                                    * y_power[j] ) * z_power[k-1] );
-            }
-        }
+    else{
+        double b_vector[64];
+        TriCubicInterpolatedFieldMap_construct_b(fmap, ix, iy, iz, b_vector);
+        TriCubicInterpolatedFieldMap_construct_coefficients(b_vector, coefs);
     }
-    *dphi_dtau *= sign_z * inv_dz; 
+
+    double dphi_dxn, dphi_dyn, dphi_dzn;
+    TriCubicInterpolatedFieldMap_evaluate_polynomial(coefs, xn, yn, zn,
+                                  phi, &dphi_dxn, &dphi_dyn, &dphi_dzn);
+
+    *dphi_dx = sign_x * inv_dx * dphi_dxn;
+    *dphi_dy = sign_y * inv_dy * dphi_dyn;
+    *dphi_dtau = sign_z * inv_dz * dphi_dzn;
 
 	return 0;
 }
 
+/*gpufun*/
+int TriCubicInterpolatedFieldMap_interpolate_grad(
+	TriCubicInterpolatedFieldMapData fmap,
+	   const double x, const double y, const double z,
+	   double* dphi_dx, double* dphi_dy, double* dphi_dtau){
+
+    double phi;
+    return TriCubicInterpolatedFieldMap_interpolate(fmap, x, y, z,
+                                  &phi, dphi_dx, dphi_dy, dphi_dtau);
+}
+
+/*gpukern*/
+void TriCubicInterpolatedFieldMap_interpolate_vector(
+        TriCubicInterpolatedFieldMapData fmap,
+        const int64_t n_points,
+        /*gpuglmem*/ const double* x,
+        /*gpuglmem*/ const double* y,
+        /*gpuglmem*/ const double* z,
+        /*gpuglmem*/ double* phi,
+        /*gpuglmem*/ double* dphi_dx,
+        /*gpuglmem*/ double* dphi_dy,
+        /*gpuglmem*/ double* dphi_dz){
+
+    #pragma omp parallel for //only_for_context cpu_openmp
+    for (int64_t pidx=0; pidx<n_points; pidx++){ //vectorize_over pidx n_points
+        double pp, gx, gy, gz;
+        if (TriCubicInterpolatedFieldMap_interpolate(fmap, x[pidx], y[pidx],
+                    z[pidx], &pp, &gx, &gy, &gz)){
+            // zeros outside the grid
+            pp = 0.; gx = 0.; gy = 0.; gz = 0.;
+        }
+        phi[pidx] = pp;
+        dphi_dx[pidx] = gx;
+        dphi_dy[pidx] = gy;
+        dphi_dz[pidx] = gz;
+    } //end_vectorize
+}
+
 #endif
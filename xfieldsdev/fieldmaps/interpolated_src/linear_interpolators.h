@@ -103,6 +103,57 @@ double TriLinearInterpolatedFieldMap_interpolate_3d_map_scalar(
     return val;
 }
 
+/*gpufun*/
+void TriLinearInterpolatedFieldMap_node_offsets(
+	   const IndicesAndWeights iw,
+	   int64_t* offsets){
+
+    // Flat indices of the 8 nodes of the cell, same order as the weights
+    const int64_t sy = iw.nx;
+    const int64_t sz = iw.nx * iw.ny;
+    const int64_t i0 = iw.ix + iw.iy * sy + iw.iz * sz;
+
+    offsets[0] = i0;
+    offsets[1] = i0 + 1;
+    offsets[2] = i0 + sy;
+    offsets[3] = i0 + 1 + sy;
+    offsets[4] = i0 + sz;
+    offsets[5] = i0 + 1 + sz;
+    offsets[6] = i0 + sy + sz;
+    offsets[7] = i0 + 1 + sy + sz;
+}
+
+// Interpolates n_comp quantities stored interleaved per node
+// (map[n_comp*inode + icomp]), so that each node of the stencil is read
+// from a contiguous chunk of memory. Zeros are returned outside the grid.
+/*gpufun*/
+void TriLinearInterpolatedFieldMap_interpolate_3d_map_interleaved(
+	/*gpuglmem*/ const double* map,
+	   const int64_t n_comp,
+	   const IndicesAndWeights iw,
+	   double* values){
+
+    for (int64_t ic=0; ic<n_comp; ic++){
+        values[ic] = 0.;
+    }
+
+    if (iw.ix < 0){
+        return;
+    }
+
+    int64_t off[8];
+    TriLinearInterpolatedFieldMap_node_offsets(iw, off);
+    const double w[8] = {iw.w000, iw.w100, iw.w010, iw.w110,
+                         iw.w001, iw.w101, iw.w011, iw.w111};
+
+    for (int inode=0; inode<8; inode++){
+        /*gpuglmem*/ const double* node = map + n_comp * off[inode];
+        for (int64_t ic=0; ic<n_comp; ic++){
+            values[ic] += w[inode] * node[ic];
+        }
+    }
+}
+
 /*gpukern*/
 void TriLinearInterpolatedFieldMap_interpolate_3d_map_vector(
     TriLinearInterpolatedFieldMapData  fmap,
@@ -121,12 +172,27 @@ void TriLinearInterpolatedFieldMap_interpolate_3d_map_vector(
 	const IndicesAndWeights iw = 
 		TriLinearInterpolatedFieldMap_compute_indeces_and_weights(
 	                                      fmap, x[pidx], y[pidx], z[pidx]);
-    	for (int iq=0; iq<n_quantities; iq++){
-	    particles_quantities[iq*n_points + pidx] = 
-		TriLinearInterpolatedFieldMap_interpolate_3d_map_scalar(
-	           (/*gpuglmem*/ double*)(buffer_mesh_quantities + offsets_mesh_quantities[iq]),
-		   iw);
-	}
+
+        if (iw.ix < 0){
+            for (int iq=0; iq<n_quantities; iq++){
+                particles_quantities[iq*n_points + pidx] = 0.;
+            }
+        }
+        else{
+            // Indices and weights are computed once for all quantities
+            int64_t off[8];
+            TriLinearInterpolatedFieldMap_node_offsets(iw, off);
+
+            for (int iq=0; iq<n_quantities; iq++){
+                /*gpuglmem*/ const double* map = (/*gpuglmem*/ const double*)(
+                        buffer_mesh_quantities + offsets_mesh_quantities[iq]);
+                particles_quantities[iq*n_points + pidx] =
+                           iw.w000 * map[off[0]] + iw.w100 * map[off[1]]
+                         + iw.w010 * map[off[2]] + iw.w110 * map[off[3]]
+                         + iw.w001 * map[off[4]] + iw.w101 * map[off[5]]
+                         + iw.w011 * map[off[6]] + iw.w111 * map[off[7]];
+            }
+        }
     }//end_vectorize
 }
 #endif
@@ -0,0 +1,78 @@
+// copyright ################################# //
+// This file is part of the Xfields Package.   //
+// Copyright (c) CERN, 2021.                   //
+// ########################################### //
+
+#ifndef XFIELDS_PHI_AND_GRADIENT_H
+#define XFIELDS_PHI_AND_GRADIENT_H
+
+// Copies the potential from the real part of the (Fortran ordered) solver
+// workspace into the field map and computes the three central differences
+// in the same pass (replaces the copy + three central_diff launches). The
+// first nx, ny, nz cells of the workspace hold phi. ws_elem_size is 2 for a
+// complex workspace and 1 for a real one.
+/*gpukern*/
+void TriLinearInterpolatedFieldMap_phi_and_gradient_from_workspace(
+        TriLinearInterpolatedFieldMapData fmap,
+        const int64_t nelem,
+        const int64_t ws_nx,
+        const int64_t ws_ny,
+        const int64_t ws_elem_size,
+        /*gpuglmem*/ const double* workspace){
+
+    const int64_t nx = TriLinearInterpolatedFieldMapData_get_nx(fmap);
+    const int64_t ny = TriLinearInterpolatedFieldMapData_get_ny(fmap);
+    const int64_t nz = TriLinearInterpolatedFieldMapData_get_nz(fmap);
+    const double fx = 1./(2*TriLinearInterpolatedFieldMapData_get_dx(fmap));
+    const double fy = 1./(2*TriLinearInterpolatedFieldMapData_get_dy(fmap));
+    const double fz = 1./(2*TriLinearInterpolatedFieldMapData_get_dz(fmap));
+
+    /*gpuglmem*/ double* phi = TriLinearInterpolatedFieldMapData_getp1_phi(fmap, 0);
+    /*gpuglmem*/ double* dphi_dx = TriLinearInterpolatedFieldMapData_getp1_dphi_dx(fmap, 0);
+    /*gpuglmem*/ double* dphi_dy = TriLinearInterpolatedFieldMapData_getp1_dphi_dy(fmap, 0);
+    /*gpuglmem*/ double* dphi_dz = TriLinearInterpolatedFieldMapData_getp1_dphi_dz(fmap, 0);
+    /*gpuglmem*/ double* grad_xyz = TriLinearInterpolatedFieldMapData_getp1_grad_xyz(fmap, 0);
+    const int64_t fill_interleaved =
+                  TriLinearInterpolatedFieldMapData_len_grad_xyz(fmap) > 0;
+
+    // strides in the workspace in units of double
+    const int64_t sx = ws_elem_size;
+    const int64_t sy = ws_elem_size*ws_nx;
+    const int64_t sz = ws_elem_size*ws_nx*ws_ny;
+
+    for (int64_t ii=0; ii<nelem; ii++){ //vectorize_over ii nelem
+        const int64_t ix = ii % nx;
+        const int64_t iy = (ii / nx) % ny;
+        const int64_t iz = ii / (nx*ny);
+        const int64_t jj = ix*sx + iy*sy + iz*sz;
+
+        phi[ii] = workspace[jj];
+
+        if (ix > 0 && ix < nx - 1){
+            dphi_dx[ii] = fx * (workspace[jj + sx] - workspace[jj - sx]);
+        }
+        else{
+            dphi_dx[ii] = 0;
+        }
+        if (iy > 0 && iy < ny - 1){
+            dphi_dy[ii] = fy * (workspace[jj + sy] - workspace[jj - sy]);
+        }
+        else{
+            dphi_dy[ii] = 0;
+        }
+        if (iz > 0 && iz < nz - 1){
+            dphi_dz[ii] = fz * (workspace[jj + sz] - workspace[jj - sz]);
+        }
+        else{
+            dphi_dz[ii] = 0;
+        }
+
+        if (fill_interleaved){
+            grad_xyz[3*ii]     = dphi_dx[ii];
+            grad_xyz[3*ii + 1] = dphi_dy[ii];
+            grad_xyz[3*ii + 2] = dphi_dz[ii];
+        }
+    }//end_vectorize
+}
+
+#endif
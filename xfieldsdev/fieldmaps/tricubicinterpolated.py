@@ -66,6 +66,27 @@ _TriCubicInterpolatedFieldMap_kernels = {
             ],
         n_threads='nparticles'
         ),
+    'TriCubicInterpolatedFieldMap_interpolate_vector': xo.Kernel(
+        args=[
+            xo.Arg(xo.ThisClass, pointer=False, name='fmap'),
+            xo.Arg(xo.Int64,   pointer=False, name='n_points'),
+            xo.Arg(xo.Float64, pointer=True,  name='x'),
+            xo.Arg(xo.Float64, pointer=True,  name='y'),
+            xo.Arg(xo.Float64, pointer=True,  name='z'),
+            xo.Arg(xo.Float64, pointer=True,  name='phi'),
+            xo.Arg(xo.Float64, pointer=True,  name='dphi_dx'),
+            xo.Arg(xo.Float64, pointer=True,  name='dphi_dy'),
+            xo.Arg(xo.Float64, pointer=True,  name='dphi_dz'),
+            ],
+        n_threads='n_points'
+        ),
+    'TriCubicInterpolatedFieldMap_precompute_coefficients': xo.Kernel(
+        args=[
+            xo.Arg(xo.ThisClass, pointer=False, name='fmap'),
+            xo.Arg(xo.Int64,   pointer=False, name='n_cells'),
+            ],
+        n_threads='n_cells'
+        ),
     }
 
 
@@ -130,6 +151,12 @@ class TriCubicInterpolatedFieldMap(xo.HybridClass):
             (1.,1.,1.).
         updatable (bool): If ``True`` the field map can be updated after
             creation. Default is ``True``.
+        precompute_coefficients (bool): If ``True`` the 64 coefficients of the
+            tricubic polynomial are computed once per cell and stored in the
+            map, so that each interpolation reduces to a polynomial
+            evaluation. This needs about eight times the memory of
+            ``phi_taylor``. If ``phi_taylor`` is modified after creation,
+            ``update_coefficients`` needs to be called. Default is ``False``.
     Returns:
         (TriCubicInterpolatedFieldMap): Interpolator object.
     """
@@ -148,6 +175,7 @@ class TriCubicInterpolatedFieldMap(xo.HybridClass):
         'dy': xo.Float64,
         'dz': xo.Float64,
         'phi_taylor': xo.Float64[:],
+        'coefs': xo.Float64[:],
     }
 
     # I add undescores in front of the names so that I can define custom
@@ -183,6 +211,7 @@ class TriCubicInterpolatedFieldMap(xo.HybridClass):
                  phi_taylor=None,
                  scale_coordinates_in_solver=(1.,1.,1.),
                  updatable=True,
+                 precompute_coefficients=False,
                  ):
 
         if _xobject is not None:
@@ -198,6 +227,10 @@ class TriCubicInterpolatedFieldMap(xo.HybridClass):
         self._z_grid = _configure_grid('z', z_grid, dz, z_range, nz)
 
         nelem = self.nx*self.ny*self.nz*8
+        if precompute_coefficients:
+            ncoefs = (self.nx - 1)*(self.ny - 1)*(self.nz - 1)*64
+        else:
+            ncoefs = 0
         self.xoinitialize(
                  _context=_context,
                  _buffer=_buffer,
@@ -214,13 +247,15 @@ class TriCubicInterpolatedFieldMap(xo.HybridClass):
                  mirror_x = mirror_x,
                  mirror_y = mirror_y,
                  mirror_z = mirror_z,
-                 phi_taylor = nelem
+                 phi_taylor = nelem,
+                 coefs = ncoefs,
                  )
 
         self.compile_kernels(only_if_needed=True)
 
         if phi_taylor is not None:
-            self.phi_taylor = phi_taylor
+            self._phi_taylor = phi_taylor
+            self.update_coefficients()
         else:
             # Set rho
             if rho is not None:
@@ -236,26 +271,42 @@ class TriCubicInterpolatedFieldMap(xo.HybridClass):
     def _assert_updatable(self):
         assert self.updatable, 'This FieldMap is not updatable!'
 
-    #@profile
+    @property
+    def precompute_coefficients(self):
+        """
+        ``True`` if the tricubic coefficients are stored in the map.
+        """
+        return len(self._coefs) > 0
+
+    def update_coefficients(self):
+        """
+        Recomputes the stored tricubic coefficients from ``phi_taylor``.
+        It has no effect if the map does not store the coefficients.
+        """
+        if not self.precompute_coefficients:
+            return
+        context = self._buffer.context
+        context.kernels.TriCubicInterpolatedFieldMap_precompute_coefficients(
+                fmap=self._xobject,
+                n_cells=(self.nx - 1)*(self.ny - 1)*(self.nz - 1))
+
     def get_values_at_points(self,
             x, y, z,
-            return_rho=True,
             return_phi=True,
             return_dphi_dx=True,
             return_dphi_dy=True,
             return_dphi_dz=True):
 
         """
-        Returns the charge density, the field potential and its derivatives
-        at the points specified by x, y, z. The output can be customized (see below).
-        Zeros are returned for points outside the grid.
+        Returns the field potential and its derivatives at the points
+        specified by x, y, z, evaluated with the tricubic interpolation.
+        The output can be customized (see below). Zeros are returned for
+        points outside the grid.
 
         Args:
             x (float64 array): Horizontal coordinates at which the field is evaluated.
             y (float64 array): Vertical coordinates at which the field is evaluated.
             z (float64 array): Longitudinal coordinates at which the field is evaluated.
-            return_rho (bool): If ``True``, the charge density at the given points is
-                returned.
             return_phi (bool): If ``True``, the potential at the given points is returned.
             return_dphi_dx (bool): If ``True``, the horizontal derivative of the potential
                 at the given points is returned.
@@ -267,50 +318,26 @@ class TriCubicInterpolatedFieldMap(xo.HybridClass):
             (tuple of float64 array): The required quantities at the provided points.
         """
 
-        #raise Exception("Method not checked/implemented.")
-        raise NotImplementedError
-
         assert len(x) == len(y) == len(z)
 
-        pos_in_buffer_of_maps_to_interp = []
-        if return_rho:
-            pos_in_buffer_of_maps_to_interp.append(
-                    self._xobject.rho._offset + self._xobject.rho._data_offset)
-        if return_phi:
-            pos_in_buffer_of_maps_to_interp.append(
-                    self._xobject.phi._offset + self._xobject.phi._data_offset)
-        if return_dphi_dx:
-            pos_in_buffer_of_maps_to_interp.append(
-                    self._xobject.dphi_dx._offset + self._xobject.dphi_dx._data_offset)
-        if return_dphi_dy:
-            pos_in_buffer_of_maps_to_interp.append(
-                    self._xobject.dphi_dy._offset + self._xobject.dphi_dy._data_offset)
-        if return_dphi_dz:
-            pos_in_buffer_of_maps_to_interp.append(
-                    self._xobject.dphi_dz._offset + self._xobject.dphi_dz._data_offset)
-
         context = self._buffer.context
 
-        pos_in_buffer_of_maps_to_interp = context.nparray_to_context_array(
-                        np.array(pos_in_buffer_of_maps_to_interp, dtype=np.int64))
-        nmaps_to_interp = len(pos_in_buffer_of_maps_to_interp)
-        buffer_out = context.zeros(
-                shape=(nmaps_to_interp * len(x),), dtype=np.float64)
-        if nmaps_to_interp > 0:
-            context.kernels.TriLinearInterpolatedFieldMap_interpolate_3d_map_vector(
+        n_points = len(x)
+        buffer_out = context.zeros(shape=(4 * n_points,), dtype=np.float64)
+        out = [buffer_out[ii*n_points:(ii+1)*n_points] for ii in range(4)]
+        if n_points > 0:
+            context.kernels.TriCubicInterpolatedFieldMap_interpolate_vector(
                     fmap=self._xobject,
-                    n_points=len(x),
+                    n_points=n_points,
                     x=x, y=y, z=z,
-                    n_quantities=nmaps_to_interp,
-                    buffer_mesh_quantities=self._buffer.buffer,
-                    offsets_mesh_quantities=pos_in_buffer_of_maps_to_interp,
-                    particles_quantities=buffer_out)
-
-        # Split buffer 
-        particles_quantities = [buffer_out[ii*len(x):(ii+1)*len(x)]
-                                        for ii in range(nmaps_to_interp)]
-
-        return particles_quantities
+                    phi=out[0],
+                    dphi_dx=out[1],
+                    dphi_dy=out[2],
+                    dphi_dz=out[3])
+
+        return [qq for qq, flag in zip(out, [return_phi, return_dphi_dx,
+                                             return_dphi_dy, return_dphi_dz])
+                if flag]
 
     def update_rho(self, rho, reset=True, force=False):
         """
@@ -84,7 +84,7 @@ int beamstrahlung_0(LocalParticle *part,
 
 
 /*gpufun*/
-double beamstrahlung_avg(LocalParticle *part, BeamBeamBiGaussian3DRecordData beamstrahlung_record, RecordIndex beamstrahlung_table_index, BeamstrahlungTableData beamstrahlung_table,
+double beamstrahlung_avg(LocalParticle *part, BeamBeamBiGaussian3DRecordData beamstrahlung_record, RecordIndex beamstrahlung_table_index, BeamstrahlungTableData beamstrahlung_table, RecordChunk* beamstrahlung_chunk,
         const double n_bb, // [1] strong slice bunch intensity
         const double sigma_x, const double sigma_y, const double sigma_z  // [m] unboosted strong slice RMS
 ){
@@ -120,7 +120,7 @@ double beamstrahlung_avg(LocalParticle *part, BeamBeamBiGaussian3DRecordData bea
 
     if (beamstrahlung_record){
         // Get a slot in the record (this is thread safe)
-        int64_t i_slot = RecordIndex_get_slot(beamstrahlung_table_index);
+        int64_t i_slot = RecordChunk_get_slot(beamstrahlung_chunk, beamstrahlung_table_index);
         // The returned slot id is negative if record is NULL or if record is full
         if (i_slot>=0){
             BeamstrahlungTableData_set_particle_id(   beamstrahlung_table, i_slot, LocalParticle_get_particle_id(part));
@@ -138,7 +138,7 @@ double beamstrahlung_avg(LocalParticle *part, BeamBeamBiGaussian3DRecordData bea
 
 
 /*gpufun*/
-double beamstrahlung(LocalParticle *part, BeamBeamBiGaussian3DRecordData beamstrahlung_record, RecordIndex beamstrahlung_table_index, BeamstrahlungTableData beamstrahlung_table,
+double beamstrahlung(LocalParticle *part, BeamBeamBiGaussian3DRecordData beamstrahlung_record, RecordIndex beamstrahlung_table_index, BeamstrahlungTableData beamstrahlung_table, RecordChunk* beamstrahlung_chunk,
      	double Fr,  // [1] radial force sqrt[(px' - px)^2 + (py' - py)^2]/Dt, Dt=1
 	double dz   // [m] z slice half width: step between 2 slices ((z_max - z_min) / 2)
 ){
@@ -171,7 +171,7 @@ double beamstrahlung(LocalParticle *part, BeamBeamBiGaussian3DRecordData beamstr
            
             if (beamstrahlung_record){
                 // Get a slot in the record (this is thread safe)
-                int64_t i_slot = RecordIndex_get_slot(beamstrahlung_table_index);
+                int64_t i_slot = RecordChunk_get_slot(beamstrahlung_chunk, beamstrahlung_table_index);
                 // The returned slot id is negative if record is NULL or if record is full
                 if (i_slot>=0){
                     BeamstrahlungTableData_set_particle_id(           beamstrahlung_table, i_slot, LocalParticle_get_particle_id(part));
@@ -192,7 +192,8 @@ double beamstrahlung(LocalParticle *part, BeamBeamBiGaussian3DRecordData beamstr
 
             // some error handling
             if (e_photon_array[j]<=0.0){
-                printf("photon emitted with negative energy: E_photon=%g [eV], E_macropart=%g [eV], photon ID: %d, max_photons: %d\n", e_photon*1e9, energy, j, max_photons);
+                XF_TRACE_RECORD(beamstrahlung_record, part, XF_TRACE_BS_NEGATIVE_PHOTON,
+                                e_photon*1e9, energy, (double) j);
             }
 
             // increment photon counter
@@ -200,7 +201,8 @@ double beamstrahlung(LocalParticle *part, BeamBeamBiGaussian3DRecordData beamstr
 
             // break loop and flag macroparticle as dead
             if (j>=1000){
-                printf("[%d] too many photons produced by one particle (photon ID: %d), Fr: %.12e, dz: %.12e\n", (int)part->ipart, j, Fr, dz);
+                XF_TRACE_RECORD(beamstrahlung_record, part, XF_TRACE_BS_TOO_MANY_PHOTONS,
+                                (double) j, Fr, dz);
                 //exit(-1);  // doesnt work on GPU
                 LocalParticle_set_state(part, XF_TOO_MANY_PHOTONS); // used to flag this kind of loss
                 break;
@@ -250,7 +250,7 @@ double compt_select(LocalParticle *part,
 
 
 /*gpufun*/
-void compt_do(LocalParticle *part, BeamBeamBiGaussian3DRecordData bhabha_record, RecordIndex bhabha_table_index, BhabhaTableData bhabha_table,
+void compt_do(LocalParticle *part, BeamBeamBiGaussian3DRecordData bhabha_record, RecordIndex bhabha_table_index, BhabhaTableData bhabha_table, RecordChunk* bhabha_chunk,
               double e_photon,           // [GeV] single equivalent virtual photon energy before Compton scattering
               const double compt_x_min,  // [1] scaling factor in the minimum energy cutoff
               double q2,                 // [GeV^2] single equivalent virtual photon virtuality
@@ -349,7 +349,7 @@ void compt_do(LocalParticle *part, BeamBeamBiGaussian3DRecordData bhabha_record,
 
             if (bhabha_record){
               // Get a slot in the record (this is thread safe)
-              int64_t i_slot = RecordIndex_get_slot(bhabha_table_index);
+              int64_t i_slot = RecordChunk_get_slot(bhabha_chunk, bhabha_table_index);
               // The returned slot id is negative if record is NULL or if record is full
               if (i_slot>=0){
                   BhabhaTableData_set_particle_id(   bhabha_table, i_slot, LocalParticle_get_particle_id(part));
@@ -375,7 +375,8 @@ void compt_do(LocalParticle *part, BeamBeamBiGaussian3DRecordData bhabha_record,
               e_loss_primary = e_e_prime - e_primary;  // [GeV], <0, loss from a single photon emission
 
               if (e_loss_primary == 0.0){
-                printf("0 energy loss: %g", e_loss_primary);
+                XF_TRACE_RECORD(bhabha_record, part, XF_TRACE_BHABHA_ZERO_LOSS,
+                                e_loss_primary, 0., 0.);
               }else{
                 //printf("[%d] lost %g [GeV]\n", (int)part->ipart, e_loss_primary);
                 if (-1.0 * e_loss_primary >= e_primary){  // macropart dies
@@ -15,145 +15,316 @@
 void compute_slice_moments_cuda_sums_per_slice(ParticlesData particles, int64_t* particles_slice, double* moments, const int64_t num_macroparticles, const int64_t n_slices, const int64_t shared_mem_size_bytes){};
 void compute_slice_moments_cuda_moments_from_sums(double* moments, const int64_t n_slices, const int64_t weight, const int64_t threshold_num_macroparticles){};
 
-int64_t binary_search(const double* bins, int first, int last, const double x){
-    // bins must be in descending order: bins[i-1] >= x > bins[i]. If bins in increasing order, change < to >.
-    if (x <= bins[last])
-        return last+1;
-
-    while (first <= last)
-    {
-        int64_t middle = first + (last - first) / 2;
-        if (x > bins[middle] && x <= bins[middle-1])
-            return middle;
-        if (bins[middle] >= x)
-        {
-            first = middle + 1;
-        }
-        else
-            last = middle - 1;
+int64_t count_edges_above(const double* bins, const int64_t n_edges, const double x){
+    // Number of bins (in descending order) with bins[i] >= x, i.e. the index
+    // i with bins[i-1] >= x > bins[i] as returned by np.digitize(right=True).
+    // Branch-free search: the number of iterations only depends on n_edges.
+    const double* base = bins;
+    int64_t n = n_edges;
+    while (n > 1){
+        const int64_t half = n / 2;
+        base = (base[half-1] >= x) ? base + half : base;
+        n -= half;
     }
-    return 0;
+    return (base - bins) + (base[0] >= x);
+}
+
+int64_t count_edges_above_uniform(const double* bins, const int64_t n_edges, const double x){
+    // Same as count_edges_above for equally spaced bins, in O(1): the index
+    // is computed from x and corrected by one step if rounding put x on the
+    // wrong side of an edge
+    const double f = (bins[0] - x) * ((n_edges - 1) / (bins[0] - bins[n_edges-1]));
+    int64_t count;
+    if (!(f >= 0.)){
+        count = 0;
+    } else if (f > n_edges - 1){
+        count = n_edges;
+    } else {
+        count = (int64_t) f + 1;
+    }
+    if (count > 0 && bins[count-1] < x){
+        count--;
+    } else if (count < n_edges && bins[count] >= x){
+        count++;
+    }
+    return count;
 }
 
 void digitize(ParticlesData particles, const double* particles_zeta, const double* bin_edges, int n_slices, int64_t* particles_slice){
   int n_part = ParticlesData_get__capacity(particles);
-  int first = 0;
-  int last = n_slices;
   #pragma omp parallel for //only_for_context cpu_openmp
   for (int i=0; i<n_part; i++) {
-//      int tid = omp_get_thread_num(); //only_for_context cpu_openmp
-//      printf("[digitize] omp thread %d\n", tid); //only_for_context cpu_openmp
-      particles_slice[i] = binary_search(bin_edges, first, last, particles_zeta[i]);
+      particles_slice[i] = count_edges_above(bin_edges, n_slices + 1, particles_zeta[i]);
   }
 }
 
-void compute_slice_moments(ParticlesData particles, int64_t* particles_slice, double* moments, int n_slices, int threshold_n_macroparticles) {
-    int n_first_moments = 7;
-    int n_second_moments = 10;
-    int n_moments = n_first_moments+n_second_moments;
-    for(int i = 0;i<n_slices*n_moments;++i) {
-        moments[i] = 0.0;
+// Per-slice accumulators of compute_slice_moments: macroparticle count,
+// running means of (x, px, y, py, zeta, delta) and centred co-moment sums of
+// (x, px, y, py), in the order of the Sigma_ij of the output
+#define SLICE_MOMENTS_N_MEANS 6
+#define SLICE_MOMENTS_N_COMOMENTS 10
+#define SLICE_MOMENTS_ACC_SIZE (1 + SLICE_MOMENTS_N_MEANS + SLICE_MOMENTS_N_COMOMENTS)
+
+int64_t slice_moments_accumulators_stride(const int64_t n_slices){
+    // doubles per chunk, padded to a multiple of 8 (64 bytes) so that two
+    // chunks never share a cache line
+    return ((n_slices*SLICE_MOMENTS_ACC_SIZE + 7) / 8) * 8;
+}
+
+void slice_moments_accumulate(double* acc, const double* v){
+    // Welford update with one macroparticle of coordinates v
+    const double n = acc[0] + 1.;
+    double d_old[4], d_new[4];
+    acc[0] = n;
+    for (int j=0; j<SLICE_MOMENTS_N_MEANS; j++){
+        const double d = v[j] - acc[1+j];
+        acc[1+j] += d / n;
+        if (j < 4){
+            d_old[j] = d;
+            d_new[j] = v[j] - acc[1+j];
+        }
     }
-    int n_part = ParticlesData_get__capacity(particles);
-    //////// zero and first order moments ///////////////
-    #pragma omp parallel default(none) firstprivate(n_part,n_slices,n_first_moments) shared(particles,moments,particles_slice) //only_for_context cpu_openmp
-    { //only_for_context cpu_openmp
-//        int tid = omp_get_thread_num(); //only_for_context cpu_openmp
-//        printf("[compute_slice_moments] omp thread %d\n", tid); //only_for_context cpu_openmp
-        double tmpSliceM[n_slices*n_first_moments];
-        for(int i = 0;i<n_slices*n_first_moments;++i) {
-            tmpSliceM[i] = 0.0;
+    double* c = acc + 1 + SLICE_MOMENTS_N_MEANS;
+    int k = 0;
+    for (int a=0; a<4; a++){
+        for (int b=a; b<4; b++){
+            c[k++] += d_old[a] * d_new[b];
         }
-        #pragma omp for //only_for_context cpu_openmp
-        for(int i = 0;i<n_part;++i) {
-            int i_slice = particles_slice[i];
-            if(i_slice >= 0 && i_slice < n_slices && ParticlesData_get_state(particles,i)>0){
-                tmpSliceM[i_slice] += 1.0;
-                tmpSliceM[n_slices + i_slice] += ParticlesData_get_x(particles,i);
-                tmpSliceM[2*n_slices + i_slice] += ParticlesData_get_px(particles,i);
-                tmpSliceM[3*n_slices + i_slice] += ParticlesData_get_y(particles,i);
-                tmpSliceM[4*n_slices + i_slice] += ParticlesData_get_py(particles,i);
-                tmpSliceM[5*n_slices + i_slice] += ParticlesData_get_zeta(particles,i);
-                tmpSliceM[6*n_slices + i_slice] += ParticlesData_get_delta(particles,i);
-            }
+    }
+}
+
+void slice_moments_merge(double* acc, const double* other){
+    // Chan et al. merge of the accumulators of two disjoint sets of particles
+    const double na = acc[0];
+    const double nb = other[0];
+    if (nb == 0.){
+        return;
+    }
+    if (na == 0.){
+        for (int j=0; j<SLICE_MOMENTS_ACC_SIZE; j++){
+            acc[j] = other[j];
         }
-        //reduction
-        #pragma omp critical //only_for_context cpu_openmp
-        { //only_for_context cpu_openmp
-            for (int i_slice = 0;i_slice<n_slices;++i_slice) {
-                for(int j = 0;j<n_first_moments;++j){
-                    moments[j*n_slices + i_slice] += tmpSliceM[j*n_slices + i_slice];
-                }
+        return;
+    }
+    const double n = na + nb;
+    double delta[SLICE_MOMENTS_N_MEANS];
+    for (int j=0; j<SLICE_MOMENTS_N_MEANS; j++){
+        delta[j] = other[1+j] - acc[1+j];
+        acc[1+j] += delta[j] * (nb / n);
+    }
+    double* c = acc + 1 + SLICE_MOMENTS_N_MEANS;
+    const double* c_other = other + 1 + SLICE_MOMENTS_N_MEANS;
+    const double f = na * nb / n;
+    int k = 0;
+    for (int a=0; a<4; a++){
+        for (int b=a; b<4; b++){
+            c[k] += c_other[k] + delta[a] * delta[b] * f;
+            k++;
+        }
+    }
+    acc[0] = n;
+}
+
+void slice_moments_accumulate_particle(double* acc, ParticlesData particles, const int64_t i){
+    const double v[SLICE_MOMENTS_N_MEANS] = {
+        ParticlesData_get_x(particles,i),
+        ParticlesData_get_px(particles,i),
+        ParticlesData_get_y(particles,i),
+        ParticlesData_get_py(particles,i),
+        ParticlesData_get_zeta(particles,i),
+        ParticlesData_get_delta(particles,i)};
+    slice_moments_accumulate(acc, v);
+}
+
+void slice_moments_reduce(double* moments, const int64_t n_slices, const int64_t threshold_n_macroparticles,
+                          const double weight, const int64_t n_chunks, double* accumulators){
+    // Merges the accumulators of the chunks with a pairwise tree reduction
+    // (for a given n_chunks the merge order is fixed, it does not depend on
+    // the thread scheduling), and stores in moments: count (scaled to real
+    // charge), 6 means and the 10 Sigma_ij (11, 12, 13, 14, 22, 23, 24, 33,
+    // 34, 44), each over all slices
+    const int64_t stride = slice_moments_accumulators_stride(n_slices);
+    for (int64_t step=1; step<n_chunks; step*=2){
+        #pragma omp parallel for //only_for_context cpu_openmp
+        for (int64_t i_slice=0; i_slice<n_slices; i_slice++){
+            for (int64_t ichunk=0; ichunk+step<n_chunks; ichunk+=2*step){
+                slice_moments_merge(
+                    accumulators + ichunk*stride + i_slice*SLICE_MOMENTS_ACC_SIZE,
+                    accumulators + (ichunk+step)*stride + i_slice*SLICE_MOMENTS_ACC_SIZE);
             }
-        } //only_for_context cpu_openmp
-    } //only_for_context cpu_openmp
-    for (int i_slice = 0;i_slice<n_slices;++i_slice) {
-        if(moments[i_slice] > threshold_n_macroparticles){
-            for(int j = 1;j<n_first_moments;++j){
-                moments[j*n_slices+i_slice] /= moments[i_slice];
+        }
+    }
+
+    for (int64_t i_slice=0; i_slice<n_slices; i_slice++){
+        const double* acc = accumulators + i_slice*SLICE_MOMENTS_ACC_SIZE;
+        const double n = acc[0];
+        if (n > threshold_n_macroparticles){
+            moments[i_slice] = n * weight;
+            for (int j=1; j<SLICE_MOMENTS_ACC_SIZE; j++){
+                moments[j*n_slices + i_slice] =
+                    (j <= SLICE_MOMENTS_N_MEANS) ? acc[j] : acc[j] / n;
             }
         }else{
-            for(int j = 0;j<n_first_moments;++j){
-                moments[j*n_slices+i_slice] = 0.0;
+            for (int j=0; j<SLICE_MOMENTS_ACC_SIZE; j++){
+                moments[j*n_slices + i_slice] = 0.0;
             }
         }
     }
-    //////// second order moments ///////////////
-    #pragma omp parallel default(none) firstprivate(n_part,n_slices,n_first_moments,n_second_moments) shared(particles,moments,particles_slice) //only_for_context cpu_openmp
-    { //only_for_context cpu_openmp
-        double tmpSliceM2[n_slices*n_second_moments];
-        for(int i = 0;i<n_slices*n_second_moments;++i) {
-            tmpSliceM2[i] = 0.0;
+}
+
+// Single pass over the particles: they are split in n_chunks contiguous
+// chunks, each accumulated on its own part of accumulators (which needs to
+// hold n_chunks*slice_moments_accumulators_stride(n_slices) doubles), and the
+// chunks are then merged by slice_moments_reduce.
+void compute_slice_moments(ParticlesData particles, int64_t* particles_slice, double* moments, int n_slices, int threshold_n_macroparticles,
+                           int64_t n_chunks, double* accumulators) {
+    const int64_t n_part = ParticlesData_get__capacity(particles);
+    const int64_t stride = slice_moments_accumulators_stride(n_slices);
+    const int64_t chunk = (n_part + n_chunks - 1) / n_chunks;
+
+    // Each chunk is cleared by the thread that fills it (first touch)
+    #pragma omp parallel for schedule(static, 1) //only_for_context cpu_openmp
+    for (int64_t ichunk=0; ichunk<n_chunks; ichunk++){
+        double* acc = accumulators + ichunk*stride;
+        for (int64_t ii=0; ii<stride; ii++){
+            acc[ii] = 0.;
         }
-        #pragma omp for //only_for_context cpu_openmp
-        for(int i = 0;i<n_part;++i) {
-            int i_slice = particles_slice[i];
-            if(i_slice >=0 && i_slice < n_slices && ParticlesData_get_state(particles,i)>0){
-                tmpSliceM2[i_slice] += ParticlesData_get_x(particles,i)*ParticlesData_get_x(particles,i); //Sigma_11
-                tmpSliceM2[n_slices + i_slice] += ParticlesData_get_x(particles,i)*ParticlesData_get_px(particles,i); //Sigma_12
-                tmpSliceM2[2*n_slices + i_slice] += ParticlesData_get_x(particles,i)*ParticlesData_get_y(particles,i); //Sigma_13
-                tmpSliceM2[3*n_slices + i_slice] += ParticlesData_get_x(particles,i)*ParticlesData_get_py(particles,i); //Sigma_14
-                tmpSliceM2[4*n_slices + i_slice] += ParticlesData_get_px(particles,i)*ParticlesData_get_px(particles,i); //Sigma_22
-                tmpSliceM2[5*n_slices + i_slice] += ParticlesData_get_px(particles,i)*ParticlesData_get_y(particles,i); //Sigma_23
-                tmpSliceM2[6*n_slices + i_slice] += ParticlesData_get_px(particles,i)*ParticlesData_get_py(particles,i); //Sigma_24
-                tmpSliceM2[7*n_slices + i_slice] += ParticlesData_get_y(particles,i)*ParticlesData_get_y(particles,i); //Sigma_33
-                tmpSliceM2[8*n_slices + i_slice] += ParticlesData_get_y(particles,i)*ParticlesData_get_py(particles,i); //Sigma_34
-                tmpSliceM2[9*n_slices + i_slice] += ParticlesData_get_py(particles,i)*ParticlesData_get_py(particles,i); //Sigma_44
+
+        const int64_t pstart = ichunk*chunk;
+        const int64_t pend = (pstart + chunk < n_part) ? pstart + chunk : n_part;
+        for (int64_t i=pstart; i<pend; i++){
+            const int64_t i_slice = particles_slice[i];
+            if (i_slice >= 0 && i_slice < n_slices && ParticlesData_get_state(particles,i)>0){
+                slice_moments_accumulate_particle(
+                    acc + i_slice*SLICE_MOMENTS_ACC_SIZE, particles, i);
             }
         }
+    }
+
+    slice_moments_reduce(moments, n_slices, threshold_n_macroparticles,
+                         ParticlesData_get_weight(particles,0), n_chunks, accumulators);
+}
+
+// Same as TempSlicer.assign_slices followed by compute_slice_moments, in one
+// pass: the slice of each particle is computed from its zeta (in O(1) if
+// uniform_bins, otherwise with count_edges_above) and accumulated right
+// away. The slice indices are written to particles_slice only if
+// store_slices.
+void slice_and_compute_moments(ParticlesData particles, const double* bin_edges, int64_t n_slices, int64_t uniform_bins,
+                               int64_t threshold_n_macroparticles, int64_t store_slices, int64_t* particles_slice,
+                               double* moments, int64_t n_chunks, double* accumulators) {
+    const int64_t n_part = ParticlesData_get__capacity(particles);
+    const int64_t stride = slice_moments_accumulators_stride(n_slices);
+    const int64_t chunk = (n_part + n_chunks - 1) / n_chunks;
+
+    #pragma omp parallel for schedule(static, 1) //only_for_context cpu_openmp
+    for (int64_t ichunk=0; ichunk<n_chunks; ichunk++){
+        double* acc = accumulators + ichunk*stride;
+        for (int64_t ii=0; ii<stride; ii++){
+            acc[ii] = 0.;
+        }
 
-        #pragma omp critical //only_for_context cpu_openmp
-        { //only_for_context cpu_openmp
-            for (int i_slice = 0;i_slice<n_slices;++i_slice) {
-                for(int j = 0;j<n_second_moments;++j) {
-                    moments[(n_first_moments+j)*n_slices+i_slice] += tmpSliceM2[j*n_slices+i_slice];
+        const int64_t pstart = ichunk*chunk;
+        const int64_t pend = (pstart + chunk < n_part) ? pstart + chunk : n_part;
+        for (int64_t i=pstart; i<pend; i++){
+            int64_t i_slice = -1;
+            if (ParticlesData_get_state(particles,i)>0){
+                const double zeta = ParticlesData_get_zeta(particles,i);
+                i_slice = (uniform_bins ?
+                    count_edges_above_uniform(bin_edges, n_slices + 1, zeta) :
+                    count_edges_above(bin_edges, n_slices + 1, zeta)) - 1;
+                if (i_slice >= 0 && i_slice < n_slices){
+                    slice_moments_accumulate_particle(
+                        acc + i_slice*SLICE_MOMENTS_ACC_SIZE, particles, i);
                 }
             }
-        } //only_for_context cpu_openmp
-    } //only_for_context cpu_openmp
-    for(int i_slice = 0;i_slice<n_slices;++i_slice) {
-        if(moments[i_slice] > threshold_n_macroparticles){
-            for(int j = n_first_moments;j<n_moments;++j){
-                moments[j*n_slices+i_slice] /= moments[i_slice];
+            if (store_slices){
+                particles_slice[i] = i_slice;
             }
-            moments[7*n_slices + i_slice] -= moments[n_slices+i_slice]*moments[n_slices+i_slice]; //Sigma_11
-            moments[8*n_slices + i_slice] -= moments[n_slices+i_slice]*moments[2*n_slices+i_slice]; //Sigma_12
-            moments[9*n_slices + i_slice] -= moments[n_slices+i_slice]*moments[3*n_slices+i_slice]; //Sigma_13
-            moments[10*n_slices + i_slice] -= moments[n_slices+i_slice]*moments[4*n_slices+i_slice]; //Sigma_14
-            moments[11*n_slices + i_slice] -= moments[2*n_slices+i_slice]*moments[2*n_slices+i_slice]; //Sigma_22
-            moments[12*n_slices + i_slice] -= moments[2*n_slices+i_slice]*moments[3*n_slices+i_slice]; //Sigma_23
-            moments[13*n_slices + i_slice] -= moments[2*n_slices+i_slice]*moments[4*n_slices+i_slice]; //Sigma_24
-            moments[14*n_slices + i_slice] -= moments[3*n_slices+i_slice]*moments[3*n_slices+i_slice]; //Sigma_33
-            moments[15*n_slices + i_slice] -= moments[3*n_slices+i_slice]*moments[4*n_slices+i_slice]; //Sigma_34
-            moments[16*n_slices + i_slice] -= moments[4*n_slices+i_slice]*moments[4*n_slices+i_slice]; //Sigma_44
-            moments[i_slice] *= ParticlesData_get_weight(particles,0);  // added to scale num_macroparts_per_slice to real charge
-        }else{
-            for(int j = n_first_moments;j<n_moments;++j){
-                moments[j*n_slices+i_slice] = 0.0;
+        }
+    }
+
+    slice_moments_reduce(moments, n_slices, threshold_n_macroparticles,
+                         ParticlesData_get_weight(particles,0), n_chunks, accumulators);
+}
+
+// Incremental updates (IncrementalSliceMoments in temp_slicer.py): the
+// accumulators of all slices (n_slices*SLICE_MOMENTS_ACC_SIZE doubles) are
+// kept between steps, the particles listed in particle_ids are removed from
+// them before they are kicked and added back after, with their new slice.
+// particles_slice holds the slice in which each particle is accumulated.
+
+void slice_moments_remove(double* acc, const double* v){
+    // Inverse of slice_moments_accumulate
+    const double n = acc[0] - 1.;
+    if (n <= 0.){
+        for (int j=0; j<SLICE_MOMENTS_ACC_SIZE; j++){
+            acc[j] = 0.;
+        }
+        return;
+    }
+    double d_old[4], d_new[4];
+    acc[0] = n;
+    for (int j=0; j<SLICE_MOMENTS_N_MEANS; j++){
+        const double mean = acc[1+j];
+        acc[1+j] -= (v[j] - mean) / n;
+        if (j < 4){
+            d_old[j] = v[j] - acc[1+j];
+            d_new[j] = v[j] - mean;
+        }
+    }
+    double* c = acc + 1 + SLICE_MOMENTS_N_MEANS;
+    int k = 0;
+    for (int a=0; a<4; a++){
+        for (int b=a; b<4; b++){
+            c[k++] -= d_old[a] * d_new[b];
+        }
+    }
+}
+
+void slice_moments_remove_particles(ParticlesData particles, const int64_t* particle_ids, int64_t n_ids,
+                                    int64_t n_slices, int64_t* particles_slice, double* accumulators){
+    for (int64_t ii=0; ii<n_ids; ii++){
+        const int64_t i = particle_ids[ii];
+        const int64_t i_slice = particles_slice[i];
+        if (i_slice >= 0 && i_slice < n_slices){
+            const double v[SLICE_MOMENTS_N_MEANS] = {
+                ParticlesData_get_x(particles,i),
+                ParticlesData_get_px(particles,i),
+                ParticlesData_get_y(particles,i),
+                ParticlesData_get_py(particles,i),
+                ParticlesData_get_zeta(particles,i),
+                ParticlesData_get_delta(particles,i)};
+            slice_moments_remove(accumulators + i_slice*SLICE_MOMENTS_ACC_SIZE, v);
+        }
+        particles_slice[i] = -1;
+    }
+}
+
+void slice_moments_add_particles(ParticlesData particles, const int64_t* particle_ids, int64_t n_ids,
+                                 const double* bin_edges, int64_t n_slices, int64_t uniform_bins,
+                                 int64_t* particles_slice, double* accumulators){
+    for (int64_t ii=0; ii<n_ids; ii++){
+        const int64_t i = particle_ids[ii];
+        int64_t i_slice = -1;
+        if (ParticlesData_get_state(particles,i)>0){
+            const double zeta = ParticlesData_get_zeta(particles,i);
+            i_slice = (uniform_bins ?
+                count_edges_above_uniform(bin_edges, n_slices + 1, zeta) :
+                count_edges_above(bin_edges, n_slices + 1, zeta)) - 1;
+            if (i_slice >= 0 && i_slice < n_slices){
+                slice_moments_accumulate_particle(
+                    accumulators + i_slice*SLICE_MOMENTS_ACC_SIZE, particles, i);
             }
         }
+        particles_slice[i] = i_slice;
     }
+}
 
+void slice_moments_from_accumulators(ParticlesData particles, double* moments, int64_t n_slices,
+                                     int64_t threshold_n_macroparticles, double* accumulators){
+    slice_moments_reduce(moments, n_slices, threshold_n_macroparticles,
+                         ParticlesData_get_weight(particles,0), 1, accumulators);
 }
 #endif /* XFIELDS_COMPUTESLICEMOMENTS_H__ */
 #endif /* XFIELDS_COMPUTESLICEMOMENTS_CUDA */
@@ -164,7 +335,11 @@ void compute_slice_moments(ParticlesData particles, int64_t* particles_slice, do
 #ifndef XFIELDS_COMPUTESLICEMOMENTS_CUH__
 #define XFIELDS_COMPUTESLICEMOMENTS_CUH__
 __global__ void digitize(ParticlesData particles, const double* particles_zeta, const double* bin_edges, int n_slices, int64_t* particles_slice){};
-__global__ void compute_slice_moments(ParticlesData particles, int64_t* particles_slice, double* moments, int n_slices, int threshold_n_macroparticles){};
+__global__ void compute_slice_moments(ParticlesData particles, int64_t* particles_slice, double* moments, int n_slices, int threshold_n_macroparticles, int64_t n_chunks, double* accumulators){};
+__global__ void slice_moments_remove_particles(ParticlesData particles, const int64_t* particle_ids, int64_t n_ids, int64_t n_slices, int64_t* particles_slice, double* accumulators){};
+__global__ void slice_moments_add_particles(ParticlesData particles, const int64_t* particle_ids, int64_t n_ids, const double* bin_edges, int64_t n_slices, int64_t uniform_bins, int64_t* particles_slice, double* accumulators){};
+__global__ void slice_moments_from_accumulators(ParticlesData particles, double* moments, int64_t n_slices, int64_t threshold_n_macroparticles, double* accumulators){};
+__global__ void slice_and_compute_moments(ParticlesData particles, const double* bin_edges, int64_t n_slices, int64_t uniform_bins, int64_t threshold_n_macroparticles, int64_t store_slices, int64_t* particles_slice, double* moments, int64_t n_chunks, double* accumulators){};
 
 __global__ void compute_slice_moments_cuda_sums_per_slice(ParticlesData particles,
                         int64_t* particles_slice, double* moments, const int64_t num_macroparticles, const int64_t n_slices, const int64_t shared_mem_size_bytes) {
@@ -1,47 +1,155 @@
-#include <stdio.h>
-#include <gsl/gsl_errno.h>
-#include <gsl/gsl_histogram2d.h>
-
-int fillHistogram(gsl_histogram2d* h1, ParticlesData particles,int npart){
-    int countOutsideOfDomain = 0;
-    int histOut;
-    for(int i = 0;i<npart;++i) {
-        histOut = gsl_histogram2d_increment(h1, ParticlesData_get_x(particles, i), ParticlesData_get_y(particles, i));
-        if(histOut==GSL_EDOM){
-            countOutsideOfDomain++;
-        }       
+// copyright ################################# //
+// This file is part of the Xfields Package.   //
+// Copyright (c) CERN, 2021.                   //
+// ########################################### //
+
+#ifndef XFIELDS_LUMICALC_H
+#define XFIELDS_LUMICALC_H
+
+// Histograms of the transverse distribution of the beams used for the
+// luminosity: each slice has a uniform grid of n_cells x n_cells cells
+// spanning [-half_width_x, half_width_x) x [-half_width_y, half_width_y),
+// laid out as [i_slice][iy][ix] and holding the number of particles per cell.
+
+/*gpufun*/
+int64_t lumigrid_cell_index(const double x, const double y,
+                            const int64_t n_cells,
+                            const double half_width_x,
+                            const double half_width_y){
+    // Returns iy*n_cells + ix, or -1 if the point is outside of the grid
+    if (!(fabs(x) < half_width_x && fabs(y) < half_width_y)){
+        return -1;
+    }
+    int64_t ix = (int64_t) ((x + half_width_x) * (0.5*n_cells/half_width_x));
+    int64_t iy = (int64_t) ((y + half_width_y) * (0.5*n_cells/half_width_y));
+    // guard against rounding at the upper edge
+    if (ix > n_cells - 1) ix = n_cells - 1;
+    if (iy > n_cells - 1) iy = n_cells - 1;
+    return iy*n_cells + ix;
+}
+
+/*gpufun*/
+double lumigrid_overlap_row(/*gpuglmem*/ const double* h1,
+                            /*gpuglmem*/ const double* h2,
+                            const int64_t nx, const int64_t ny,
+                            const int64_t iy){
+    // Row iy of the trapezoidal sum of h1*h2 (edge cells weigh 1/2)
+    const double wy = (iy == 0 || iy == ny-1) ? 0.5 : 1.;
+    const int64_t i0 = iy*nx;
+    double row = 0.5 * (h1[i0]*h2[i0] + h1[i0+nx-1]*h2[i0+nx-1]);
+    for (int64_t ix = 1; ix < nx-1; ix++){
+        row += h1[i0+ix] * h2[i0+ix];
+    }
+    return wy * row;
+}
+
+/*gpufun*/
+double compute_lumi_integral(/*gpuglmem*/ const double* h1,
+                             /*gpuglmem*/ const double* h2,
+                             const int64_t nx, const int64_t ny,
+                             const double dx, const double dy){
+    // Overlap integral [m^-2] of two histograms of the number of particles
+    // per cell (laid out as [iy][ix]), using the trapezoidal rule on the
+    // cell densities h/(dx*dy)
+    double integral = 0.;
+    for (int64_t iy = 0; iy < ny; iy++){
+        integral += lumigrid_overlap_row(h1, h2, nx, ny, iy);
+    }
+    return integral / (dx*dy);
+}
+
+// Bins the particles with slice index in [i_slice_min, i_slice_max] and adds
+// them to the histograms of their slice in lumigrid (which holds all slices).
+// CPU only: the particles are split in n_private_grids contiguous chunks,
+// each chunk is binned without atomics on its own copy of the histograms of
+// the selected slices and the copies are then summed with a pairwise tree
+// reduction. private_grids needs to hold
+// n_private_grids*(i_slice_max-i_slice_min+1)*n_cells*n_cells doubles.
+/*gpukern*/ void lumigrid_fill_private_grids(
+        const int64_t nparticles,
+        /*gpuglmem*/ const double* x,
+        /*gpuglmem*/ const double* y,
+        /*gpuglmem*/ const double* weight,
+        /*gpuglmem*/ const int64_t* state,
+        /*gpuglmem*/ const int64_t* slice_index,
+        const int64_t i_slice_min,
+        const int64_t i_slice_max,
+        const int64_t n_cells,
+        const double half_width_x,
+        const double half_width_y,
+        const int64_t n_private_grids,
+        /*gpuglmem*/ double* private_grids,
+        /*gpuglmem*/ double* lumigrid){
+
+    const int64_t nelem = (i_slice_max - i_slice_min + 1)*n_cells*n_cells;
+    const int64_t chunk = (nparticles + n_private_grids - 1) / n_private_grids;
+
+    // Each grid is cleared by the thread that fills it (first touch)
+    #pragma omp parallel for schedule(static, 1) //only_for_context cpu_openmp
+    for (int64_t igrid=0; igrid<n_private_grids; igrid++){
+        /*gpuglmem*/ double* this_grid = private_grids + igrid*nelem;
+        for (int64_t ii=0; ii<nelem; ii++){
+            this_grid[ii] = 0.;
+        }
+
+        const int64_t pstart = igrid*chunk;
+        const int64_t pend = (pstart + chunk < nparticles) ?
+                                            pstart + chunk : nparticles;
+        for (int64_t pidx=pstart; pidx<pend; pidx++){
+            const int64_t i_slice = slice_index[pidx];
+            if (state[pidx] > 0
+                    && i_slice >= i_slice_min && i_slice <= i_slice_max){
+                const int64_t icell = lumigrid_cell_index(x[pidx], y[pidx],
+                                    n_cells, half_width_x, half_width_y);
+                if (icell >= 0){
+                    this_grid[(i_slice - i_slice_min)*n_cells*n_cells + icell]
+                                                            += weight[pidx];
+                }
+            }
+        }
+    }
+
+    // Pairwise tree reduction into grid 0 (for a given number of grids the
+    // summation order is fixed, it does not depend on the thread scheduling)
+    for (int64_t stride=1; stride<n_private_grids; stride*=2){
+        #pragma omp parallel for //only_for_context cpu_openmp
+        for (int64_t ii=0; ii<nelem; ii++){
+            for (int64_t igrid=0; igrid+stride<n_private_grids; igrid+=2*stride){
+                private_grids[igrid*nelem + ii] +=
+                                private_grids[(igrid+stride)*nelem + ii];
+            }
+        }
+    }
+
+    /*gpuglmem*/ double* target = lumigrid + i_slice_min*n_cells*n_cells;
+    #pragma omp parallel for //only_for_context cpu_openmp
+    for (int64_t ii=0; ii<nelem; ii++){
+        target[ii] += private_grids[ii];
     }
-    return countOutsideOfDomain;
 }
 
-int compute_lumi_integral(gsl_histogram2d* h1,gsl_histogram2d* h2,double intensity1,double intensity2,double *lumicombi) {
-         double sum1= gsl_histogram2d_sum(h1);
-         double sum2= gsl_histogram2d_sum(h2);
-         float dx=( gsl_histogram2d_xmax(h1)- gsl_histogram2d_xmin(h1))/gsl_histogram2d_nx(h1);
-         float dy=( gsl_histogram2d_ymax(h1)- gsl_histogram2d_ymin(h1))/gsl_histogram2d_ny(h1);
-         double scale1=1.0/(sum1*dx*dy);
-         double scale2=1.0/(sum2*dx*dy);
-         gsl_histogram2d_scale(h1,scale1);
-         gsl_histogram2d_scale(h2,scale2);
-         gsl_histogram2d_mul(h1,h2); //                                                                     
-         long double integral=0.25*dx*dy*(gsl_histogram2d_get(h1, 0, 0)+gsl_histogram2d_get(h1, gsl_histogram2d_nx(h1)-1, 0)+gsl_histogram2d_get(h1, 0, gsl_histogram2d_ny(h1)-1)+gsl_histogram2d_get(h1, gsl_histogram2d_nx(h1)-1, gsl_histogram2d_ny(h1)-1));
-         double secondPart=0.0;
-         double thirdPart=0.0;
-         double fourthPart=0.0;
-         for(int i = 0;i<gsl_histogram2d_nx(h1)-1;i++) {
-           for(int j = 0;j<gsl_histogram2d_ny(h1)-1;j++) {
-             secondPart+= gsl_histogram2d_get(h1,i+1,j+1);
-           }
-         }
-         for(int i = 0;i<gsl_histogram2d_nx(h1)-1;i++) {
-
-           thirdPart+= gsl_histogram2d_get(h1,i+1,0)+gsl_histogram2d_get(h1,i+1,gsl_histogram2d_ny(h1)-1);
-         }
-         for(int i = 0;i<gsl_histogram2d_nx(h1)-1;i++) {
-
-           fourthPart+= gsl_histogram2d_get(h1,0,i+1)+gsl_histogram2d_get(h1,gsl_histogram2d_nx(h1)-1,i+1);
-         }
-         double integralf= integral + 0.25*dx*dy*(4*secondPart+2*thirdPart+2*fourthPart);
-         *lumicombi =  intensity1*intensity2*integralf;
+// Rows of the overlap integrals of the slices colliding at a given step:
+// slice i_slice_min + irow/n_cells of lumigrid_my_beam with slice
+// timestep - i_slice of lumigrid_other_beam. Each row is summed by one
+// thread, the rows are reduced by BeamBeam3D_selective_compute_lumi_integral.
+/*gpukern*/ void lumigrid_overlap_rows(
+        const int64_t n_rows,
+        const int64_t n_cells,
+        const int64_t timestep,
+        const int64_t i_slice_min,
+        /*gpuglmem*/ const double* lumigrid_my_beam,
+        /*gpuglmem*/ const double* lumigrid_other_beam,
+        /*gpuglmem*/ double* row_sums){
+
+    #pragma omp parallel for //only_for_context cpu_openmp
+    for (int64_t irow=0; irow<n_rows; irow++){ //vectorize_over irow n_rows
+        const int64_t i_slice = i_slice_min + irow / n_cells;
+        const int64_t i_slice_other_beam = timestep - i_slice;
+        row_sums[irow] = lumigrid_overlap_row(
+                lumigrid_my_beam + i_slice*n_cells*n_cells,
+                lumigrid_other_beam + i_slice_other_beam*n_cells*n_cells,
+                n_cells, n_cells, irow % n_cells);
+    }//end_vectorize
 }
 
+#endif
@@ -0,0 +1,66 @@
+// copyright ################################# //
+// This file is part of the Xfields Package.   //
+// Copyright (c) CERN, 2021.                   //
+// ########################################### //
+
+#ifndef XFIELDS_RECORD_CHUNKS_H
+#define XFIELDS_RECORD_CHUNKS_H
+
+// Chunked allocation of the slots of a record table (compile with
+// XFIELDS_RECORD_CHUNKS). Instead of one atomic increment of the record
+// counter per photon, each kernel call reserves XFIELDS_RECORD_CHUNK_SIZE
+// consecutive slots at a time and fills them without synchronization. The
+// slots of a chunk that are not used stay zeroed (primary_energy == 0) and
+// are dropped by PhotonRecordWriter. Only the CPU contexts use it, where one
+// kernel call handles a whole chunk of particles; the GPU contexts keep one
+// slot per photon.
+#ifdef XFIELDS_RECORD_CHUNKS
+#define XFIELDS_USE_RECORD_CHUNKS //only_for_context cpu_serial cpu_openmp
+#endif
+#ifndef XFIELDS_RECORD_CHUNK_SIZE
+#define XFIELDS_RECORD_CHUNK_SIZE 64
+#endif
+
+typedef struct {
+    int64_t next;   // next free slot of the current chunk
+    int64_t end;    // one past the last slot of the current chunk
+} RecordChunk;
+
+/*gpufun*/
+void RecordChunk_init(RecordChunk* chunk){
+    chunk->next = 0;
+    chunk->end = 0;
+}
+
+/*gpufun*/
+int64_t RecordChunk_get_slot(RecordChunk* chunk, RecordIndex record_index){
+    // Same convention as RecordIndex_get_slot: negative if the record is
+    // NULL or full
+    #ifdef XFIELDS_USE_RECORD_CHUNKS
+    if (record_index == NULL){
+        return -2;
+    }
+    if (chunk->next >= chunk->end){
+        const int64_t capacity = RecordIndex_get_capacity(record_index);
+        /*gpuglmem*/ uint32_t* num_recorded = RecordIndex_getp_num_recorded(record_index);
+        if (*num_recorded >= capacity){
+            return -1;
+        }
+        const int64_t start = atomicAdd(num_recorded,
+                                        (uint32_t) XFIELDS_RECORD_CHUNK_SIZE);
+        if (start >= capacity){
+            *num_recorded = capacity;
+            return -1;
+        }
+        chunk->next = start;
+        chunk->end = (start + XFIELDS_RECORD_CHUNK_SIZE < capacity) ?
+                            start + XFIELDS_RECORD_CHUNK_SIZE : capacity;
+    }
+    return chunk->next++;
+    #else
+    (void) chunk;
+    return RecordIndex_get_slot(record_index);
+    #endif
+}
+
+#endif
@@ -3,4 +3,6 @@
 # Copyright (c) CERN, 2021.                   #
 # ########################################### #
 
-from .fftsolvers import FFTSolver3D, FFTSolver2p5D
\ No newline at end of file
+from .fftsolvers import FFTSolver3D, FFTSolver2p5D
+from .fftsolvers import FFTSolver3DR2C, FFTSolver2p5DR2C, FFTSolver3DPruned
+from .fftsolvers import set_green_function_cache_dir, clear_green_spectrum_cache
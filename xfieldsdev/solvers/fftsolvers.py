@@ -3,13 +3,100 @@
 # Copyright (c) CERN, 2021.                   #
 # ########################################### #
 
+import hashlib
+import inspect
+import os
+from pathlib import Path
+
 import numpy as np
 from scipy.constants import epsilon_0
 from numpy import pi
 
 from .base import Solver
+from ..general import _pkg_root
+
+import xobjects as xo
+from xobjects import context_default, ContextPyopencl
 
-from xobjects import context_default
+# Transformed Green functions shared by all the solvers built for the same
+# geometry on the same context (they are never modified after creation)
+_green_spectrum_cache = {}
+
+# Optional directory where the transformed Green functions are stored and
+# from which they are memory mapped (see set_green_function_cache_dir)
+_green_spectrum_cache_dir = os.environ.get(
+                                    'XFIELDS_GREEN_FUNCTION_CACHE_DIR', None)
+
+def clear_green_spectrum_cache():
+    '''
+    Releases the transformed Green functions kept by the solvers cache
+    (the files in the on-disk cache are not removed).
+    '''
+    _green_spectrum_cache.clear()
+
+def set_green_function_cache_dir(path):
+    '''
+    Enables the on-disk cache of the transformed Green functions. Solvers
+    built for a geometry already present in the directory load the spectrum
+    from there (memory mapped on CPU) instead of computing it. The cache can
+    be shared among processes. The default directory is taken from the
+    environment variable ``XFIELDS_GREEN_FUNCTION_CACHE_DIR``.
+
+    Args:
+        path (str or Path): Cache directory, ``None`` disables the cache.
+    '''
+    global _green_spectrum_cache_dir
+    if path is not None:
+        Path(path).mkdir(parents=True, exist_ok=True)
+    _green_spectrum_cache_dir = path
+
+def _get_green_spectrum(context, kind, nx, ny, nz, dx, dy, dz, dtype,
+                        compute_spectrum):
+
+    key = (kind, nx, ny, nz, dx, dy, dz, np.dtype(dtype).str)
+
+    if (context,) + key in _green_spectrum_cache:
+        return _green_spectrum_cache[(context,) + key]
+
+    spectrum = None
+    if _green_spectrum_cache_dir is not None:
+        fname = Path(_green_spectrum_cache_dir).joinpath(
+            f'green_{kind}_{hashlib.sha1(repr(key).encode()).hexdigest()}.npy')
+        if fname.exists():
+            spectrum = np.load(fname, mmap_mode='r')
+        else:
+            spectrum = compute_spectrum().astype(dtype)
+            # Write and rename, so that concurrent jobs never see partial files
+            fname_tmp = fname.with_suffix(f'.{os.getpid()}.tmp')
+            with open(fname_tmp, 'wb') as fid:
+                np.save(fid, spectrum)
+            os.replace(fname_tmp, fname)
+    else:
+        spectrum = compute_spectrum().astype(dtype)
+
+    spectrum_dev = context.nparray_to_context_array(spectrum)
+    _green_spectrum_cache[(context,) + key] = spectrum_dev
+    return spectrum_dev
+
+_fftsolvers_kernels = {
+    'fftsolver_multiply_slices_by_spectrum': xo.Kernel(
+        args=[
+            xo.Arg(xo.Int64,   pointer=False, name='n_xy'),
+            xo.Arg(xo.Int64,   pointer=False, name='n_slices'),
+            xo.Arg(xo.Int64,   pointer=False, name='n_tot'),
+            xo.Arg(xo.Float64, pointer=True,  name='workspace'),
+            xo.Arg(xo.Float64, pointer=True,  name='spectrum'),
+            ],
+        n_threads='n_tot'
+        ),
+    }
+
+def _add_fftsolvers_kernels(context):
+    if 'fftsolver_multiply_slices_by_spectrum' not in context.kernels.keys():
+        context.add_kernels(
+            sources=[_pkg_root.joinpath(
+                        'solvers/fftsolvers_src/multiply_spectrum.h')],
+            kernels=_fftsolvers_kernels)
 
 class FFTSolver2D(Solver):
 
@@ -31,11 +118,17 @@ class FFTSolver3D(Solver):
         dz (float): Longitudinal cell size in meters.
         context (XfContext): identifies the :doc:`context <contexts>`
             on which the computation is executed.
+        fftplan (FFT plan): FFT plan to be reused (it needs to be built for
+            the same workspace shape).
+        workspace (complex128 array): Workspace to be used by the solver. It
+            can be shared among solvers with the same grid size, which are
+            used one at a time. If not provided, a new one is allocated.
     Returns:
         (FFTSolver3D): Poisson solver object.
     '''
 
-    def __init__(self, dx, dy, dz, nx, ny, nz, context=None, fftplan=None):
+    def __init__(self, dx, dy, dz, nx, ny, nz, context=None, fftplan=None,
+                 workspace=None):
 
         if context is None:
             context = context_default
@@ -43,53 +136,23 @@ class FFTSolver3D(Solver):
         self.context = context
 
         # Prepare arrays
-        workspace_dev = context.nparray_to_context_array(
-                    np.zeros((2*nx, 2*ny, 2*nz), dtype=np.complex128, order='F'))
-
-
-        # Build grid for primitive function
-        xg_F = np.arange(0, nx+2) * dx - dx/2
-        yg_F = np.arange(0, ny+2) * dy - dy/2
-        zg_F = np.arange(0, nz+2) * dz - dz/2
-        XX_F, YY_F, ZZ_F = np.meshgrid(xg_F, yg_F, zg_F, indexing='ij')
-
-        # Compute primitive
-        F_temp = primitive_func_3d(XX_F, YY_F, ZZ_F)
-
-        # Integrated Green Function (I will transform inplace)
-        gint_rep= np.zeros((2*nx, 2*ny, 2*nz), dtype=np.complex128, order='F')
-        gint_rep[:nx+1, :ny+1, :nz+1] = (F_temp[ 1:,  1:,  1:]
-                                       - F_temp[:-1,  1:,  1:]
-                                       - F_temp[ 1:, :-1,  1:]
-                                       + F_temp[:-1, :-1,  1:]
-                                       - F_temp[ 1:,  1:, :-1]
-                                       + F_temp[:-1,  1:, :-1]
-                                       + F_temp[ 1:, :-1, :-1]
-                                       - F_temp[:-1, :-1, :-1])
-
-        # Replicate
-        # To define how to make the replicas I have a look at:
-        # np.abs(np.fft.fftfreq(10))*10
-        # = [0., 1., 2., 3., 4., 5., 4., 3., 2., 1.]
-        gint_rep[nx+1:, :ny+1, :nz+1] = gint_rep[nx-1:0:-1, :ny+1,     :nz+1    ]
-        gint_rep[:nx+1, ny+1:, :nz+1] = gint_rep[:nx+1,     ny-1:0:-1, :nz+1    ]
-        gint_rep[nx+1:, ny+1:, :nz+1] = gint_rep[nx-1:0:-1, ny-1:0:-1, :nz+1    ]
-        gint_rep[:nx+1, :ny+1, nz+1:] = gint_rep[:nx+1,     :ny+1,     nz-1:0:-1]
-        gint_rep[nx+1:, :ny+1, nz+1:] = gint_rep[nx-1:0:-1, :ny+1,     nz-1:0:-1]
-        gint_rep[:nx+1, ny+1:, nz+1:] = gint_rep[:nx+1,     ny-1:0:-1, nz-1:0:-1]
-        gint_rep[nx+1:, ny+1:, nz+1:] = gint_rep[nx-1:0:-1, ny-1:0:-1, nz-1:0:-1]
-
-        self._gint_rep = gint_rep.copy()
-
-        # Tranasfer to device
-        gint_rep_dev = context.nparray_to_context_array(gint_rep)
+        if workspace is None:
+            workspace_dev = context.zeros((2*nx, 2*ny, 2*nz),
+                                          dtype=np.complex128, order='F')
+        else:
+            assert workspace.shape == (2*nx, 2*ny, 2*nz)
+            workspace_dev = workspace
+
 
         # Prepare fft plan
         if fftplan is None:
             fftplan = context.plan_FFT(workspace_dev, axes=(0,1,2))
 
-        # Transform the green function (in place)
-        fftplan.transform(gint_rep_dev)
+        # Transformed integrated Green function (cached)
+        gint_rep_dev = _get_green_spectrum(context, kind='3d',
+            nx=nx, ny=ny, nz=nz, dx=dx, dy=dy, dz=dz, dtype=np.complex128,
+            compute_spectrum=lambda: np.asfortranarray(np.fft.fftn(
+                integrated_green_function_3d(dx, dy, dz, nx, ny, nz))))
 
         self.dx = dx
         self.dy = dy
@@ -114,26 +177,58 @@ class FFTSolver3D(Solver):
             phi (float64 array): electric potential at the grid points in Volts.
         '''
 
-        nz_alloc = self.nz
-        if self._gint_rep_transf_dev.shape[2] > 1:
-            nz_alloc = self._gint_rep_transf_dev.shape[2]
-        _workspace_dev = self.context.zeros(
-                (2*self.nx, 2*self.ny, nz_alloc), dtype=np.complex128, order='F')
+        _workspace_dev = self.solve_in_workspace(rho)
+        # copied out of the workspace, which is reused at the next call
+        return _workspace_dev.real[:self.nx, :self.ny, :self.nz].copy()
+
+    def solve_in_workspace(self, rho):
+
+        '''
+        Solves Poisson's equation in free space for a given charge density
+        reusing the workspace allocated at the creation of the solver. The
+        potential is found in the real part of the first nx, ny, nz cells
+        of the returned workspace, which is overwritten at the next call.
+
+        Args:
+            rho (float64 array): charge density at the grid points in
+                Coulomb/m^3.
+        Returns:
+            workspace (complex128 array): solver workspace containing phi.
+        '''
+
+        _workspace_dev = self._workspace_dev
+
+        # Clear the padding (the first block is overwritten by rho)
+        if isinstance(self.context, ContextPyopencl):
+            _workspace_dev.fill(0)
+        else:
+            _workspace_dev.T[self.nz:, :, :] = 0
+            _workspace_dev.T[:self.nz, self.ny:, :] = 0
+            _workspace_dev.T[:self.nz, :self.ny, self.nx:] = 0
 
         # The transposes make it faster in cupy (C-contigous arrays)
         _workspace_dev.T[:self.nz, :self.ny, :self.nx] = rho.T
         self.fftplan.transform(_workspace_dev) # rho_rep_hat
 
-        try:
+        if (isinstance(self.context, ContextPyopencl)
+                and self._gint_rep_transf_dev.shape[2] == 1):
+            # pyopencl does not support array broadcasting (used in 2.5D),
+            # all the slices are multiplied in one kernel
+            n_xy = _workspace_dev.shape[0] * _workspace_dev.shape[1]
+            self.context.kernels.fftsolver_multiply_slices_by_spectrum(
+                    n_xy=n_xy,
+                    n_slices=_workspace_dev.shape[2],
+                    n_tot=n_xy*_workspace_dev.shape[2],
+                    workspace=_workspace_dev.reshape(-1, order='F'
+                                                     ).view(np.float64),
+                    spectrum=self._gint_rep_transf_dev.reshape(-1, order='F'
+                                                     ).view(np.float64))
+        else:
             _workspace_dev.T[:,:,:] *= (
                         self._gint_rep_transf_dev.T) # phi_rep_hat
-        except Exception: # pyopencl does not support array broadcasting (used in 2.5D)
-            for ii in range(self.nz):
-                _workspace_dev.T[ii,:,:] *= (
-                        self._gint_rep_transf_dev.T[0, :, :]) # phi_rep_hat
 
         self.fftplan.itransform(_workspace_dev) #phi_rep
-        return _workspace_dev.real[:self.nx, :self.ny, :self.nz]
+        return _workspace_dev
 
 class FFTSolver2p5D(FFTSolver3D):
 
@@ -150,53 +245,43 @@ class FFTSolver2p5D(FFTSolver3D):
         dz (float): Longitudinal cell size in meters.
         context (XfContext): identifies the :doc:`context <contexts>`
             on which the computation is executed.
+        fftplan (FFT plan): FFT plan to be reused (it needs to be built for
+            the same workspace shape).
+        workspace (complex128 array): Workspace to be used by the solver. It
+            can be shared among solvers with the same grid size, which are
+            used one at a time. If not provided, a new one is allocated.
     Returns:
         (FFTSolver3D): Poisson solver object.
     '''
 
-    def __init__(self, dx, dy, dz, nx, ny, nz, context=None, fftplan=None):
+    def __init__(self, dx, dy, dz, nx, ny, nz, context=None, fftplan=None,
+                 workspace=None):
 
         if context is None:
             context = context_default
         self.context = context
 
-        # Build grid for primitive function
-        xg_F = np.arange(0, nx+2) * dx - dx/2
-        yg_F = np.arange(0, ny+2) * dy - dy/2
-        XX_F, YY_F= np.meshgrid(xg_F, yg_F, indexing='ij')
-
-        # Compute primitive
-        F_temp = primitive_func_2p5d(XX_F, YY_F)
-
-        # Integrated Green Function (I will transform inplace)
-        gint_rep= np.zeros((2*nx, 2*ny), dtype=np.complex128, order='F')
-        gint_rep[:nx+1, :ny+1] = (F_temp[ 1:,  1:]
-                                - F_temp[:-1,  1:]
-                                - F_temp[ 1:, :-1]
-                                + F_temp[:-1, :-1])
-
-        # Replicate
-        # To define how to make the replicas I have a look at:
-        # np.abs(np.fft.fftfreq(10))*10
-        # = [0., 1., 2., 3., 4., 5., 4., 3., 2., 1.]
-        gint_rep[nx+1:, :ny+1] = gint_rep[nx-1:0:-1, :ny+1]
-        gint_rep[:nx+1, ny+1:] = gint_rep[:nx+1, ny-1:0:-1]
-        gint_rep[nx+1:, ny+1:] = gint_rep[nx-1:0:-1, ny-1:0:-1]
-
-
-        # Prepare fft plan
+        # Prepare workspace and fft plan
+        if workspace is None:
+            workspace_dev = context.zeros((2*nx, 2*ny, nz),
+                                          dtype=np.complex128, order='F')
+        else:
+            assert workspace.shape == (2*nx, 2*ny, nz)
+            workspace_dev = workspace
         if fftplan is None:
-            temp_dev = context.zeros((2*nx, 2*ny, nz),
-                                    dtype=np.complex128, order='F')
-            fftplan = context.plan_FFT(temp_dev, axes=(0,1))
-            del(temp_dev)
+            fftplan = context.plan_FFT(workspace_dev, axes=(0,1))
 
-        # Transform the green function
-        gint_rep_transf = np.fft.fftn(gint_rep, axes=(0,1))
+        if isinstance(context, ContextPyopencl):
+            _add_fftsolvers_kernels(context)
 
-        # Transfer to GPU (if needed)
-        gint_rep_transf_dev = context.nparray_to_context_array(
-                                       np.atleast_3d(gint_rep_transf))
+        # Transformed Green function (computed once per geometry and shared
+        # by all 2.5D solvers on this context, the same spectrum is applied
+        # to all the slices)
+        gint_rep_transf_dev = _get_green_spectrum(context, kind='2p5d',
+            nx=nx, ny=ny, nz=None, dx=dx, dy=dy, dz=None, dtype=np.complex128,
+            compute_spectrum=lambda: np.asfortranarray(np.atleast_3d(
+                np.fft.fftn(integrated_green_function_2p5d(dx, dy, nx, ny),
+                            axes=(0,1)))))
 
         self.dx = dx
         self.dy = dy
@@ -204,54 +289,35 @@ class FFTSolver2p5D(FFTSolver3D):
         self.nx = nx
         self.ny = ny
         self.nz = nz
+        self._workspace_dev = workspace_dev
         self._gint_rep_transf_dev = gint_rep_transf_dev
         self.fftplan = fftplan
 
 class FFTSolver2p5DAveraged(Solver):
 
-    def __init__(self, dx, dy, dz, nx, ny, nz, context=None, fftplan=None):
+    def __init__(self, dx, dy, dz, nx, ny, nz, context=None, fftplan=None,
+                 workspace=None):
 
         if context is None:
             context = context_default
         self.context = context
 
-        # Build grid for primitive function
-        xg_F = np.arange(0, nx+2) * dx - dx/2
-        yg_F = np.arange(0, ny+2) * dy - dy/2
-        XX_F, YY_F= np.meshgrid(xg_F, yg_F, indexing='ij')
-
-        # Compute primitive
-        F_temp = primitive_func_2p5d(XX_F, YY_F)
-
-        # Integrated Green Function (I will transform inplace)
-        gint_rep= np.zeros((2*nx, 2*ny), dtype=np.complex128, order='F')
-        gint_rep[:nx+1, :ny+1] = (F_temp[ 1:,  1:]
-                                - F_temp[:-1,  1:]
-                                - F_temp[ 1:, :-1]
-                                + F_temp[:-1, :-1])
-
-        # Replicate
-        # To define how to make the replicas I have a look at:
-        # np.abs(np.fft.fftfreq(10))*10
-        # = [0., 1., 2., 3., 4., 5., 4., 3., 2., 1.]
-        gint_rep[nx+1:, :ny+1] = gint_rep[nx-1:0:-1, :ny+1]
-        gint_rep[:nx+1, ny+1:] = gint_rep[:nx+1, ny-1:0:-1]
-        gint_rep[nx+1:, ny+1:] = gint_rep[nx-1:0:-1, ny-1:0:-1]
-
-
-        # Prepare fft plan
+        # Prepare workspace and fft plan
+        if workspace is None:
+            workspace_dev = context.zeros((2*nx, 2*ny),
+                                          dtype=np.complex128, order='F')
+        else:
+            assert workspace.shape == (2*nx, 2*ny)
+            workspace_dev = workspace
         if fftplan is None:
-            temp_dev = context.zeros((2*nx, 2*ny),
-                                    dtype=np.complex128, order='F')
-            fftplan = context.plan_FFT(temp_dev, axes=(0,1))
-            del(temp_dev)
-
-        # Transform the green function
-        gint_rep_transf = np.fft.fftn(gint_rep, axes=(0,1))
+            fftplan = context.plan_FFT(workspace_dev, axes=(0,1))
 
-        # Transfer to GPU (if needed)
-        gint_rep_transf_dev = context.nparray_to_context_array(
-                                       np.atleast_2d(gint_rep_transf))
+        # Transformed Green function (shared with the other solvers)
+        gint_rep_transf_dev = _get_green_spectrum(context, kind='2p5d_avg',
+            nx=nx, ny=ny, nz=None, dx=dx, dy=dy, dz=None, dtype=np.complex128,
+            compute_spectrum=lambda: np.asfortranarray(np.atleast_2d(
+                np.fft.fftn(integrated_green_function_2p5d(dx, dy, nx, ny),
+                            axes=(0,1)))))
 
         self.dx = dx
         self.dy = dy
@@ -259,6 +325,7 @@ class FFTSolver2p5DAveraged(Solver):
         self.nx = nx
         self.ny = ny
         self.nz = nz
+        self._workspace_dev = workspace_dev
         self._gint_rep_transf_dev = gint_rep_transf_dev
         self.fftplan = fftplan
 
@@ -275,8 +342,8 @@ class FFTSolver2p5DAveraged(Solver):
             phi (float64 array): electric potential at the grid points in Volts.
         '''
 
-        _workspace_dev = self.context.zeros(
-                (2*self.nx, 2*self.ny), dtype=np.complex128, order='F')
+        _workspace_dev = self._workspace_dev
+        _workspace_dev[:, :] = 0
 
         sum_rho_xy = rho.sum(axis=0).sum(axis=0)
         sum_rho = sum_rho_xy.sum()
@@ -298,6 +365,373 @@ class FFTSolver2p5DAveraged(Solver):
 
         return phi
 
+class FFTSolver3DR2C(Solver):
+
+    '''
+    Creates a Poisson solver object that solves the full 3D Poisson
+    equation using the FFT method (free space), using real-to-complex
+    transforms. Since rho and the integrated Green function are real, only
+    half of the spectrum is computed and stored. As the Green function is
+    also even, its transform is real and is stored as such.
+
+    Args:
+        nx (int): Number of cells in the horizontal direction.
+        ny (int): Number of cells in the vertical direction.
+        nz (int): Number of cells in the vertical direction.
+        dx (float): Horizontal cell size in meters.
+        dy (float): Vertical cell size in meters.
+        dz (float): Longitudinal cell size in meters.
+        context (XfContext): identifies the :doc:`context <contexts>`
+            on which the computation is executed (CPU or cupy).
+        fftplan: Not used (the transforms are planned by the FFT library).
+        workspace (float64 array): Real workspace of shape (2nx, 2ny, 2nz)
+            to be used by the solver. If not provided, a new one is
+            allocated.
+    Returns:
+        (FFTSolver3DR2C): Poisson solver object.
+    '''
+
+    def __init__(self, dx, dy, dz, nx, ny, nz, context=None, fftplan=None,
+                 workspace=None):
+
+        if context is None:
+            context = context_default
+
+        if isinstance(context, ContextPyopencl):
+            raise NotImplementedError(
+                'Real-to-complex solvers are not available on pyopencl')
+
+        self.context = context
+
+        self._init_r2c(key=dict(kind='3d_r2c', nx=nx, ny=ny, nz=nz,
+                                dx=dx, dy=dy, dz=dz),
+                compute_gint_rep=lambda: integrated_green_function_3d(
+                                                    dx, dy, dz, nx, ny, nz),
+                shape=(2*nx, 2*ny, 2*nz), axes=(2, 1, 0), workspace=workspace)
+
+        self.dx = dx
+        self.dy = dy
+        self.dz = dz
+        self.nx = nx
+        self.ny = ny
+        self.nz = nz
+
+    def _init_r2c(self, key, compute_gint_rep, shape, axes, workspace):
+
+        def compute_spectrum():
+            # The last axis in the list (x, contiguous in memory) is the one
+            # halved by the real transform
+            gint_hat = np.fft.rfftn(compute_gint_rep(), axes=axes).real
+            if gint_hat.ndim < len(shape):
+                gint_hat = gint_hat[:, :, np.newaxis]
+            return np.asfortranarray(gint_hat)
+
+        if workspace is None:
+            workspace = self.context.zeros(shape, dtype=np.float64, order='F')
+        else:
+            assert workspace.shape == shape
+            assert workspace.dtype == np.float64
+
+        self._axes = axes
+        self._fft_shape = tuple(shape[ii] for ii in axes)
+        self._workspace_dev = workspace
+
+        # Half spectrum of the workspace, the real transform halves the
+        # last axis in the list
+        spectrum_shape = list(shape)
+        spectrum_shape[axes[-1]] = shape[axes[-1]] // 2 + 1
+        self._spectrum_dev = self.context.zeros(tuple(spectrum_shape),
+                                        dtype=np.complex128, order='F')
+        # numpy >= 2 writes the transforms in preallocated arrays
+        self._fft_out = (isinstance(self.context, xo.ContextCpu)
+            and 'out' in inspect.signature(np.fft.rfft).parameters)
+        self._gint_rep_transf_dev = _get_green_spectrum(self.context, **key,
+                            dtype=np.float64, compute_spectrum=compute_spectrum)
+        self.fftplan = None
+
+    #@profile
+    def solve(self, rho):
+
+        '''
+        Solves Poisson's equation in free space for a given charge density.
+
+        Args:
+            rho (float64 array): charge density at the grid points in
+                Coulomb/m^3.
+        Returns:
+            phi (float64 array): electric potential at the grid points in Volts.
+        '''
+
+        phi_rep = self.solve_in_workspace(rho)
+        # copied out of the workspace, which is reused at the next call
+        return phi_rep[:self.nx, :self.ny, :self.nz].copy()
+
+    def solve_in_workspace(self, rho):
+
+        '''
+        Solves Poisson's equation in free space for a given charge density
+        reusing the workspace allocated at the creation of the solver. The
+        potential is found in the first nx, ny, nz cells of the returned
+        workspace, which is overwritten at the next call. On CPU with
+        numpy >= 2 the transforms are computed in the preallocated
+        workspace and half spectrum, otherwise the FFT library allocates
+        its outputs and the potential is copied into the workspace.
+
+        Args:
+            rho (float64 array): charge density at the grid points in
+                Coulomb/m^3.
+        Returns:
+            workspace (float64 array): solver workspace containing phi on
+                the doubled grid.
+        '''
+
+        fft = self.context.nplike_lib.fft
+        _workspace_dev = self._workspace_dev
+
+        # Clear the padding (the first block is overwritten by rho)
+        _workspace_dev.T[self.nz:, :, :] = 0
+        _workspace_dev.T[:self.nz, self.ny:, :] = 0
+        _workspace_dev.T[:self.nz, :self.ny, self.nx:] = 0
+        _workspace_dev.T[:self.nz, :self.ny, :self.nx] = rho.T
+
+        if self._fft_out:
+            spectrum = self._spectrum_dev
+            fft.rfftn(_workspace_dev, axes=self._axes,
+                      out=spectrum) # rho_rep_hat
+            spectrum *= self._gint_rep_transf_dev # phi_rep_hat
+            # inverse of rfftn, axis by axis in place and back to the
+            # real workspace
+            for axis in self._axes[:-1]:
+                fft.ifft(spectrum, axis=axis, out=spectrum)
+            fft.irfft(spectrum, n=self._fft_shape[-1], axis=self._axes[-1],
+                      out=_workspace_dev) # phi_rep
+        else:
+            rho_rep_hat = fft.rfftn(_workspace_dev, axes=self._axes)
+            rho_rep_hat *= self._gint_rep_transf_dev # phi_rep_hat
+            _workspace_dev[...] = fft.irfftn(rho_rep_hat, s=self._fft_shape,
+                                             axes=self._axes) # phi_rep
+        return _workspace_dev
+
+class FFTSolver2p5DR2C(FFTSolver3DR2C):
+
+    '''
+    Creates a Poisson solver object that solve's Poisson equation in
+    the 2.5D approximation using the FFT method (free space), using
+    real-to-complex transforms (see ``FFTSolver3DR2C``).
+
+    Args:
+        nx (int): Number of cells in the horizontal direction.
+        ny (int): Number of cells in the vertical direction.
+        nz (int): Number of cells in the vertical direction.
+        dx (float): Horizontal cell size in meters.
+        dy (float): Vertical cell size in meters.
+        dz (float): Longitudinal cell size in meters.
+        context (XfContext): identifies the :doc:`context <contexts>`
+            on which the computation is executed (CPU or cupy).
+        fftplan: Not used (the transforms are planned by the FFT library).
+        workspace (float64 array): Real workspace of shape (2nx, 2ny, nz)
+            to be used by the solver. If not provided, a new one is
+            allocated.
+    Returns:
+        (FFTSolver2p5DR2C): Poisson solver object.
+    '''
+
+    def __init__(self, dx, dy, dz, nx, ny, nz, context=None, fftplan=None,
+                 workspace=None):
+
+        if context is None:
+            context = context_default
+
+        if isinstance(context, ContextPyopencl):
+            raise NotImplementedError(
+                'Real-to-complex solvers are not available on pyopencl')
+
+        self.context = context
+
+        self._init_r2c(key=dict(kind='2p5d_r2c', nx=nx, ny=ny, nz=None,
+                                dx=dx, dy=dy, dz=None),
+                compute_gint_rep=lambda: integrated_green_function_2p5d(
+                                                            dx, dy, nx, ny),
+                shape=(2*nx, 2*ny, nz), axes=(1, 0), workspace=workspace)
+
+        self.dx = dx
+        self.dy = dy
+        self.dz = dz
+        self.nx = nx
+        self.ny = ny
+        self.nz = nz
+
+class FFTSolver3DPruned(Solver):
+
+    '''
+    Creates a Poisson solver object that solves the full 3D Poisson
+    equation using the FFT method (free space), skipping the work on the
+    zero padding. In the forward transform the 1D FFTs along each axis are
+    computed only on the lines that are not identically zero (x on ny*nz
+    lines, y on (nx+1)*nz lines, z on all lines), in the inverse transform
+    only on the lines needed to get the first nx, ny, nz cells. The x axis
+    uses real-to-complex transforms and the Green function is stored as a
+    real half spectrum (see ``FFTSolver3DR2C``).
+
+    Args:
+        nx (int): Number of cells in the horizontal direction.
+        ny (int): Number of cells in the vertical direction.
+        nz (int): Number of cells in the vertical direction.
+        dx (float): Horizontal cell size in meters.
+        dy (float): Vertical cell size in meters.
+        dz (float): Longitudinal cell size in meters.
+        context (XfContext): identifies the :doc:`context <contexts>`
+            on which the computation is executed (CPU or cupy).
+        fftplan: Not used (the transforms are planned by the FFT library).
+        workspace: Not used.
+    Returns:
+        (FFTSolver3DPruned): Poisson solver object.
+    '''
+
+    def __init__(self, dx, dy, dz, nx, ny, nz, context=None, fftplan=None,
+                 workspace=None):
+
+        if context is None:
+            context = context_default
+
+        if isinstance(context, ContextPyopencl):
+            raise NotImplementedError(
+                'Pruned solver is not available on pyopencl')
+
+        self.context = context
+
+        # Same spectrum as FFTSolver3DR2C (cached)
+        self._gint_rep_transf_dev = _get_green_spectrum(context, kind='3d_r2c',
+            nx=nx, ny=ny, nz=nz, dx=dx, dy=dy, dz=dz, dtype=np.float64,
+            compute_spectrum=lambda: np.asfortranarray(np.fft.rfftn(
+                integrated_green_function_3d(dx, dy, dz, nx, ny, nz),
+                axes=(2, 1, 0)).real))
+        self._workspace_dev = None
+        self.fftplan = None
+
+        self.dx = dx
+        self.dy = dy
+        self.dz = dz
+        self.nx = nx
+        self.ny = ny
+        self.nz = nz
+
+    def solve_in_workspace(self, rho):
+
+        '''
+        Solves Poisson's equation in free space for a given charge density.
+
+        Args:
+            rho (float64 array): charge density at the grid points in
+                Coulomb/m^3.
+        Returns:
+            phi (float64 array): electric potential at the grid points in Volts.
+        '''
+
+        fft = self.context.nplike_lib.fft
+        nx, ny, nz = self.nx, self.ny, self.nz
+
+        # Forward, the zero padding is added axis by axis
+        rho_hat = fft.rfft(rho, n=2*nx, axis=0)       # (nx+1, ny,  nz)
+        rho_hat = fft.fft(rho_hat, n=2*ny, axis=1)    # (nx+1, 2ny, nz)
+        rho_hat = fft.fft(rho_hat, n=2*nz, axis=2)    # (nx+1, 2ny, 2nz)
+
+        rho_hat *= self._gint_rep_transf_dev # phi_rep_hat
+
+        # Inverse, only the needed part is kept after each axis
+        phi = fft.ifft(rho_hat, axis=2)[:, :, :nz]    # (nx+1, 2ny, nz)
+        phi = fft.ifft(phi, axis=1)[:, :ny, :]        # (nx+1, ny,  nz)
+        phi = fft.irfft(phi, n=2*nx, axis=0)[:nx, :, :]
+
+        return phi
+
+    def solve(self, rho):
+
+        '''
+        Solves Poisson's equation in free space for a given charge density.
+
+        Args:
+            rho (float64 array): charge density at the grid points in
+                Coulomb/m^3.
+        Returns:
+            phi (float64 array): electric potential at the grid points in Volts.
+        '''
+
+        return self.solve_in_workspace(rho)
+
+def integrated_green_function_3d(dx, dy, dz, nx, ny, nz):
+
+    '''
+    Integrated Green function for the 3D free space Poisson equation on the
+    doubled (2nx, 2ny, 2nz) grid, replicated such that it is even along all
+    axes. The returned array is real and Fortran ordered.
+    '''
+
+    # Build grid for primitive function
+    xg_F = np.arange(0, nx+2) * dx - dx/2
+    yg_F = np.arange(0, ny+2) * dy - dy/2
+    zg_F = np.arange(0, nz+2) * dz - dz/2
+    XX_F, YY_F, ZZ_F = np.meshgrid(xg_F, yg_F, zg_F, indexing='ij')
+
+    # Compute primitive
+    F_temp = primitive_func_3d(XX_F, YY_F, ZZ_F)
+
+    gint_rep= np.zeros((2*nx, 2*ny, 2*nz), dtype=np.float64, order='F')
+    gint_rep[:nx+1, :ny+1, :nz+1] = (F_temp[ 1:,  1:,  1:]
+                                   - F_temp[:-1,  1:,  1:]
+                                   - F_temp[ 1:, :-1,  1:]
+                                   + F_temp[:-1, :-1,  1:]
+                                   - F_temp[ 1:,  1:, :-1]
+                                   + F_temp[:-1,  1:, :-1]
+                                   + F_temp[ 1:, :-1, :-1]
+                                   - F_temp[:-1, :-1, :-1])
+
+    # Replicate
+    # To define how to make the replicas I have a look at:
+    # np.abs(np.fft.fftfreq(10))*10
+    # = [0., 1., 2., 3., 4., 5., 4., 3., 2., 1.]
+    gint_rep[nx+1:, :ny+1, :nz+1] = gint_rep[nx-1:0:-1, :ny+1,     :nz+1    ]
+    gint_rep[:nx+1, ny+1:, :nz+1] = gint_rep[:nx+1,     ny-1:0:-1, :nz+1    ]
+    gint_rep[nx+1:, ny+1:, :nz+1] = gint_rep[nx-1:0:-1, ny-1:0:-1, :nz+1    ]
+    gint_rep[:nx+1, :ny+1, nz+1:] = gint_rep[:nx+1,     :ny+1,     nz-1:0:-1]
+    gint_rep[nx+1:, :ny+1, nz+1:] = gint_rep[nx-1:0:-1, :ny+1,     nz-1:0:-1]
+    gint_rep[:nx+1, ny+1:, nz+1:] = gint_rep[:nx+1,     ny-1:0:-1, nz-1:0:-1]
+    gint_rep[nx+1:, ny+1:, nz+1:] = gint_rep[nx-1:0:-1, ny-1:0:-1, nz-1:0:-1]
+
+    return gint_rep
+
+def integrated_green_function_2p5d(dx, dy, nx, ny):
+
+    '''
+    Integrated Green function for the 2D free space Poisson equation on the
+    doubled (2nx, 2ny) grid, replicated such that it is even along both
+    axes. The returned array is real and Fortran ordered.
+    '''
+
+    # Build grid for primitive function
+    xg_F = np.arange(0, nx+2) * dx - dx/2
+    yg_F = np.arange(0, ny+2) * dy - dy/2
+    XX_F, YY_F= np.meshgrid(xg_F, yg_F, indexing='ij')
+
+    # Compute primitive
+    F_temp = primitive_func_2p5d(XX_F, YY_F)
+
+    gint_rep= np.zeros((2*nx, 2*ny), dtype=np.float64, order='F')
+    gint_rep[:nx+1, :ny+1] = (F_temp[ 1:,  1:]
+                            - F_temp[:-1,  1:]
+                            - F_temp[ 1:, :-1]
+                            + F_temp[:-1, :-1])
+
+    # Replicate
+    # To define how to make the replicas I have a look at:
+    # np.abs(np.fft.fftfreq(10))*10
+    # = [0., 1., 2., 3., 4., 5., 4., 3., 2., 1.]
+    gint_rep[nx+1:, :ny+1] = gint_rep[nx-1:0:-1, :ny+1]
+    gint_rep[:nx+1, ny+1:] = gint_rep[:nx+1, ny-1:0:-1]
+    gint_rep[nx+1:, ny+1:] = gint_rep[nx-1:0:-1, ny-1:0:-1]
+
+    return gint_rep
+
 def primitive_func_3d(x,y,z):
     abs_r = np.sqrt(x * x + y * y + z * z)
     inv_abs_r = 1./abs_r
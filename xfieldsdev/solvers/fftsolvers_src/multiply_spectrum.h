@@ -0,0 +1,31 @@
+// copyright ################################# //
+// This file is part of the Xfields Package.   //
+// Copyright (c) CERN, 2021.                   //
+// ########################################### //
+
+#ifndef XFIELDS_MULTIPLY_SPECTRUM_H
+#define XFIELDS_MULTIPLY_SPECTRUM_H
+
+// Multiplies in place all the n_slices slices of a complex (interleaved,
+// Fortran ordered) workspace by the same 2D complex spectrum of n_xy
+// elements, in a single pass.
+/*gpukern*/ void fftsolver_multiply_slices_by_spectrum(
+        const int64_t n_xy,
+        const int64_t n_slices,
+        const int64_t n_tot,
+        /*gpuglmem*/ double* workspace,
+        /*gpuglmem*/ const double* spectrum){
+
+    #pragma omp parallel for //only_for_context cpu_openmp
+    for (int64_t ii=0; ii<n_tot; ii++){ //vectorize_over ii n_tot
+        const int64_t ig = ii % n_xy;
+        const double a_re = workspace[2*ii];
+        const double a_im = workspace[2*ii + 1];
+        const double b_re = spectrum[2*ig];
+        const double b_im = spectrum[2*ig + 1];
+        workspace[2*ii]     = a_re*b_re - a_im*b_im;
+        workspace[2*ii + 1] = a_re*b_im + a_im*b_re;
+    }//end_vectorize
+}
+
+#endif